@@ -0,0 +1,38 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CMEM_BACKEND_H
+#define CMEM_BACKEND_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* an implementation of the cmem_buf.h API */
+typedef struct {
+	const char *name;
+	int (*init)(void);
+	int (*alloc)(unsigned int size, unsigned int align, void **cmem_buf);
+	void (*free)(void *cmem_buffer);
+	int (*cache_operation)(void *ptr, size_t size, int cache_operation);
+	unsigned long long (*get_phys)(void *ptr);	/* 0 when unknown */
+} cmem_backend;
+
+#ifdef HAVE_TICMEM
+extern const cmem_backend cmem_backend_ticmem;
+#endif
+extern const cmem_backend cmem_backend_dmabuf;
+
+#endif //CMEM_BACKEND_H
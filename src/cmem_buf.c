@@ -15,56 +15,394 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "cmem_buf.h"
+#include "cmem_backend.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
-#include <unistd.h>
-#include <ti/cmem.h>
-#include <sys/ioctl.h>
+#include <pthread.h>
+
+#ifndef DEFAULT_CMEM_BACKEND
+#define DEFAULT_CMEM_BACKEND "dmabuf"
+#endif
 
-#define CMEM_BLOCKID CMEM_CMABLOCKID
+#ifdef DEBUG
+#define ERROR(fmt, ...) \
+	do { fprintf(stderr, "ERROR:%s:%d: " fmt "\n", __func__, __LINE__,\
+##__VA_ARGS__); } while (0)
+#else
+#define ERROR(fmt, ...)
+#endif
 
-CMEM_AllocParams cmem_alloc_params = {
-	CMEM_HEAP,	/* type */
-	CMEM_CACHED,	/* flags */
-	1		/* alignment */
+/* environment variable overriding the configured backend */
+#define CMEM_BACKEND_ENV "GST_CMEM_BACKEND"
+
+static const cmem_backend *backends[] = {
+#ifdef HAVE_TICMEM
+	&cmem_backend_ticmem,
+#endif
+	&cmem_backend_dmabuf,
+	NULL
 };
 
+static const cmem_backend *backend;
+
+static const cmem_backend *find_backend(const char *name)
+{
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (strcmp(backends[i]->name, name) == 0)
+			return backends[i];
+	}
+
+	return NULL;
+}
+
 void init_cmem()
 {
-	CMEM_init();
+	const char *name;
+
+	if (backend)
+		return;
+
+	name = getenv(CMEM_BACKEND_ENV);
+	if (name == NULL || find_backend(name) == NULL)
+		name = DEFAULT_CMEM_BACKEND;
+
+	backend = find_backend(name);
+	if (backend == NULL)
+		backend = backends[0];
+
+	if (backend->init() < 0)
+		fprintf(stderr, "cmem backend %s: init failed\n", backend->name);
 }
 
-int alloc_cmem_buffer(unsigned int size, unsigned int align, void **cmem_buf)
+const char *cmem_backend_name()
+{
+	return backend ? backend->name : NULL;
+}
+
+/*
+ * Registry: buffers are kept on per-(size, align) free lists shared by
+ * the whole process, so consumers that rarely peak together reuse each
+ * other's buffers instead of each holding its own set.
+ *
+ * A pool is referenced by the consumers that allocated from it and by
+ * its buffers in use. When the last reference goes, its free buffers
+ * go back to the backend.
+ */
+typedef struct cmem_chunk {
+	struct cmem_chunk *next;
+	void *buf;
+	int fd;
+	cmem_consumer *owner;
+} cmem_chunk;
+
+typedef struct cmem_pool {
+	struct cmem_pool *next;
+	unsigned int size;
+	unsigned int align;
+	unsigned int refcount;
+	cmem_chunk *free_list;
+	cmem_chunk *used_list;
+} cmem_pool;
+
+struct cmem_consumer {
+	char name[32];
+	size_t quota;
+	size_t in_use;
+	cmem_pool **pools;
+	unsigned int num_pools;
+};
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static cmem_pool *pools;
+static cmem_stats stats;
+
+/* give the free buffers of a pool back to the backend */
+static size_t pool_drain(cmem_pool *pool)
+{
+	cmem_chunk *chunk;
+	size_t released = 0;
+
+	while ((chunk = pool->free_list) != NULL) {
+		pool->free_list = chunk->next;
+		backend->free(chunk->buf);
+		stats.allocated -= pool->size;
+		released += pool->size;
+		free(chunk);
+	}
+
+	return released;
+}
+
+static void pool_unref(cmem_pool *pool)
+{
+	cmem_pool **p;
+
+	if (--pool->refcount > 0)
+		return;
+
+	(void)pool_drain(pool);
+
+	for (p = &pools; *p; p = &(*p)->next) {
+		if (*p == pool) {
+			*p = pool->next;
+			break;
+		}
+	}
+	stats.pools--;
+	free(pool);
+}
+
+static cmem_pool *pool_get(cmem_consumer *consumer, unsigned int size,
+		unsigned int align)
+{
+	cmem_pool *pool, **tmp;
+	unsigned int i;
+
+	for (pool = pools; pool; pool = pool->next) {
+		if (pool->size == size && pool->align == align)
+			break;
+	}
+
+	if (pool == NULL) {
+		pool = calloc(1, sizeof(*pool));
+		if (pool == NULL)
+			return NULL;
+		pool->size = size;
+		pool->align = align;
+		pool->next = pools;
+		pools = pool;
+		stats.pools++;
+	}
+
+	/* the consumer keeps the pool alive until it goes away */
+	if (consumer) {
+		for (i = 0; i < consumer->num_pools; i++) {
+			if (consumer->pools[i] == pool)
+				return pool;
+		}
+
+		tmp = realloc(consumer->pools,
+				(consumer->num_pools + 1) * sizeof(*tmp));
+		if (tmp == NULL)
+			return pool;
+		consumer->pools = tmp;
+		consumer->pools[consumer->num_pools++] = pool;
+		pool->refcount++;
+	}
+
+	return pool;
+}
+
+cmem_consumer *cmem_consumer_new(const char *name, size_t quota)
+{
+	cmem_consumer *consumer;
+
+	consumer = calloc(1, sizeof(*consumer));
+	if (consumer == NULL)
+		return NULL;
+
+	snprintf(consumer->name, sizeof(consumer->name), "%s",
+			name ? name : "anonymous");
+	consumer->quota = quota;
+
+	pthread_mutex_lock(&registry_lock);
+	stats.consumers++;
+	pthread_mutex_unlock(&registry_lock);
+
+	return consumer;
+}
+
+void cmem_consumer_set_quota(cmem_consumer *consumer, size_t quota)
+{
+	pthread_mutex_lock(&registry_lock);
+	consumer->quota = quota;
+	pthread_mutex_unlock(&registry_lock);
+}
+
+void cmem_consumer_free(cmem_consumer *consumer)
 {
+	cmem_pool *pool;
+	cmem_chunk *chunk;
+	unsigned int i;
+
+	if (consumer == NULL)
+		return;
+
+	pthread_mutex_lock(&registry_lock);
+
+	/* buffers still out are returned without an owner */
+	for (pool = pools; pool; pool = pool->next) {
+		for (chunk = pool->used_list; chunk; chunk = chunk->next) {
+			if (chunk->owner == consumer)
+				chunk->owner = NULL;
+		}
+	}
+
+	for (i = 0; i < consumer->num_pools; i++)
+		pool_unref(consumer->pools[i]);
+	stats.consumers--;
+
+	pthread_mutex_unlock(&registry_lock);
+
+	free(consumer->pools);
+	free(consumer);
+}
+
+/*
+ * Free buffers stay cached for the next allocation of the same size.
+ * An idle consumer trims the pools it uses so the memory goes back to
+ * the backend; returns the bytes released.
+ */
+size_t cmem_consumer_trim(cmem_consumer *consumer)
+{
+	size_t released = 0;
+	unsigned int i;
+
+	if (consumer == NULL)
+		return 0;
+
+	pthread_mutex_lock(&registry_lock);
+
+	for (i = 0; i < consumer->num_pools; i++)
+		released += pool_drain(consumer->pools[i]);
+	stats.trimmed += released;
+
+	pthread_mutex_unlock(&registry_lock);
+
+	return released;
+}
+
+int alloc_cmem_buffer_for(cmem_consumer *consumer, unsigned int size,
+		unsigned int align, void **cmem_buf)
+{
+	cmem_pool *pool;
+	cmem_chunk *chunk;
 	int fd;
-	cmem_alloc_params.alignment = align;
 
-	*cmem_buf = CMEM_alloc2(CMEM_BLOCKID, size,
-		&cmem_alloc_params);
+	if (backend == NULL)
+		init_cmem();
+
+	pthread_mutex_lock(&registry_lock);
+	stats.requests++;
 
-	if(*cmem_buf == NULL){
-		return -ENOMEM;
+	if (consumer && consumer->quota &&
+			consumer->in_use + size > consumer->quota) {
+		ERROR("%s: quota of %zu bytes exceeded", consumer->name,
+				consumer->quota);
+		stats.quota_failures++;
+		goto failed;
 	}
 
-	fd = CMEM_export_dmabuf(*cmem_buf);
-	return (fd > 0 ? fd : -EFAULT); /* XXX: CMEM_export_dmabuf returns 0 if failed */
+	pool = pool_get(consumer, size, align);
+	if (pool == NULL)
+		goto failed;
+
+	chunk = pool->free_list;
+	if (chunk) {
+		pool->free_list = chunk->next;
+		stats.reused++;
+	}
+	else {
+		chunk = calloc(1, sizeof(*chunk));
+		if (chunk == NULL)
+			goto failed_pool;
+
+		fd = backend->alloc(size, align, &chunk->buf);
+		if (fd < 0) {
+			free(chunk);
+			goto failed_pool;
+		}
+		chunk->fd = fd;
+
+		stats.allocated += size;
+		if (stats.allocated > stats.peak_allocated)
+			stats.peak_allocated = stats.allocated;
+	}
+
+	chunk->owner = consumer;
+	chunk->next = pool->used_list;
+	pool->used_list = chunk;
+	pool->refcount++;
+
+	if (consumer)
+		consumer->in_use += size;
+	stats.in_use += size;
+
+	pthread_mutex_unlock(&registry_lock);
+
+	*cmem_buf = chunk->buf;
+	return chunk->fd;
+
+failed_pool:
+	/* a pool nobody references is dropped again */
+	pool->refcount++;
+	pool_unref(pool);
+failed:
+	pthread_mutex_unlock(&registry_lock);
+	return -1;
+}
+
+int alloc_cmem_buffer(unsigned int size, unsigned int align, void **cmem_buf)
+{
+	return alloc_cmem_buffer_for(NULL, size, align, cmem_buf);
 }
 
 void free_cmem_buffer(void *cmem_buffer)
 {
-	CMEM_free(cmem_buffer, &cmem_alloc_params);
+	cmem_pool *pool;
+	cmem_chunk **p, *chunk;
+
+	pthread_mutex_lock(&registry_lock);
+
+	for (pool = pools; pool; pool = pool->next) {
+		for (p = &pool->used_list; *p; p = &(*p)->next) {
+			if ((*p)->buf == cmem_buffer)
+				goto found;
+		}
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+	ERROR("unknown buffer %p", cmem_buffer);
+	return;
+
+found:
+	chunk = *p;
+	*p = chunk->next;
+
+	if (chunk->owner)
+		chunk->owner->in_use -= pool->size;
+	stats.in_use -= pool->size;
+
+	chunk->owner = NULL;
+	chunk->next = pool->free_list;
+	pool->free_list = chunk;
+	pool_unref(pool);
+
+	pthread_mutex_unlock(&registry_lock);
 }
 
-int cmem_do_cache_operation(void *ptr, size_t size, int cache_operation) 
+void cmem_get_stats(cmem_stats *out)
 {
-	int ret;
+	pthread_mutex_lock(&registry_lock);
+	*out = stats;
+	pthread_mutex_unlock(&registry_lock);
+}
 
-	if (cache_operation == CMEM_CACHE_FLUSH)
-		ret = CMEM_cacheWb(ptr, size);
-	else
-		ret = CMEM_cacheInv(ptr, size);
+int cmem_do_cache_operation(void *ptr, size_t size, int cache_operation)
+{
+	return backend->cache_operation(ptr, size, cache_operation);
+}
 
-	return (ret < 0 ? -EFAULT : 0);
+unsigned long long cmem_get_phys(void *ptr)
+{
+	return backend->get_phys(ptr);
 }
@@ -24,9 +24,35 @@
 #define CMEM_CACHE_FLUSH      0
 #define CMEM_CACHE_INVALIDATE 1
 
+/* a user of the shared buffers, with an optional quota in bytes */
+typedef struct cmem_consumer cmem_consumer;
+
+/* registry counters, reused / requests is the sharing efficiency */
+typedef struct {
+	unsigned long long requests;	/* buffers asked for */
+	unsigned long long reused;	/* served from a free list */
+	unsigned long long quota_failures;
+	size_t allocated;		/* bytes held from the backend */
+	size_t in_use;			/* bytes handed out */
+	size_t peak_allocated;
+	unsigned long long trimmed;	/* bytes given back by idle consumers */
+	unsigned int pools;		/* distinct (size, align) pairs */
+	unsigned int consumers;
+} cmem_stats;
+
 void init_cmem();
+const char *cmem_backend_name();
 int alloc_cmem_buffer(unsigned int size, unsigned int align, void **cmem_buf);
 void free_cmem_buffer(void *cmem_buffer);
+
+cmem_consumer *cmem_consumer_new(const char *name, size_t quota);
+void cmem_consumer_set_quota(cmem_consumer *consumer, size_t quota);
+void cmem_consumer_free(cmem_consumer *consumer);
+size_t cmem_consumer_trim(cmem_consumer *consumer);
+int alloc_cmem_buffer_for(cmem_consumer *consumer, unsigned int size,
+		unsigned int align, void **cmem_buf);
+void cmem_get_stats(cmem_stats *stats);
 int cmem_do_cache_operation(void *ptr, size_t size, int cache_operation);
+unsigned long long cmem_get_phys(void *ptr);
 
 #endif //CMEM_BUF_H
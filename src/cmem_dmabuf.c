@@ -0,0 +1,313 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Portable backend: dma-heap when the kernel has one, otherwise
+ * memfd + /dev/udmabuf. Cache maintenance goes through DMA_BUF_IOCTL_SYNC.
+ */
+
+/* memfd_create() and file sealing */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "cmem_buf.h"
+#include "cmem_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <linux/udmabuf.h>
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#ifdef DEBUG
+#define ERROR(fmt, ...) \
+	do { fprintf(stderr, "ERROR:%s:%d: " fmt "\n", __func__, __LINE__,\
+##__VA_ARGS__); } while (0)
+#else
+#define ERROR(fmt, ...)
+#endif
+
+/* environment variable selecting a dma-heap, e.g. "linux,cma" */
+#define DMA_HEAP_ENV "GST_CMEM_DMA_HEAP"
+
+/*
+ * Only physically contiguous heaps, the VPE can't DMA from scattered
+ * pages. "system" is, so it is only used when named in DMA_HEAP_ENV.
+ */
+static const char *default_heaps[] = {
+	"linux,cma",
+	"reserved",
+	NULL
+};
+
+typedef struct dmabuf_entry {
+	struct dmabuf_entry *next;
+	void *ptr;
+	size_t size;
+	int fd;
+} dmabuf_entry;
+
+static pthread_mutex_t entries_lock = PTHREAD_MUTEX_INITIALIZER;
+static dmabuf_entry *entries;
+
+static int heap_fd = -1;
+static int udmabuf_fd = -1;
+
+static int open_heap(const char *name)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), "/dev/dma_heap/%s", name);
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static int dmabuf_init(void)
+{
+	const char *name;
+	int i;
+
+	name = getenv(DMA_HEAP_ENV);
+	if (name)
+		heap_fd = open_heap(name);
+
+	for (i = 0; heap_fd < 0 && default_heaps[i]; i++)
+		heap_fd = open_heap(default_heaps[i]);
+
+	if (heap_fd >= 0)
+		return 0;
+
+	udmabuf_fd = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+	if (udmabuf_fd < 0) {
+		ERROR("neither dma-heap nor /dev/udmabuf available: %s", strerror(errno));
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+static int heap_alloc(size_t size)
+{
+	struct dma_heap_allocation_data data;
+
+	memset(&data, 0, sizeof(data));
+	data.len = size;
+	data.fd_flags = O_RDWR | O_CLOEXEC;
+
+	if (ioctl(heap_fd, DMA_HEAP_IOCTL_ALLOC, &data) < 0) {
+		ERROR("DMA_HEAP_IOCTL_ALLOC failed: %s", strerror(errno));
+		return -ENOMEM;
+	}
+
+	return (int)data.fd;
+}
+
+static int udmabuf_alloc(size_t size)
+{
+	struct udmabuf_create create;
+	int memfd, fd;
+
+	memfd = memfd_create("cmem", MFD_ALLOW_SEALING | MFD_CLOEXEC);
+	if (memfd < 0)
+		return -errno;
+
+	/* udmabuf requires the backing file to be unshrinkable */
+	if (ftruncate(memfd, size) < 0 ||
+		fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+		ERROR("memfd setup failed: %s", strerror(errno));
+		close(memfd);
+		return -ENOMEM;
+	}
+
+	memset(&create, 0, sizeof(create));
+	create.memfd = memfd;
+	create.flags = UDMABUF_FLAGS_CLOEXEC;
+	create.offset = 0;
+	create.size = size;
+
+	fd = ioctl(udmabuf_fd, UDMABUF_CREATE, &create);
+	if (fd < 0)
+		ERROR("UDMABUF_CREATE failed: %s", strerror(errno));
+
+	/* the dmabuf holds its own reference on the pages */
+	close(memfd);
+
+	return (fd < 0 ? -ENOMEM : fd);
+}
+
+static int dmabuf_alloc(unsigned int size, unsigned int align, void **cmem_buf)
+{
+	dmabuf_entry *entry;
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t len;
+	int fd;
+
+	*cmem_buf = NULL;
+
+	/* mappings are page aligned, which covers every alignment we ask for */
+	if (align > page)
+		ERROR("alignment %u not supported, using %zu", align, page);
+
+	len = (size + page - 1) & ~(page - 1);
+
+	if (heap_fd >= 0)
+		fd = heap_alloc(len);
+	else if (udmabuf_fd >= 0)
+		fd = udmabuf_alloc(len);
+	else
+		fd = -ENODEV;
+
+	if (fd < 0)
+		return fd;
+
+	entry = malloc(sizeof(*entry));
+	if (entry == NULL) {
+		close(fd);
+		return -ENOMEM;
+	}
+
+	entry->ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (entry->ptr == MAP_FAILED) {
+		ERROR("mmap failed: %s", strerror(errno));
+		free(entry);
+		close(fd);
+		return -ENOMEM;
+	}
+
+	entry->size = len;
+	entry->fd = fd;
+
+	pthread_mutex_lock(&entries_lock);
+	entry->next = entries;
+	entries = entry;
+	pthread_mutex_unlock(&entries_lock);
+
+	*cmem_buf = entry->ptr;
+	return fd;
+}
+
+/* entries_lock must be held */
+static dmabuf_entry **lookup_entry(void *ptr)
+{
+	dmabuf_entry **pentry;
+	char *p = ptr;
+
+	for (pentry = &entries; *pentry; pentry = &(*pentry)->next) {
+		char *base = (*pentry)->ptr;
+
+		if (p >= base && p < base + (*pentry)->size)
+			return pentry;
+	}
+
+	return NULL;
+}
+
+static void dmabuf_free(void *cmem_buffer)
+{
+	dmabuf_entry **pentry, *entry = NULL;
+
+	pthread_mutex_lock(&entries_lock);
+	pentry = lookup_entry(cmem_buffer);
+	if (pentry) {
+		entry = *pentry;
+		*pentry = entry->next;
+	}
+	pthread_mutex_unlock(&entries_lock);
+
+	if (entry == NULL) {
+		ERROR("unknown buffer %p", cmem_buffer);
+		return;
+	}
+
+	munmap(entry->ptr, entry->size);
+	close(entry->fd);
+	free(entry);
+}
+
+static int sync_dmabuf(int fd, uint64_t flags)
+{
+	struct dma_buf_sync sync;
+
+	memset(&sync, 0, sizeof(sync));
+	sync.flags = flags;
+	if (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+		ERROR("DMA_BUF_IOCTL_SYNC failed: %s", strerror(errno));
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+/*
+ * The sync ioctl always covers the whole dmabuf. Every START is paired
+ * with an END in the same direction: a START on the way to a write
+ * does nothing, its END cleans the cache; a read's START invalidates.
+ */
+static int dmabuf_cache_operation(void *ptr, size_t size, int cache_operation)
+{
+	dmabuf_entry **pentry;
+	uint64_t dir;
+	int fd = -1, ret;
+
+	pthread_mutex_lock(&entries_lock);
+	pentry = lookup_entry(ptr);
+	if (pentry)
+		fd = (*pentry)->fd;
+	pthread_mutex_unlock(&entries_lock);
+
+	if (fd < 0)
+		return -EFAULT;
+
+	/* flush ends a cpu write, invalidate starts a cpu read */
+	dir = cache_operation == CMEM_CACHE_FLUSH ?
+		DMA_BUF_SYNC_WRITE : DMA_BUF_SYNC_READ;
+
+	ret = sync_dmabuf(fd, DMA_BUF_SYNC_START | dir);
+	if (sync_dmabuf(fd, DMA_BUF_SYNC_END | dir) < 0)
+		ret = -EFAULT;
+
+	return ret;
+}
+
+/* the physical address is not visible to userspace here */
+static unsigned long long dmabuf_get_phys(void *ptr)
+{
+	return 0;
+}
+
+const cmem_backend cmem_backend_dmabuf = {
+	"dmabuf",
+	dmabuf_init,
+	dmabuf_alloc,
+	dmabuf_free,
+	dmabuf_cache_operation,
+	dmabuf_get_phys,
+};
@@ -0,0 +1,89 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "cmem_buf.h"
+#include "cmem_backend.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ti/cmem.h>
+#include <sys/ioctl.h>
+
+#define CMEM_BLOCKID CMEM_CMABLOCKID
+
+static CMEM_AllocParams cmem_alloc_params = {
+	CMEM_HEAP,	/* type */
+	CMEM_CACHED,	/* flags */
+	1		/* alignment */
+};
+
+static int ticmem_init(void)
+{
+	return CMEM_init();
+}
+
+static int ticmem_alloc(unsigned int size, unsigned int align, void **cmem_buf)
+{
+	int fd;
+	cmem_alloc_params.alignment = align;
+
+	*cmem_buf = CMEM_alloc2(CMEM_BLOCKID, size,
+		&cmem_alloc_params);
+
+	if(*cmem_buf == NULL){
+		return -ENOMEM;
+	}
+
+	fd = CMEM_export_dmabuf(*cmem_buf);
+	return (fd > 0 ? fd : -EFAULT); /* XXX: CMEM_export_dmabuf returns 0 if failed */
+}
+
+static void ticmem_free(void *cmem_buffer)
+{
+	CMEM_free(cmem_buffer, &cmem_alloc_params);
+}
+
+static int ticmem_cache_operation(void *ptr, size_t size, int cache_operation)
+{
+	int ret;
+
+	if (cache_operation == CMEM_CACHE_FLUSH)
+		ret = CMEM_cacheWb(ptr, size);
+	else
+		ret = CMEM_cacheInv(ptr, size);
+
+	return (ret < 0 ? -EFAULT : 0);
+}
+
+static unsigned long long ticmem_get_phys(void *ptr)
+{
+	return (unsigned long long)CMEM_getPhys(ptr);
+}
+
+const cmem_backend cmem_backend_ticmem = {
+	"ticmem",
+	ticmem_init,
+	ticmem_alloc,
+	ticmem_free,
+	ticmem_cache_operation,
+	ticmem_get_phys,
+};
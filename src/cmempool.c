@@ -47,7 +47,8 @@ gst_cmem_memory_alloc (GstAllocator * allocator, gsize size,
   mem->data = g_malloc (size);
   mem->fd = 0xdeadbeef;
 #else
-  mem->fd = alloc_cmem_buffer (size, 1, (void **)&mem->data);
+  mem->fd = alloc_cmem_buffer_for (((GstCMemMemoryAllocator *)allocator)->consumer,
+      size, 1, (void **)&mem->data);
   if (mem->fd < 0) {
     GST_WARNING_OBJECT (allocator, "cmem alloc failed(%d)", mem->fd);
     return NULL;
@@ -95,13 +96,26 @@ gst_cmem_memory_unmap (GstCMemMemory * mem)
 G_DEFINE_TYPE (GstCMemMemoryAllocator, gst_cmem_memory_allocator,
     GST_TYPE_ALLOCATOR);
 
+static void
+gst_cmem_memory_allocator_finalize (GObject * object)
+{
+  GstCMemMemoryAllocator *allocator = (GstCMemMemoryAllocator *) object;
+
+  /* free buffers of sizes nobody else uses go back to the backend */
+  cmem_consumer_free (allocator->consumer);
+
+  G_OBJECT_CLASS (gst_cmem_memory_allocator_parent_class)->finalize (object);
+}
+
 static void
 gst_cmem_memory_allocator_class_init (GstCMemMemoryAllocatorClass * klass)
 {
+  GObjectClass *gobject_class = (GObjectClass *) klass;
   GstAllocatorClass *allocator_class;
 
   allocator_class = (GstAllocatorClass *) klass;
 
+  gobject_class->finalize = gst_cmem_memory_allocator_finalize;
   allocator_class->alloc = gst_cmem_memory_alloc;
   allocator_class->free = gst_cmem_memory_free;
 
@@ -119,6 +133,48 @@ gst_cmem_memory_allocator_init (GstCMemMemoryAllocator * allocator)
   alloc->mem_unmap = (GstMemoryUnmapFunction) gst_cmem_memory_unmap;
 
   GST_OBJECT_FLAG_SET (allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+
+  allocator->consumer = cmem_consumer_new (GST_CMEM_ALLOCATOR_NAME, 0);
+}
+
+/* 0 lifts the limit */
+void
+gst_cmem_memory_allocator_set_quota (GstAllocator * allocator, gsize quota)
+{
+  g_return_if_fail (GST_IS_CMEM_MEMORY_ALLOCATOR (allocator));
+
+  cmem_consumer_set_quota (((GstCMemMemoryAllocator *)allocator)->consumer,
+      quota);
+}
+
+/* for CMEM buffers an element allocates outside of GstMemory */
+cmem_consumer *
+gst_cmem_memory_allocator_get_consumer (GstAllocator * allocator)
+{
+  g_return_val_if_fail (GST_IS_CMEM_MEMORY_ALLOCATOR (allocator), NULL);
+
+  return ((GstCMemMemoryAllocator *)allocator)->consumer;
+}
+
+/* the registry counters, for the elements' stats properties */
+GstStructure *
+gst_cmem_get_stats (void)
+{
+  cmem_stats stats;
+
+  cmem_get_stats (&stats);
+
+  return gst_structure_new ("cmem-stats",
+      "backend", G_TYPE_STRING, cmem_backend_name (),
+      "requests", G_TYPE_UINT64, (guint64) stats.requests,
+      "reused", G_TYPE_UINT64, (guint64) stats.reused,
+      "quota-failures", G_TYPE_UINT64, (guint64) stats.quota_failures,
+      "allocated", G_TYPE_UINT64, (guint64) stats.allocated,
+      "in-use", G_TYPE_UINT64, (guint64) stats.in_use,
+      "peak-allocated", G_TYPE_UINT64, (guint64) stats.peak_allocated,
+      "trimmed", G_TYPE_UINT64, (guint64) stats.trimmed,
+      "pools", G_TYPE_UINT, stats.pools,
+      "consumers", G_TYPE_UINT, stats.consumers, NULL);
 }
 
 
@@ -167,8 +223,10 @@ cmem_buffer_pool_set_config (GstBufferPool * pool, GstStructure * config)
   cpool->caps = gst_caps_ref (caps);
 
   cpool->info = info;
+  cpool->size = MAX (size, info.size);
+  cpool->min_buffers = min_buffers;
 
-  gst_buffer_pool_config_set_params (config, caps, info.size, min_buffers,
+  gst_buffer_pool_config_set_params (config, caps, cpool->size, min_buffers,
       max_buffers);
 
   return GST_BUFFER_POOL_CLASS (parent_class)->set_config (pool, config);
@@ -200,14 +258,17 @@ cmem_buffer_pool_alloc (GstBufferPool * pool, GstBuffer ** buffer,
   GstBuffer *newbuf;
   GstMemory *mem;
 
-  mem = gst_allocator_alloc (cpool->allocator, cpool->info.size, NULL);
+  mem = gst_allocator_alloc (cpool->allocator, cpool->size, NULL);
   if (mem == NULL)
     goto no_mem;
 
   newbuf = gst_buffer_new ();
   gst_buffer_append_memory (newbuf, mem);
+  gst_buffer_add_cmem_meta (newbuf, (GstCMemMemory *) mem);
   *buffer = newbuf;
 
+  g_atomic_int_inc (&cpool->allocated);
+
   return GST_FLOW_OK;
 
 no_mem:
@@ -217,6 +278,105 @@ no_mem:
   }
 }
 
+static void
+cmem_buffer_pool_free (GstBufferPool * pool, GstBuffer * buffer)
+{
+  GstCMemBufferPool *cpool = GST_CMEM_BUFFER_POOL_CAST (pool);
+
+  g_atomic_int_add (&cpool->allocated, -1);
+
+  GST_BUFFER_POOL_CLASS (parent_class)->free_buffer (pool, buffer);
+}
+
+static void
+cmem_buffer_pool_reset (GstBufferPool * pool, GstBuffer * buffer)
+{
+  GstCMemMeta *cmeta;
+
+  /* the pooled meta outlives the last user, who may have written the
+   * memory through the CPU caches */
+  cmeta = (GstCMemMeta *) gst_buffer_get_meta (buffer, GST_CMEM_META_API_TYPE);
+  if (cmeta)
+    cmeta->cache_state = GST_CMEM_CACHE_CPU_DIRTY;
+
+  GST_BUFFER_POOL_CLASS (parent_class)->reset_buffer (pool, buffer);
+}
+
+static GstFlowReturn
+cmem_buffer_pool_acquire (GstBufferPool * pool, GstBuffer ** buffer,
+    GstBufferPoolAcquireParams * params)
+{
+  GstCMemBufferPool *cpool = GST_CMEM_BUFFER_POOL_CAST (pool);
+  GstFlowReturn ret;
+
+  ret = GST_BUFFER_POOL_CLASS (parent_class)->acquire_buffer (pool, buffer,
+      params);
+  if (ret == GST_FLOW_OK) {
+    g_atomic_int_inc (&cpool->outstanding);
+    /* streaming again, keep what comes back */
+    cpool->trimmed = FALSE;
+  }
+
+  return ret;
+}
+
+static void
+cmem_buffer_pool_release (GstBufferPool * pool, GstBuffer * buffer)
+{
+  GstCMemBufferPool *cpool = GST_CMEM_BUFFER_POOL_CAST (pool);
+
+  g_atomic_int_add (&cpool->outstanding, -1);
+
+  /* a tagged buffer is freed by the base class instead of queued */
+  if (cpool->trimmed &&
+      g_atomic_int_get (&cpool->allocated) > (gint) cpool->min_buffers)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_TAG_MEMORY);
+
+  GST_BUFFER_POOL_CLASS (parent_class)->release_buffer (pool, buffer);
+}
+
+/**
+ * gst_cmem_buffer_pool_trim:
+ * @pool: a #GstCMemBufferPool
+ *
+ * Free the idle buffers of @pool down to its configured minimum and give
+ * the memory back to CMEM. Buffers still in use are freed as they are
+ * released, until the pool hands out a buffer again.
+ */
+void
+gst_cmem_buffer_pool_trim (GstBufferPool * pool)
+{
+  GstCMemBufferPool *cpool;
+  GstBufferPoolAcquireParams params = { 0, };
+  GstBuffer *buffer;
+  gsize released;
+
+  g_return_if_fail (GST_IS_CMEM_BUFFER_POOL (pool));
+
+  cpool = GST_CMEM_BUFFER_POOL_CAST (pool);
+  cpool->trimmed = TRUE;
+
+  /* take the queued buffers directly, so they don't count as handed out */
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+  while (g_atomic_int_get (&cpool->allocated) >
+      g_atomic_int_get (&cpool->outstanding) &&
+      g_atomic_int_get (&cpool->allocated) > (gint) cpool->min_buffers) {
+    if (GST_BUFFER_POOL_CLASS (parent_class)->acquire_buffer (pool, &buffer,
+            &params) != GST_FLOW_OK)
+      break;
+
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_TAG_MEMORY);
+    GST_BUFFER_POOL_CLASS (parent_class)->release_buffer (pool, buffer);
+  }
+
+  /* the freed buffers are still cached by the registry */
+  released = cmem_consumer_trim (
+      gst_cmem_memory_allocator_get_consumer (cpool->allocator));
+
+  GST_DEBUG_OBJECT (pool, "trimmed to %d buffer(s), %" G_GSIZE_FORMAT
+      " bytes released", g_atomic_int_get (&cpool->allocated), released);
+}
+
 GstBufferPool *
 gst_cmem_buffer_pool_new (void)
 {
@@ -254,6 +414,10 @@ gst_cmem_buffer_pool_class_init (GstCMemBufferPoolClass * klass)
 
   gstbufferpool_class->set_config = cmem_buffer_pool_set_config;
   gstbufferpool_class->alloc_buffer = cmem_buffer_pool_alloc;
+  gstbufferpool_class->free_buffer = cmem_buffer_pool_free;
+  gstbufferpool_class->reset_buffer = cmem_buffer_pool_reset;
+  gstbufferpool_class->acquire_buffer = cmem_buffer_pool_acquire;
+  gstbufferpool_class->release_buffer = cmem_buffer_pool_release;
 
   GST_DEBUG_CATEGORY_INIT (gst_cmem_pool_debug, "cmempool", 0,
       "cmempool");
@@ -262,7 +426,10 @@ gst_cmem_buffer_pool_class_init (GstCMemBufferPoolClass * klass)
 static void
 gst_cmem_buffer_pool_init (GstCMemBufferPool * pool)
 {
-  /* nothing to do here */
+  pool->min_buffers = 0;
+  pool->allocated = 0;
+  pool->outstanding = 0;
+  pool->trimmed = FALSE;
 }
 
 static void
@@ -24,6 +24,9 @@
 #include <gst/video/gstvideometa.h>
 #include <gst/video/gstvideopool.h>
 
+#include "cmem_buf.h"
+#include "gstcmemmeta.h"
+
 G_BEGIN_DECLS
 
 typedef struct _GstCMemMemory GstCMemMemory;
@@ -64,6 +67,13 @@ struct _GstCMemBufferPool
   GstCaps *caps;
   GstVideoInfo info;
   guint32 fourcc;
+  gsize size;         /* of each buffer, the frame or more when configured so */
+
+  /* trimming, the counters are atomic */
+  guint min_buffers;
+  gint allocated;
+  gint outstanding;
+  gboolean trimmed;
 };
 
 struct _GstCMemBufferPoolClass
@@ -74,18 +84,43 @@ struct _GstCMemBufferPoolClass
 GType gst_cmem_buffer_pool_get_type (void);
 
 GstBufferPool * gst_cmem_buffer_pool_new     (void);
+void            gst_cmem_buffer_pool_trim    (GstBufferPool * pool);
 
 
-typedef GstAllocator GstCMemMemoryAllocator;
+/**
+ * GstCMemMemoryAllocator:
+ * @consumer: registry handle the allocations are accounted to
+ *
+ * Allocates from the process-wide CMEM registry, see cmem_buf.h.
+ */
+typedef struct {
+  GstAllocator parent;
+  cmem_consumer *consumer;
+} GstCMemMemoryAllocator;
 typedef GstAllocatorClass GstCMemMemoryAllocatorClass;
 
 GType gst_cmem_memory_allocator_get_type (void);
 
+void gst_cmem_memory_allocator_set_quota (GstAllocator * allocator, gsize quota);
+cmem_consumer * gst_cmem_memory_allocator_get_consumer (GstAllocator * allocator);
+
+GstStructure * gst_cmem_get_stats (void);
+
 #define GST_CMEM_ALLOCATOR_NAME "cmem_allocator"
 #define GST_TYPE_CMEM_MEMORY_ALLOCATOR   (gst_cmem_memory_allocator_get_type())
 #define GST_IS_CMEM_MEMORY_ALLOCATOR(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_CMEM_MEMORY_ALLOCATOR))
 
 
+/* plugin side of the public GstCMemMeta */
+GType gst_cmem_meta_api_get_type (void);
+#define GST_CMEM_META_API_TYPE (gst_cmem_meta_api_get_type())
+
+const GstMetaInfo *gst_cmem_meta_get_info (void);
+#define GST_CMEM_META_INFO (gst_cmem_meta_get_info())
+
+GstCMemMeta *gst_buffer_add_cmem_meta (GstBuffer * buffer, GstCMemMemory * mem);
+
+
 /* XXX: roughly determined value */
 #define CMEM_POOL_MIN_BUF_NUM 3
 #define CMEM_POOL_MAX_BUF_NUM 8
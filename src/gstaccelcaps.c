@@ -0,0 +1,346 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <linux/videodev2.h>
+
+#include <gst/video/video.h>
+
+#include "gstaccelcaps.h"
+#include "gstaccelfixup.h"
+#include "v4l2_m2m.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_accel_caps_debug);
+#define GST_CAT_DEFAULT gst_accel_caps_debug
+
+/* bump when the probing changes what it writes */
+#define CACHE_VERSION 1
+
+typedef struct {
+  GstCaps *sink_caps;
+  GstCaps *src_caps;
+} ProbedCaps;
+
+/* device path -> ProbedCaps, for the life of the process */
+static GMutex probe_lock;
+static GHashTable *probed;
+
+
+static void
+probed_caps_free (ProbedCaps *p)
+{
+  gst_caps_unref (p->sink_caps);
+  gst_caps_unref (p->src_caps);
+  g_free (p);
+}
+
+
+/* the formats a fourcc stands for, the inverse of get_v4l2_fmt() */
+static guint
+fourcc_to_formats (uint32_t fourcc, GstVideoFormat fmts[2])
+{
+  switch (fourcc) {
+    case V4L2_PIX_FMT_YUYV:
+      fmts[0] = GST_VIDEO_FORMAT_YUY2;
+      return 1;
+    case V4L2_PIX_FMT_RGB24:
+      fmts[0] = GST_VIDEO_FORMAT_RGB;
+      return 1;
+    case V4L2_PIX_FMT_BGR24:
+      fmts[0] = GST_VIDEO_FORMAT_BGR;
+      return 1;
+    case V4L2_PIX_FMT_RGB32:
+      fmts[0] = GST_VIDEO_FORMAT_ARGB;
+      fmts[1] = GST_VIDEO_FORMAT_xRGB;
+      return 2;
+    case V4L2_PIX_FMT_BGR32:
+      fmts[0] = GST_VIDEO_FORMAT_ABGR;
+      fmts[1] = GST_VIDEO_FORMAT_xBGR;
+      return 2;
+    default:
+      fmts[0] = gst_video_format_from_fourcc (fourcc);
+      return fmts[0] != GST_VIDEO_FORMAT_UNKNOWN ? 1 : 0;
+  }
+}
+
+
+static void
+append_format (GstCaps *caps, GstVideoFormat fmt,
+    const struct v4l2_frmsize_stepwise *range)
+{
+  GstStructure *st;
+
+  st = gst_structure_new ("video/x-raw",
+      "format", G_TYPE_STRING, gst_video_format_to_string (fmt), NULL);
+
+  if (range->min_width < range->max_width)
+    gst_structure_set (st, "width", GST_TYPE_INT_RANGE,
+        (gint)range->min_width, (gint)range->max_width, NULL);
+  else
+    gst_structure_set (st, "width", G_TYPE_INT, (gint)range->min_width, NULL);
+
+  if (range->min_height < range->max_height)
+    gst_structure_set (st, "height", GST_TYPE_INT_RANGE,
+        (gint)range->min_height, (gint)range->max_height, NULL);
+  else
+    gst_structure_set (st, "height", G_TYPE_INT, (gint)range->min_height,
+        NULL);
+
+  gst_structure_set (st, "framerate", GST_TYPE_FRACTION_RANGE,
+      0, 1, G_MAXINT, 1, NULL);
+
+  gst_caps_append_structure (caps, st);
+}
+
+
+/* every format of one queue with the sizes it takes */
+static GstCaps *
+probe_queue (gint fd, gboolean is_input)
+{
+  GstCaps *caps;
+  GstVideoFormat fmts[2], fixed, native;
+  struct v4l2_frmsize_stepwise range;
+  uint32_t fourcc;
+  guint index, n, i;
+
+  caps = gst_caps_new_empty ();
+
+  for (index = 0; v4l2_enum_format (fd, index, is_input, &fourcc) == 0;
+      index++) {
+    n = fourcc_to_formats (fourcc, fmts);
+    if (n == 0) {
+      GST_DEBUG ("skipping %" GST_FOURCC_FORMAT, GST_FOURCC_ARGS (fourcc));
+      continue;
+    }
+
+    if (v4l2_get_size_range (fd, fourcc, is_input, &range) < 0) {
+      GST_DEBUG ("no sizes for %" GST_FOURCC_FORMAT, GST_FOURCC_ARGS (fourcc));
+      continue;
+    }
+
+    for (i = 0; i < n; i++)
+      append_format (caps, fmts[i], &range);
+  }
+
+  if (is_input)
+    return caps;
+
+  /* the formats converted on the copy out, with the sizes of their native */
+  for (i = 0; gst_accel_fixup_get_nth (i, &fixed, &native); i++) {
+    GstCaps *native_caps;
+
+    native_caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING,
+        gst_video_format_to_string (native), NULL);
+    if (gst_caps_can_intersect (caps, native_caps)) {
+      GstStructure *st;
+      GstCaps *tmp;
+
+      tmp = gst_caps_intersect (caps, native_caps);
+      st = gst_structure_copy (gst_caps_get_structure (tmp, 0));
+      gst_structure_set (st, "format", G_TYPE_STRING,
+          gst_video_format_to_string (fixed), NULL);
+      gst_caps_append_structure (caps, st);
+      gst_caps_unref (tmp);
+    }
+    gst_caps_unref (native_caps);
+  }
+
+  return caps;
+}
+
+
+static gchar *
+cache_file (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "gstreamer-1.0",
+      "acceltransform-caps.ini", NULL);
+}
+
+
+static gchar *
+cache_group (const gchar *driver, uint32_t version)
+{
+  return g_strdup_printf ("%s %u.%u.%u", driver, (version >> 16) & 0xff,
+      (version >> 8) & 0xff, version & 0xff);
+}
+
+
+static gboolean
+cache_load (const gchar *group, GstCaps **sink_caps, GstCaps **src_caps)
+{
+  GKeyFile *kf;
+  gchar *path, *sink = NULL, *src = NULL;
+  gboolean ret = FALSE;
+
+  kf = g_key_file_new ();
+  path = cache_file ();
+
+  if (!g_key_file_load_from_file (kf, path, G_KEY_FILE_NONE, NULL))
+    goto done;
+  if (g_key_file_get_integer (kf, group, "cache-version", NULL) !=
+      CACHE_VERSION)
+    goto done;
+
+  sink = g_key_file_get_string (kf, group, "sink-caps", NULL);
+  src = g_key_file_get_string (kf, group, "src-caps", NULL);
+  if (sink == NULL || src == NULL)
+    goto done;
+
+  *sink_caps = gst_caps_from_string (sink);
+  *src_caps = gst_caps_from_string (src);
+  if (*sink_caps == NULL || *src_caps == NULL) {
+    gst_caps_replace (sink_caps, NULL);
+    gst_caps_replace (src_caps, NULL);
+    goto done;
+  }
+
+  ret = TRUE;
+
+done:
+  g_free (sink);
+  g_free (src);
+  g_free (path);
+  g_key_file_free (kf);
+  return ret;
+}
+
+
+/* best effort, a read-only home only costs the probing next time */
+static void
+cache_store (const gchar *group, GstCaps *sink_caps, GstCaps *src_caps)
+{
+  GKeyFile *kf;
+  gchar *path, *dir, *str;
+  GError *err = NULL;
+
+  kf = g_key_file_new ();
+  path = cache_file ();
+
+  /* keep the other drivers' groups */
+  (void)g_key_file_load_from_file (kf, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+  g_key_file_set_integer (kf, group, "cache-version", CACHE_VERSION);
+  str = gst_caps_to_string (sink_caps);
+  g_key_file_set_string (kf, group, "sink-caps", str);
+  g_free (str);
+  str = gst_caps_to_string (src_caps);
+  g_key_file_set_string (kf, group, "src-caps", str);
+  g_free (str);
+
+  dir = g_path_get_dirname (path);
+  (void)g_mkdir_with_parents (dir, 0755);
+  if (!g_key_file_save_to_file (kf, path, &err)) {
+    GST_DEBUG ("can't write %s: %s", path, err->message);
+    g_error_free (err);
+  }
+
+  g_free (dir);
+  g_free (path);
+  g_key_file_free (kf);
+}
+
+
+static ProbedCaps *
+probe_device (const gchar *device)
+{
+  ProbedCaps *p = NULL;
+  gchar driver[32], *group = NULL;
+  uint32_t version;
+  GstCaps *sink_caps, *src_caps;
+  gint fd;
+
+  fd = v4l2_open (device);
+  if (fd < 0) {
+    GST_DEBUG ("open %s failed: %s", device, g_strerror (errno));
+    return NULL;
+  }
+
+  if (v4l2_query_driver (fd, driver, sizeof (driver), &version) < 0)
+    goto done;
+
+  group = cache_group (driver, version);
+  if (cache_load (group, &sink_caps, &src_caps)) {
+    GST_DEBUG ("%s: cached caps of %s", device, group);
+  }
+  else {
+    sink_caps = probe_queue (fd, TRUE);
+    src_caps = probe_queue (fd, FALSE);
+    if (gst_caps_is_empty (sink_caps) || gst_caps_is_empty (src_caps)) {
+      GST_WARNING ("%s: no usable formats", device);
+      gst_caps_unref (sink_caps);
+      gst_caps_unref (src_caps);
+      goto done;
+    }
+    GST_INFO ("%s: probed %s", device, group);
+    cache_store (group, sink_caps, src_caps);
+  }
+
+  GST_DEBUG ("sink %" GST_PTR_FORMAT ", src %" GST_PTR_FORMAT, sink_caps,
+      src_caps);
+
+  p = g_new (ProbedCaps, 1);
+  p->sink_caps = sink_caps;
+  p->src_caps = src_caps;
+
+done:
+  g_free (group);
+  v4l2_close (fd);
+  return p;
+}
+
+
+gboolean
+gst_accel_caps_probe (const gchar *device, GstCaps **sink_caps,
+    GstCaps **src_caps)
+{
+  ProbedCaps *p;
+
+  g_mutex_lock (&probe_lock);
+
+  if (G_UNLIKELY (probed == NULL)) {
+    GST_DEBUG_CATEGORY_INIT (gst_accel_caps_debug, "accelcaps", 0,
+        "M2M device capabilities");
+    probed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) probed_caps_free);
+  }
+
+  /* a device that can't be probed is asked again next time */
+  p = g_hash_table_lookup (probed, device);
+  if (p == NULL) {
+    p = probe_device (device);
+    if (p)
+      g_hash_table_insert (probed, g_strdup (device), p);
+  }
+
+  if (p) {
+    *sink_caps = gst_caps_ref (p->sink_caps);
+    *src_caps = gst_caps_ref (p->src_caps);
+  }
+
+  g_mutex_unlock (&probe_lock);
+
+  return p != NULL;
+}
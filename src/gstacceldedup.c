@@ -0,0 +1,109 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstacceldedup.h"
+
+/* one row in this many is read */
+#define ROW_STEP 4
+
+#define GRID GST_ACCEL_SIGNATURE_GRID
+
+
+/* a plain loop over bytes, which the compiler turns into vector adds */
+static inline guint32
+sum_bytes (const guint8 *p, guint n)
+{
+  guint32 sum = 0;
+  guint i;
+
+  for (i = 0; i < n; i++)
+    sum += p[i];
+
+  return sum;
+}
+
+
+gboolean
+gst_accel_signature_compute (GstAccelSignature *sig, GstBuffer *buffer,
+    const GstVideoInfo *info)
+{
+  GstVideoFrame frame;
+  const guint8 *data, *row;
+  guint row_bytes, height, stride, bw, bh, bx, by, y;
+  guint32 *sum;
+
+  if (!gst_video_frame_map (&frame, (GstVideoInfo *) info, buffer,
+          GST_MAP_READ))
+    return FALSE;
+
+  data = GST_VIDEO_FRAME_PLANE_DATA (&frame, 0);
+  stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0);
+  row_bytes = GST_VIDEO_FRAME_COMP_WIDTH (&frame, 0) *
+      GST_VIDEO_FRAME_COMP_PSTRIDE (&frame, 0);
+  height = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, 0);
+
+  bw = row_bytes / GRID;
+  bh = height / GRID;
+  if (bw == 0 || bh == 0) {
+    gst_video_frame_unmap (&frame);
+    return FALSE;
+  }
+
+  memset (sig->sum, 0, sizeof (sig->sum));
+  sig->samples = bw * ((bh + ROW_STEP - 1) / ROW_STEP);
+
+  for (by = 0; by < GRID; by++) {
+    sum = &sig->sum[by * GRID];
+    for (y = by * bh; y < (by + 1) * bh; y += ROW_STEP) {
+      row = data + (gsize) y * stride;
+      for (bx = 0; bx < GRID; bx++)
+        sum[bx] += sum_bytes (row + bx * bw, bw);
+    }
+  }
+
+  gst_video_frame_unmap (&frame);
+
+  return TRUE;
+}
+
+
+gboolean
+gst_accel_signature_match (const GstAccelSignature *a,
+    const GstAccelSignature *b, guint threshold)
+{
+  guint32 limit;
+  guint i;
+
+  if (a->samples != b->samples || a->samples == 0)
+    return FALSE;
+
+  limit = threshold * a->samples;
+  for (i = 0; i < GRID * GRID; i++) {
+    if ((a->sum[i] > b->sum[i] ?
+            a->sum[i] - b->sum[i] : b->sum[i] - a->sum[i]) > limit)
+      return FALSE;
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,50 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ACCEL_DEDUP_H__
+#define __GST_ACCEL_DEDUP_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* the first plane cut into a grid of blocks */
+#define GST_ACCEL_SIGNATURE_GRID 8
+
+/*
+ * A cheap fingerprint of a frame for telling unchanged frames apart: the
+ * sum of every sampled byte per block of the first plane, read from
+ * every few rows only. Noise averages out over a block, a moving object
+ * shifts the sum of the blocks it crosses.
+ */
+typedef struct {
+  guint32 sum[GST_ACCEL_SIGNATURE_GRID * GST_ACCEL_SIGNATURE_GRID];
+  guint samples;    /* bytes summed per block */
+} GstAccelSignature;
+
+gboolean gst_accel_signature_compute (GstAccelSignature *sig,
+    GstBuffer *buffer, const GstVideoInfo *info);
+
+/* TRUE when no block's mean moved by more than threshold (0-255) */
+gboolean gst_accel_signature_match (const GstAccelSignature *a,
+    const GstAccelSignature *b, guint threshold);
+
+G_END_DECLS
+
+#endif /* __GST_ACCEL_DEDUP_H__ */
@@ -0,0 +1,260 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
+
+#include "gstaccelfixup.h"
+
+static const struct {
+  GstVideoFormat format;
+  GstVideoFormat native;
+} fixups[] = {
+  {GST_VIDEO_FORMAT_I420, GST_VIDEO_FORMAT_NV12},   /* chroma plane split */
+  {GST_VIDEO_FORMAT_BGRA, GST_VIDEO_FORMAT_ARGB},   /* swizzle, opaque alpha */
+  {GST_VIDEO_FORMAT_RGBA, GST_VIDEO_FORMAT_ARGB},   /* swizzle, opaque alpha */
+  {GST_VIDEO_FORMAT_GBR, GST_VIDEO_FORMAT_RGB},     /* planar RGB */
+};
+
+
+gboolean
+gst_accel_fixup_get_native (GstVideoFormat format, GstVideoFormat *native)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (fixups); i++) {
+    if (fixups[i].format == format) {
+      if (native)
+        *native = fixups[i].native;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+
+/* the index-th format with a fixup, FALSE past the last */
+gboolean
+gst_accel_fixup_get_nth (guint index, GstVideoFormat *format,
+    GstVideoFormat *native)
+{
+  if (index >= G_N_ELEMENTS (fixups))
+    return FALSE;
+
+  *format = fixups[index].format;
+  *native = fixups[index].native;
+  return TRUE;
+}
+
+
+/* UVUV... -> UU.. VV.. */
+static void
+split_uv_row (const guint8 *src, guint8 *u, guint8 *v, gint width)
+{
+  gint i = 0;
+
+#if defined(HAVE_NEON)
+  for (; i + 16 <= width; i += 16) {
+    uint8x16x2_t uv = vld2q_u8 (src + 2 * i);
+    vst1q_u8 (u + i, uv.val[0]);
+    vst1q_u8 (v + i, uv.val[1]);
+  }
+#elif defined(HAVE_SSE2)
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+
+  for (; i + 16 <= width; i += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *)(src + 2 * i));
+    __m128i b = _mm_loadu_si128 ((const __m128i *)(src + 2 * i + 16));
+    _mm_storeu_si128 ((__m128i *)(u + i), _mm_packus_epi16 (
+            _mm_and_si128 (a, mask), _mm_and_si128 (b, mask)));
+    _mm_storeu_si128 ((__m128i *)(v + i), _mm_packus_epi16 (
+            _mm_srli_epi16 (a, 8), _mm_srli_epi16 (b, 8)));
+  }
+#endif
+
+  for (; i < width; i++) {
+    u[i] = src[2 * i];
+    v[i] = src[2 * i + 1];
+  }
+}
+
+
+/* A R G B -> B G R A or R G B A, alpha forced opaque */
+static void
+swizzle_argb_row (const guint8 *src, guint8 *dest, gint width, gboolean bgra)
+{
+  gint i = 0;
+
+#if defined(HAVE_NEON)
+  const uint8x16_t alpha = vdupq_n_u8 (0xff);
+
+  for (; i + 16 <= width; i += 16) {
+    uint8x16x4_t in = vld4q_u8 (src + 4 * i);
+    uint8x16x4_t out;
+
+    if (bgra) {
+      out.val[0] = in.val[3];
+      out.val[1] = in.val[2];
+      out.val[2] = in.val[1];
+    }
+    else {
+      out.val[0] = in.val[1];
+      out.val[1] = in.val[2];
+      out.val[2] = in.val[3];
+    }
+    out.val[3] = alpha;
+    vst4q_u8 (dest + 4 * i, out);
+  }
+#elif defined(HAVE_SSE2)
+  /* little endian: a pixel is A | R << 8 | G << 16 | B << 24 */
+  const __m128i alpha = _mm_set1_epi32 (0xff000000);
+  const __m128i m1 = _mm_set1_epi32 (0x0000ff00);
+  const __m128i m2 = _mm_set1_epi32 (0x00ff0000);
+
+  for (; i + 4 <= width; i += 4) {
+    __m128i p = _mm_loadu_si128 ((const __m128i *)(src + 4 * i));
+    __m128i r;
+
+    if (bgra)
+      r = _mm_or_si128 (_mm_or_si128 (_mm_srli_epi32 (p, 24),
+              _mm_and_si128 (_mm_srli_epi32 (p, 8), m1)),
+          _mm_and_si128 (_mm_slli_epi32 (p, 8), m2));
+    else
+      r = _mm_srli_epi32 (p, 8);
+    _mm_storeu_si128 ((__m128i *)(dest + 4 * i), _mm_or_si128 (r, alpha));
+  }
+#endif
+
+  for (; i < width; i++) {
+    const guint8 *s = src + 4 * i;
+    guint8 *d = dest + 4 * i;
+
+    if (bgra) {
+      d[0] = s[3];
+      d[1] = s[2];
+      d[2] = s[1];
+    }
+    else {
+      d[0] = s[1];
+      d[1] = s[2];
+      d[2] = s[3];
+    }
+    d[3] = 0xff;
+  }
+}
+
+
+/* R G B -> G.. B.. R.. */
+static void
+split_rgb_row (const guint8 *src, guint8 *g, guint8 *b, guint8 *r, gint width)
+{
+  gint i = 0;
+
+#if defined(HAVE_NEON)
+  for (; i + 16 <= width; i += 16) {
+    uint8x16x3_t rgb = vld3q_u8 (src + 3 * i);
+    vst1q_u8 (r + i, rgb.val[0]);
+    vst1q_u8 (g + i, rgb.val[1]);
+    vst1q_u8 (b + i, rgb.val[2]);
+  }
+#endif
+
+  for (; i < width; i++) {
+    r[i] = src[3 * i];
+    g[i] = src[3 * i + 1];
+    b[i] = src[3 * i + 2];
+  }
+}
+
+
+static void
+copy_plane (GstVideoFrame *dest, gint plane, const guint8 *src, gint stride,
+    gint width_bytes, gint height)
+{
+  guint8 *d = GST_VIDEO_FRAME_PLANE_DATA (dest, plane);
+  gint dstride = GST_VIDEO_FRAME_PLANE_STRIDE (dest, plane);
+  gint y;
+
+  for (y = 0; y < height; y++)
+    memcpy (d + y * dstride, src + y * stride, width_bytes);
+}
+
+
+/* convert a frame in src_info's native layout into dest */
+void
+gst_accel_fixup_frame (GstVideoFrame *dest, const guint8 *src,
+    const GstVideoInfo *src_info)
+{
+  gint y, width, height, sstride;
+  const guint8 *s;
+
+  width = GST_VIDEO_FRAME_WIDTH (dest);
+  height = GST_VIDEO_FRAME_HEIGHT (dest);
+  sstride = GST_VIDEO_INFO_PLANE_STRIDE (src_info, 0);
+
+  switch (GST_VIDEO_FRAME_FORMAT (dest)) {
+    case GST_VIDEO_FORMAT_I420:
+      copy_plane (dest, 0, src, sstride, width, height);
+
+      s = src + GST_VIDEO_INFO_PLANE_OFFSET (src_info, 1);
+      sstride = GST_VIDEO_INFO_PLANE_STRIDE (src_info, 1);
+      for (y = 0; y < (height + 1) / 2; y++)
+        split_uv_row (s + y * sstride,
+            (guint8 *)GST_VIDEO_FRAME_PLANE_DATA (dest, 1) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (dest, 1),
+            (guint8 *)GST_VIDEO_FRAME_PLANE_DATA (dest, 2) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (dest, 2), (width + 1) / 2);
+      break;
+
+    case GST_VIDEO_FORMAT_BGRA:
+    case GST_VIDEO_FORMAT_RGBA:
+      for (y = 0; y < height; y++)
+        swizzle_argb_row (src + y * sstride,
+            (guint8 *)GST_VIDEO_FRAME_PLANE_DATA (dest, 0) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (dest, 0), width,
+            GST_VIDEO_FRAME_FORMAT (dest) == GST_VIDEO_FORMAT_BGRA);
+      break;
+
+    case GST_VIDEO_FORMAT_GBR:
+      for (y = 0; y < height; y++)
+        split_rgb_row (src + y * sstride,
+            (guint8 *)GST_VIDEO_FRAME_PLANE_DATA (dest, 0) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (dest, 0),
+            (guint8 *)GST_VIDEO_FRAME_PLANE_DATA (dest, 1) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (dest, 1),
+            (guint8 *)GST_VIDEO_FRAME_PLANE_DATA (dest, 2) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (dest, 2), width);
+      break;
+
+    default:
+      g_assert_not_reached ();
+      break;
+  }
+}
@@ -0,0 +1,43 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ACCEL_FIXUP_H__
+#define __GST_ACCEL_FIXUP_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Output formats the VPE can't write. The device produces the nearest
+ * native format and the copy out of the capture buffer converts on the
+ * way, so the frame is still read only once.
+ */
+gboolean gst_accel_fixup_get_native (GstVideoFormat format,
+    GstVideoFormat *native);
+
+gboolean gst_accel_fixup_get_nth (guint index, GstVideoFormat *format,
+    GstVideoFormat *native);
+
+void gst_accel_fixup_frame (GstVideoFrame *dest, const guint8 *src,
+    const GstVideoInfo *src_info);
+
+G_END_DECLS
+
+#endif /* __GST_ACCEL_FIXUP_H__ */
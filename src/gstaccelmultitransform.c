@@ -0,0 +1,999 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * accelmultitransform converts several streams on one VPE. Every
+ * sink_%u request pad gets a matching src_%u pad. Streaming threads hand
+ * their frame to a single device thread and wait for the result, the
+ * device thread picks the next job by smooth weighted round-robin and
+ * lets jobs close to their deadline go first.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "gstaccelmultitransform.h"
+#include "cmempool.h"
+#include "cmem_buf.h"
+#include "v4l2_m2m.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_accel_multi_transform_debug);
+#define GST_CAT_DEFAULT gst_accel_multi_transform_debug
+
+enum
+{
+  PROP_0,
+  PROP_DEVNAME,
+  PROP_JOBS,
+  PROP_FORMAT_SWITCHES,
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_WEIGHT,
+  PROP_PAD_DEADLINE,
+};
+
+#define DEFAULT_DEVICE_NAME "/dev/v4l/by-path/platform-489d0000.vpe-video-index0"
+#define DEFAULT_PAD_WEIGHT 1
+#define DEFAULT_PAD_DEADLINE 0
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("NV12")
+        ";" GST_VIDEO_CAPS_MAKE ("UYVY")
+        ";" GST_VIDEO_CAPS_MAKE ("YUYV")
+        ";" GST_VIDEO_CAPS_MAKE ("YUY2"))
+    );
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("NV12")
+        ";" GST_VIDEO_CAPS_MAKE ("UYVY")
+        ";" GST_VIDEO_CAPS_MAKE ("YUYV")
+        ";" GST_VIDEO_CAPS_MAKE ("YUY2")
+        ";" GST_VIDEO_CAPS_MAKE ("ARGB")
+        ";" GST_VIDEO_CAPS_MAKE ("xRGB")
+        ";" GST_VIDEO_CAPS_MAKE ("ABGR")
+        ";" GST_VIDEO_CAPS_MAKE ("xBGR")
+        ";" GST_VIDEO_CAPS_MAKE ("RGB")
+        ";" GST_VIDEO_CAPS_MAKE ("BGR"))
+    );
+
+
+/* stream pad */
+G_DEFINE_TYPE (GstAccelMultiTransformPad, gst_accel_multi_transform_pad,
+    GST_TYPE_PAD);
+
+static void
+gst_accel_multi_transform_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAccelMultiTransformPad *spad = GST_ACCEL_MULTI_TRANSFORM_PAD_CAST (object);
+
+  switch (prop_id) {
+    case PROP_PAD_WEIGHT:
+      GST_OBJECT_LOCK (spad);
+      spad->weight = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (spad);
+      break;
+    case PROP_PAD_DEADLINE:
+      GST_OBJECT_LOCK (spad);
+      spad->deadline = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (spad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_accel_multi_transform_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAccelMultiTransformPad *spad = GST_ACCEL_MULTI_TRANSFORM_PAD_CAST (object);
+
+  switch (prop_id) {
+    case PROP_PAD_WEIGHT:
+      GST_OBJECT_LOCK (spad);
+      g_value_set_uint (value, spad->weight);
+      GST_OBJECT_UNLOCK (spad);
+      break;
+    case PROP_PAD_DEADLINE:
+      GST_OBJECT_LOCK (spad);
+      g_value_set_uint64 (value, spad->deadline);
+      GST_OBJECT_UNLOCK (spad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_accel_multi_transform_pad_class_init (GstAccelMultiTransformPadClass * klass)
+{
+  GObjectClass *object_class = (GObjectClass *) klass;
+
+  object_class->set_property = gst_accel_multi_transform_pad_set_property;
+  object_class->get_property = gst_accel_multi_transform_pad_get_property;
+
+  g_object_class_install_property (object_class, PROP_PAD_WEIGHT,
+      g_param_spec_uint ("weight", "Weight",
+          "Share of the device given to this stream", 1, 1000,
+          DEFAULT_PAD_WEIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_PAD_DEADLINE,
+      g_param_spec_uint64 ("deadline", "Deadline",
+          "Time a frame may wait for the device in ns (0 = one frame duration)",
+          0, G_MAXUINT64, DEFAULT_PAD_DEADLINE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+}
+
+static void
+gst_accel_multi_transform_pad_init (GstAccelMultiTransformPad * spad)
+{
+  spad->srcpad = NULL;
+  spad->weight = DEFAULT_PAD_WEIGHT;
+  spad->deadline = DEFAULT_PAD_DEADLINE;
+  spad->negotiated = FALSE;
+  spad->pool = NULL;
+  spad->work_mem = NULL;
+  spad->out_cbuf.buf = NULL;
+  spad->out_cbuf.fd = -1;
+  spad->state = GST_ACCEL_JOB_IDLE;
+  spad->inbuf = NULL;
+  spad->outbuf = NULL;
+  spad->ret = GST_FLOW_OK;
+  spad->job_deadline = GST_CLOCK_TIME_NONE;
+  spad->current_weight = 0;
+  spad->flushing = FALSE;
+}
+
+
+#define gst_accel_multi_transform_parent_class parent_class
+G_DEFINE_TYPE (GstAccelMultiTransform, gst_accel_multi_transform,
+    GST_TYPE_ELEMENT);
+
+
+/* per-stream device buffers */
+static void
+release_stream (GstAccelMultiTransformPad *spad)
+{
+  if (spad->pool) {
+    gst_buffer_pool_set_active (spad->pool, FALSE);
+    gst_object_unref (spad->pool);
+    spad->pool = NULL;
+  }
+
+  if (spad->work_mem) {
+    gst_memory_unref (spad->work_mem);
+    spad->work_mem = NULL;
+  }
+
+  if (spad->out_cbuf.buf) {
+    free_cmem_buffer (spad->out_cbuf.buf);
+    spad->out_cbuf.buf = NULL;
+    spad->out_cbuf.fd = -1;
+  }
+
+  spad->negotiated = FALSE;
+}
+
+
+static gboolean
+same_format (const GstVideoInfo *a, const GstVideoInfo *b)
+{
+  return GST_VIDEO_INFO_FORMAT (a) == GST_VIDEO_INFO_FORMAT (b) &&
+      GST_VIDEO_INFO_WIDTH (a) == GST_VIDEO_INFO_WIDTH (b) &&
+      GST_VIDEO_INFO_HEIGHT (a) == GST_VIDEO_INFO_HEIGHT (b);
+}
+
+
+/* set the stream's formats on the device, a no-op when they already match */
+static gboolean
+configure_device (GstAccelMultiTransform *mtrans,
+    GstAccelMultiTransformPad *spad)
+{
+  gint i, ret;
+  uint32_t fourcc = 0;
+  enum v4l2_colorspace clrspc = 0;
+  uint32_t *sizeimage;
+  const GstVideoInfo *vinfo;
+
+  if (mtrans->configured &&
+      same_format (&mtrans->cur_in_info, &spad->in_info) &&
+      same_format (&mtrans->cur_out_info, &spad->out_info)) {
+    spad->v4l2_in_size = mtrans->cur_in_size;
+    spad->v4l2_out_size = mtrans->cur_out_size;
+    return TRUE;
+  }
+
+  /* buffers must be released before S_FMT */
+  if (mtrans->streaming) {
+    (void)v4l2_stream_off (mtrans->devfd, 1);
+    (void)v4l2_stream_off (mtrans->devfd, 0);
+    mtrans->streaming = FALSE;
+  }
+
+  if (mtrans->configured) {
+    (void)v4l2_release_buffer (mtrans->devfd, 1, V4L2_MEMORY_DMABUF);
+    (void)v4l2_release_buffer (mtrans->devfd, 0, V4L2_MEMORY_DMABUF);
+    mtrans->configured = FALSE;
+  }
+
+  vinfo = &spad->in_info;
+  sizeimage = &spad->v4l2_in_size;
+
+  for (i = 0; i < 2; i++) {
+    if (!get_v4l2_fmt (vinfo, &fourcc, &clrspc)) {
+      GST_ERROR_OBJECT (spad, "color format is incompatible(index:%d)", i);
+      return FALSE;
+    }
+
+    /* one job at a time, a single buffer per queue is enough */
+    ret = v4l2_request_buffer (mtrans->devfd, GST_VIDEO_INFO_WIDTH (vinfo),
+        GST_VIDEO_INFO_HEIGHT (vinfo), fourcc, clrspc, 0, 1, (i == 0),
+        V4L2_MEMORY_DMABUF, sizeimage);
+    if (ret < 0) {
+      GST_ERROR_OBJECT (spad, "buffer initialize failed(input:%s)",
+          (i == 0 ? "yes" : "no"));
+      return FALSE;
+    }
+
+    vinfo = &spad->out_info;
+    sizeimage = &spad->v4l2_out_size;
+  }
+
+  mtrans->cur_in_info = spad->in_info;
+  mtrans->cur_out_info = spad->out_info;
+  mtrans->cur_in_size = spad->v4l2_in_size;
+  mtrans->cur_out_size = spad->v4l2_out_size;
+  mtrans->configured = TRUE;
+  mtrans->format_switches++;
+
+  GST_DEBUG_OBJECT (mtrans, "device switched to %s", GST_OBJECT_NAME (spad));
+
+  return TRUE;
+}
+
+
+/* runs on the device thread */
+static GstFlowReturn
+run_job (GstAccelMultiTransform *mtrans, GstAccelMultiTransformPad *spad,
+    GstBuffer *inbuf, GstBuffer **outbuf)
+{
+  gint ret;
+  GstMemory *mem;
+  GstMapInfo map;
+  const GstCMemMemory *cmem;
+  GstVideoFrame frame;
+  GstFlowReturn res;
+
+  *outbuf = NULL;
+
+  if (!configure_device (mtrans, spad))
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  mem = gst_buffer_peek_memory (inbuf, 0);
+  if (GST_IS_CMEM_MEMORY_ALLOCATOR (mem->allocator)) {
+    cmem = (GstCMemMemory *)mem;
+  }
+  else {
+    if (!gst_buffer_map (inbuf, &map, GST_MAP_READ)) {
+      GST_WARNING_OBJECT (spad, "Could not map buffer, skipping");
+      return GST_FLOW_OK;
+    }
+
+    cmem = (GstCMemMemory *)spad->work_mem;
+    memcpy (cmem->data, map.data, MIN (map.size, spad->in_info.size));
+    gst_buffer_unmap (inbuf, &map);
+  }
+
+  /* flush cache for device read after cpu write */
+  if (cmem_do_cache_operation (cmem->data, GST_MEMORY_CAST (cmem)->size,
+          CMEM_CACHE_FLUSH) < 0)
+    GST_WARNING_OBJECT (spad, "cache operation(%d) failed", CMEM_CACHE_FLUSH);
+
+  /* invalidate cache for cpu read after device write */
+  if (cmem_do_cache_operation (spad->out_cbuf.buf, spad->out_info.size,
+          CMEM_CACHE_INVALIDATE) < 0)
+    GST_WARNING_OBJECT (spad, "cache operation(%d) failed", CMEM_CACHE_INVALIDATE);
+
+  ret = v4l2_queue_buffer (mtrans->devfd, 0, spad->out_cbuf.fd,
+      spad->v4l2_out_size, 0);
+  if (ret < 0)
+    goto device_error;
+
+  ret = v4l2_queue_buffer (mtrans->devfd, 0, cmem->fd, spad->v4l2_in_size, 1);
+  if (ret < 0)
+    goto device_error;
+
+  if (!mtrans->streaming) {
+    if (v4l2_stream_on (mtrans->devfd, 0) < 0 ||
+        v4l2_stream_on (mtrans->devfd, 1) < 0)
+      goto device_error;
+    mtrans->streaming = TRUE;
+  }
+
+  if (v4l2_dequeue_buffer (mtrans->devfd, 0, V4L2_MEMORY_DMABUF, NULL) < 0 ||
+      v4l2_dequeue_buffer (mtrans->devfd, 1, V4L2_MEMORY_DMABUF, NULL) < 0)
+    goto device_error;
+
+  res = gst_buffer_pool_acquire_buffer (spad->pool, outbuf, NULL);
+  if (res != GST_FLOW_OK)
+    return res;
+
+  if (gst_video_frame_map (&frame, &spad->out_info, *outbuf, GST_MAP_WRITE)) {
+    memcpy (GST_VIDEO_FRAME_PLANE_DATA (&frame, 0), spad->out_cbuf.buf,
+        spad->out_info.size);
+    gst_video_frame_unmap (&frame);
+  }
+  else {
+    GST_WARNING_OBJECT (spad, "Could not map buffer, skipping");
+  }
+
+  gst_buffer_copy_into (*outbuf, inbuf,
+      GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+  return GST_FLOW_OK;
+
+device_error:
+  /* XXX: omit cleanup */
+  GST_ERROR_OBJECT (spad, "device job failed");
+  return GST_FLOW_ERROR;
+}
+
+
+/* pick the next stream to run, element lock held */
+static GstAccelMultiTransformPad *
+pick_next_job (GstAccelMultiTransform *mtrans)
+{
+  GList *l;
+  GstAccelMultiTransformPad *spad, *best = NULL, *urgent = NULL;
+  GstClockTime now, slack;
+  gint64 total = 0;
+
+  now = gst_util_get_timestamp ();
+  slack = 2 * mtrans->avg_job_time;
+
+  for (l = mtrans->sinkpads; l; l = l->next) {
+    spad = l->data;
+    if (spad->state != GST_ACCEL_JOB_QUEUED)
+      continue;
+
+    /* a job that would miss its deadline behind another one goes first */
+    if (GST_CLOCK_TIME_IS_VALID (spad->job_deadline) &&
+        spad->job_deadline <= now + slack &&
+        (urgent == NULL || spad->job_deadline < urgent->job_deadline))
+      urgent = spad;
+
+    /* smooth weighted round-robin */
+    spad->current_weight += spad->weight;
+    total += spad->weight;
+    if (best == NULL || spad->current_weight > best->current_weight)
+      best = spad;
+  }
+
+  if (urgent)
+    best = urgent;
+
+  if (best)
+    best->current_weight -= total;
+
+  return best;
+}
+
+
+static gpointer
+gst_accel_multi_transform_loop (gpointer data)
+{
+  GstAccelMultiTransform *mtrans = data;
+  GstAccelMultiTransformPad *spad;
+  GstBuffer *outbuf;
+  GstFlowReturn ret;
+  GstClockTime start, elapsed;
+
+  g_mutex_lock (&mtrans->lock);
+  while (mtrans->running) {
+    spad = pick_next_job (mtrans);
+    if (spad == NULL) {
+      g_cond_wait (&mtrans->cond, &mtrans->lock);
+      continue;
+    }
+
+    spad->state = GST_ACCEL_JOB_RUNNING;
+    gst_object_ref (spad);
+    g_mutex_unlock (&mtrans->lock);
+
+    start = gst_util_get_timestamp ();
+    ret = run_job (mtrans, spad, spad->inbuf, &outbuf);
+    elapsed = gst_util_get_timestamp () - start;
+
+    g_mutex_lock (&mtrans->lock);
+    spad->outbuf = outbuf;
+    spad->ret = ret;
+    spad->state = GST_ACCEL_JOB_DONE;
+    mtrans->jobs++;
+    mtrans->avg_job_time = (mtrans->avg_job_time * 7 + elapsed) / 8;
+    g_cond_broadcast (&mtrans->cond);
+    gst_object_unref (spad);
+  }
+  g_mutex_unlock (&mtrans->lock);
+
+  return NULL;
+}
+
+
+static GstFlowReturn
+gst_accel_multi_transform_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * inbuf)
+{
+  GstAccelMultiTransform *mtrans = GST_ACCEL_MULTI_TRANSFORM_CAST (parent);
+  GstAccelMultiTransformPad *spad = GST_ACCEL_MULTI_TRANSFORM_PAD_CAST (pad);
+  GstBuffer *outbuf = NULL;
+  GstFlowReturn ret;
+  GstClockTime deadline;
+
+  GST_OBJECT_LOCK (spad);
+  deadline = spad->deadline;
+  GST_OBJECT_UNLOCK (spad);
+
+  g_mutex_lock (&mtrans->lock);
+  if (spad->flushing || !mtrans->running) {
+    ret = GST_FLOW_FLUSHING;
+    goto unlock;
+  }
+
+  if (!spad->negotiated) {
+    ret = GST_FLOW_NOT_NEGOTIATED;
+    goto unlock;
+  }
+
+  if (deadline == 0 && GST_VIDEO_INFO_FPS_N (&spad->in_info) > 0)
+    deadline = gst_util_uint64_scale_int (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (&spad->in_info), GST_VIDEO_INFO_FPS_N (&spad->in_info));
+
+  spad->inbuf = inbuf;
+  spad->job_deadline = (deadline > 0 ?
+      gst_util_get_timestamp () + deadline : GST_CLOCK_TIME_NONE);
+  spad->state = GST_ACCEL_JOB_QUEUED;
+  g_cond_broadcast (&mtrans->cond);
+
+  /* a running job still uses inbuf, wait for it even when flushing */
+  while (spad->state == GST_ACCEL_JOB_RUNNING ||
+      (spad->state == GST_ACCEL_JOB_QUEUED && !spad->flushing && mtrans->running))
+    g_cond_wait (&mtrans->cond, &mtrans->lock);
+
+  if (spad->state == GST_ACCEL_JOB_DONE) {
+    outbuf = spad->outbuf;
+    ret = spad->ret;
+  }
+  else {
+    ret = GST_FLOW_FLUSHING;
+  }
+
+  spad->outbuf = NULL;
+  spad->inbuf = NULL;
+  spad->state = GST_ACCEL_JOB_IDLE;
+
+unlock:
+  g_mutex_unlock (&mtrans->lock);
+
+  gst_buffer_unref (inbuf);
+
+  if (outbuf == NULL)
+    return ret;
+
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (outbuf);
+    return ret;
+  }
+
+  return gst_pad_push (spad->srcpad, outbuf);
+}
+
+
+/* the stream's output pool, taken from downstream if it offers one */
+static gboolean
+setup_stream_pool (GstAccelMultiTransformPad *spad, GstCaps *caps)
+{
+  GstQuery *query;
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  guint size = 0, min = 0, max = 0;
+
+  query = gst_query_new_allocation (caps, TRUE);
+  if (gst_pad_peer_query (spad->srcpad, query) &&
+      gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+  gst_query_unref (query);
+
+  if (pool == NULL)
+    pool = gst_video_buffer_pool_new ();
+
+  size = MAX (size, spad->out_info.size);
+  min = MAX (min, 2);
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  if (!gst_buffer_pool_set_config (pool, config) ||
+      !gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_WARNING_OBJECT (spad, "failed setting up output pool");
+    gst_object_unref (pool);
+    return FALSE;
+  }
+
+  spad->pool = pool;
+
+  return TRUE;
+}
+
+
+/* pick output caps for the stream and allocate its buffers */
+static gboolean
+set_stream_caps (GstAccelMultiTransform *mtrans,
+    GstAccelMultiTransformPad *spad, GstCaps *incaps)
+{
+  GstVideoInfo in_info, out_info;
+  GstCaps *peercaps, *tmpl, *outcaps;
+  GstStructure *st;
+  gint fd;
+  void *buf;
+
+  if (!gst_video_info_from_caps (&in_info, incaps))
+    goto invalid_caps;
+
+  /* keep the input size and rate, convert to what downstream prefers */
+  tmpl = gst_pad_get_pad_template_caps (spad->srcpad);
+  peercaps = gst_pad_peer_query_caps (spad->srcpad, tmpl);
+  gst_caps_unref (tmpl);
+
+  if (gst_caps_is_empty (peercaps)) {
+    gst_caps_unref (peercaps);
+    goto invalid_caps;
+  }
+
+  outcaps = gst_caps_make_writable (gst_caps_truncate (peercaps));
+  st = gst_caps_get_structure (outcaps, 0);
+  gst_structure_fixate_field_nearest_int (st, "width",
+      GST_VIDEO_INFO_WIDTH (&in_info));
+  gst_structure_fixate_field_nearest_int (st, "height",
+      GST_VIDEO_INFO_HEIGHT (&in_info));
+  gst_structure_fixate_field_nearest_fraction (st, "framerate",
+      GST_VIDEO_INFO_FPS_N (&in_info), GST_VIDEO_INFO_FPS_D (&in_info));
+  outcaps = gst_caps_fixate (outcaps);
+
+  if (!gst_video_info_from_caps (&out_info, outcaps)) {
+    gst_caps_unref (outcaps);
+    goto invalid_caps;
+  }
+
+  /* the streaming thread is in here, so the stream has no job running */
+  g_mutex_lock (&mtrans->lock);
+  release_stream (spad);
+  spad->in_info = in_info;
+  spad->out_info = out_info;
+  g_mutex_unlock (&mtrans->lock);
+
+  spad->work_mem = gst_allocator_alloc (mtrans->allocator, in_info.size, NULL);
+  if (spad->work_mem == NULL) {
+    GST_ERROR_OBJECT (spad, "gst_allocator_alloc failed");
+    goto failed;
+  }
+
+  fd = alloc_cmem_buffer_for (
+      gst_cmem_memory_allocator_get_consumer (mtrans->allocator),
+      out_info.size, 1, &buf);
+  if (fd < 0) {
+    GST_ERROR_OBJECT (spad, "alloc cmem failed(ret:%d)", fd);
+    goto failed;
+  }
+  spad->out_cbuf.fd = fd;
+  spad->out_cbuf.buf = buf;
+
+  if (!gst_pad_push_event (spad->srcpad, gst_event_new_caps (outcaps)))
+    GST_DEBUG_OBJECT (spad, "downstream did not accept caps yet");
+
+  if (!setup_stream_pool (spad, outcaps))
+    goto failed;
+
+  gst_caps_unref (outcaps);
+
+  g_mutex_lock (&mtrans->lock);
+  spad->negotiated = TRUE;
+  g_mutex_unlock (&mtrans->lock);
+
+  return TRUE;
+
+invalid_caps:
+  {
+    GST_ERROR_OBJECT (spad, "invalid caps");
+    return FALSE;
+  }
+failed:
+  {
+    gst_caps_unref (outcaps);
+    release_stream (spad);
+    return FALSE;
+  }
+}
+
+
+static gboolean
+gst_accel_multi_transform_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstAccelMultiTransform *mtrans = GST_ACCEL_MULTI_TRANSFORM_CAST (parent);
+  GstAccelMultiTransformPad *spad = GST_ACCEL_MULTI_TRANSFORM_PAD_CAST (pad);
+  GstCaps *caps;
+  gboolean ret;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+      gst_event_parse_caps (event, &caps);
+      ret = set_stream_caps (mtrans, spad, caps);
+      gst_event_unref (event);
+      return ret;
+    case GST_EVENT_FLUSH_START:
+      g_mutex_lock (&mtrans->lock);
+      spad->flushing = TRUE;
+      g_cond_broadcast (&mtrans->cond);
+      g_mutex_unlock (&mtrans->lock);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      g_mutex_lock (&mtrans->lock);
+      spad->flushing = FALSE;
+      g_mutex_unlock (&mtrans->lock);
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_push_event (spad->srcpad, event);
+}
+
+
+/* offer CMEM buffers upstream, as acceltransform does */
+static gboolean
+gst_accel_multi_transform_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstBufferPool *pool;
+  GstStructure *config;
+  GstCaps *caps;
+  GstVideoInfo info;
+  gboolean need_pool;
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION)
+    return gst_pad_query_default (pad, parent, query);
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+  if (caps == NULL || !gst_video_info_from_caps (&info, caps))
+    return FALSE;
+
+  if (need_pool) {
+    pool = gst_cmem_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, info.size,
+        CMEM_POOL_MIN_BUF_NUM, CMEM_POOL_MAX_BUF_NUM);
+    if (!gst_buffer_pool_set_config (pool, config)) {
+      gst_object_unref (pool);
+      return FALSE;
+    }
+
+    gst_query_add_allocation_pool (query, pool, info.size,
+        CMEM_POOL_MIN_BUF_NUM, CMEM_POOL_MAX_BUF_NUM);
+    gst_object_unref (pool);
+  }
+
+  return TRUE;
+}
+
+
+static GstPad *
+gst_accel_multi_transform_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstAccelMultiTransform *mtrans = GST_ACCEL_MULTI_TRANSFORM_CAST (element);
+  GstAccelMultiTransformPad *spad;
+  gchar *sinkname, *srcname;
+  guint id;
+
+  g_mutex_lock (&mtrans->lock);
+  if (name == NULL || sscanf (name, "sink_%u", &id) != 1)
+    id = mtrans->next_pad_id;
+  mtrans->next_pad_id = MAX (mtrans->next_pad_id, id + 1);
+  g_mutex_unlock (&mtrans->lock);
+
+  sinkname = g_strdup_printf ("sink_%u", id);
+  srcname = g_strdup_printf ("src_%u", id);
+
+  spad = g_object_new (GST_TYPE_ACCEL_MULTI_TRANSFORM_PAD, "name", sinkname,
+      "direction", GST_PAD_SINK, "template", templ, NULL);
+  spad->srcpad = gst_pad_new_from_static_template (&src_factory, srcname);
+  g_free (sinkname);
+  g_free (srcname);
+
+  gst_pad_set_chain_function (GST_PAD_CAST (spad),
+      GST_DEBUG_FUNCPTR (gst_accel_multi_transform_chain));
+  gst_pad_set_event_function (GST_PAD_CAST (spad),
+      GST_DEBUG_FUNCPTR (gst_accel_multi_transform_sink_event));
+  gst_pad_set_query_function (GST_PAD_CAST (spad),
+      GST_DEBUG_FUNCPTR (gst_accel_multi_transform_sink_query));
+
+  g_mutex_lock (&mtrans->lock);
+  mtrans->sinkpads = g_list_append (mtrans->sinkpads, gst_object_ref (spad));
+  g_mutex_unlock (&mtrans->lock);
+
+  gst_element_add_pad (element, spad->srcpad);
+  gst_element_add_pad (element, GST_PAD_CAST (spad));
+
+  return GST_PAD_CAST (spad);
+}
+
+
+static void
+gst_accel_multi_transform_release_pad (GstElement * element, GstPad * pad)
+{
+  GstAccelMultiTransform *mtrans = GST_ACCEL_MULTI_TRANSFORM_CAST (element);
+  GstAccelMultiTransformPad *spad = GST_ACCEL_MULTI_TRANSFORM_PAD_CAST (pad);
+
+  g_mutex_lock (&mtrans->lock);
+  mtrans->sinkpads = g_list_remove (mtrans->sinkpads, spad);
+  spad->flushing = TRUE;
+  g_cond_broadcast (&mtrans->cond);
+  while (spad->state == GST_ACCEL_JOB_RUNNING)
+    g_cond_wait (&mtrans->cond, &mtrans->lock);
+  release_stream (spad);
+  g_mutex_unlock (&mtrans->lock);
+
+  gst_element_remove_pad (element, spad->srcpad);
+  gst_element_remove_pad (element, pad);
+  gst_object_unref (spad);
+}
+
+
+static gboolean
+open_device (GstAccelMultiTransform *mtrans)
+{
+  const gchar *devname = DEFAULT_DEVICE_NAME;
+
+  if (mtrans->device_name)
+    devname = mtrans->device_name;
+
+  mtrans->devfd = v4l2_open (devname);
+  if (mtrans->devfd < 0) {
+    GST_ELEMENT_ERROR (mtrans, RESOURCE, OPEN_READ_WRITE, (NULL),
+        ("open %s failed: %s", devname, strerror (errno)));
+    return FALSE;
+  }
+
+  mtrans->allocator = g_object_new (GST_TYPE_CMEM_MEMORY_ALLOCATOR, NULL);
+  mtrans->configured = FALSE;
+  mtrans->streaming = FALSE;
+  mtrans->avg_job_time = 0;
+
+  return TRUE;
+}
+
+
+static void
+close_device (GstAccelMultiTransform *mtrans)
+{
+  GList *l;
+
+  for (l = mtrans->sinkpads; l; l = l->next)
+    release_stream (l->data);
+
+  if (mtrans->devfd >= 0) {
+    if (mtrans->streaming) {
+      (void)v4l2_stream_off (mtrans->devfd, 1);
+      (void)v4l2_stream_off (mtrans->devfd, 0);
+      mtrans->streaming = FALSE;
+    }
+
+    v4l2_close (mtrans->devfd);
+    mtrans->devfd = -1;
+  }
+  mtrans->configured = FALSE;
+
+  if (mtrans->allocator) {
+    gst_object_unref (mtrans->allocator);
+    mtrans->allocator = NULL;
+  }
+}
+
+
+static GstStateChangeReturn
+gst_accel_multi_transform_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstAccelMultiTransform *mtrans = GST_ACCEL_MULTI_TRANSFORM_CAST (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      if (!open_device (mtrans))
+        return GST_STATE_CHANGE_FAILURE;
+      mtrans->running = TRUE;
+      mtrans->thread = g_thread_new ("accelmultitransform",
+          gst_accel_multi_transform_loop, mtrans);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* unblock waiting streaming threads before the pads deactivate */
+      g_mutex_lock (&mtrans->lock);
+      mtrans->running = FALSE;
+      g_cond_broadcast (&mtrans->cond);
+      g_mutex_unlock (&mtrans->lock);
+      if (mtrans->thread) {
+        g_thread_join (mtrans->thread);
+        mtrans->thread = NULL;
+      }
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      close_device (mtrans);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+
+static void
+gst_accel_multi_transform_set_property (GObject *object, guint prop_id,
+    GValue const *value, GParamSpec *pspec)
+{
+  GstAccelMultiTransform *mtrans = GST_ACCEL_MULTI_TRANSFORM_CAST (object);
+
+  switch (prop_id) {
+    case PROP_DEVNAME:
+      g_free (mtrans->device_name);
+      mtrans->device_name = g_value_dup_string (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+
+static void
+gst_accel_multi_transform_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstAccelMultiTransform *mtrans = GST_ACCEL_MULTI_TRANSFORM_CAST (object);
+
+  switch (prop_id) {
+    case PROP_DEVNAME:
+      g_value_set_string (value, mtrans->device_name);
+      break;
+    case PROP_JOBS:
+      g_mutex_lock (&mtrans->lock);
+      g_value_set_uint64 (value, mtrans->jobs);
+      g_mutex_unlock (&mtrans->lock);
+      break;
+    case PROP_FORMAT_SWITCHES:
+      g_mutex_lock (&mtrans->lock);
+      g_value_set_uint64 (value, mtrans->format_switches);
+      g_mutex_unlock (&mtrans->lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+
+static void
+gst_accel_multi_transform_finalize (GObject * object)
+{
+  GstAccelMultiTransform *mtrans = GST_ACCEL_MULTI_TRANSFORM_CAST (object);
+
+  g_list_free_full (mtrans->sinkpads, (GDestroyNotify) gst_object_unref);
+  g_free (mtrans->device_name);
+  g_mutex_clear (&mtrans->lock);
+  g_cond_clear (&mtrans->cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static void
+gst_accel_multi_transform_class_init (GstAccelMultiTransformClass * klass)
+{
+  GObjectClass *object_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = (GstElementClass *) klass;
+
+  object_class->set_property = gst_accel_multi_transform_set_property;
+  object_class->get_property = gst_accel_multi_transform_get_property;
+  object_class->finalize = gst_accel_multi_transform_finalize;
+
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_accel_multi_transform_change_state);
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_accel_multi_transform_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_accel_multi_transform_release_pad);
+
+  g_object_class_install_property (object_class, PROP_DEVNAME,
+      g_param_spec_string ("device-name", "V4L2 devie name",
+          "V4L2 device file name(full path)", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_JOBS,
+      g_param_spec_uint64 ("jobs", "Jobs", "Frames converted on the device",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_FORMAT_SWITCHES,
+      g_param_spec_uint64 ("format-switches", "Format switches",
+          "Times the device was set up for another stream's formats",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_set_details_simple (gstelement_class,
+      "Multi-stream colorspace converter",
+      "Filter/Converter/Video",
+      "Time-multiplexes one HW accelerated video transform device",
+      "AUTHOR_NAME AUTHOR_EMAIL");
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_factory));
+
+  GST_DEBUG_CATEGORY_INIT (gst_accel_multi_transform_debug,
+      "accelmultitransform", 0, "accelmultitransform");
+}
+
+static void
+gst_accel_multi_transform_init (GstAccelMultiTransform * mtrans)
+{
+  g_mutex_init (&mtrans->lock);
+  g_cond_init (&mtrans->cond);
+
+  mtrans->device_name = NULL;
+  mtrans->devfd = -1;
+  mtrans->allocator = NULL;
+  mtrans->sinkpads = NULL;
+  mtrans->next_pad_id = 0;
+  mtrans->thread = NULL;
+  mtrans->running = FALSE;
+  mtrans->configured = FALSE;
+  mtrans->streaming = FALSE;
+  mtrans->avg_job_time = 0;
+  mtrans->jobs = 0;
+  mtrans->format_switches = 0;
+}
@@ -0,0 +1,130 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ACCEL_MULTI_TRANSFORM_H__
+#define __GST_ACCEL_MULTI_TRANSFORM_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
+
+#include "gstacceltransform.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ACCEL_MULTI_TRANSFORM \
+  (gst_accel_multi_transform_get_type())
+#define GST_ACCEL_MULTI_TRANSFORM(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ACCEL_MULTI_TRANSFORM,GstAccelMultiTransform))
+#define GST_IS_ACCEL_MULTI_TRANSFORM(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ACCEL_MULTI_TRANSFORM))
+#define GST_ACCEL_MULTI_TRANSFORM_CAST(obj)  ((GstAccelMultiTransform *)(obj))
+
+#define GST_TYPE_ACCEL_MULTI_TRANSFORM_PAD \
+  (gst_accel_multi_transform_pad_get_type())
+#define GST_ACCEL_MULTI_TRANSFORM_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ACCEL_MULTI_TRANSFORM_PAD,GstAccelMultiTransformPad))
+#define GST_ACCEL_MULTI_TRANSFORM_PAD_CAST(obj)  ((GstAccelMultiTransformPad *)(obj))
+
+typedef struct _GstAccelMultiTransform GstAccelMultiTransform;
+typedef struct _GstAccelMultiTransformClass GstAccelMultiTransformClass;
+typedef struct _GstAccelMultiTransformPad GstAccelMultiTransformPad;
+typedef struct _GstAccelMultiTransformPadClass GstAccelMultiTransformPadClass;
+
+typedef enum {
+  GST_ACCEL_JOB_IDLE,
+  GST_ACCEL_JOB_QUEUED,
+  GST_ACCEL_JOB_RUNNING,
+  GST_ACCEL_JOB_DONE,
+} GstAccelJobState;
+
+/* one stream: a sink pad, its src pad and its device context */
+struct _GstAccelMultiTransformPad {
+  GstPad parent;
+
+  GstPad *srcpad;
+
+  /* properties */
+  guint weight;
+  GstClockTime deadline;
+
+  /* per-stream context, guarded by the element lock */
+  gboolean negotiated;
+  GstVideoInfo in_info;
+  GstVideoInfo out_info;
+  guint32 v4l2_in_size;
+  guint32 v4l2_out_size;
+  GstBufferPool *pool;
+  GstMemory *work_mem;
+  cmem_buf out_cbuf;
+
+  /* scheduling, guarded by the element lock */
+  GstAccelJobState state;
+  GstBuffer *inbuf;
+  GstBuffer *outbuf;
+  GstFlowReturn ret;
+  GstClockTime job_deadline;
+  gint64 current_weight;
+  gboolean flushing;
+};
+
+struct _GstAccelMultiTransformPadClass {
+  GstPadClass parent_class;
+};
+
+struct _GstAccelMultiTransform {
+  GstElement element;
+
+  gchar *device_name;
+  gint devfd;
+  GstAllocator *allocator;
+
+  GMutex lock;
+  GCond cond;
+  GList *sinkpads;
+  guint next_pad_id;
+
+  GThread *thread;
+  gboolean running;
+
+  /* formats currently set on the device */
+  gboolean configured;
+  gboolean streaming;
+  GstVideoInfo cur_in_info;
+  GstVideoInfo cur_out_info;
+  guint32 cur_in_size;
+  guint32 cur_out_size;
+
+  /* moving average of one job, for deadline slack */
+  GstClockTime avg_job_time;
+
+  guint64 jobs;
+  guint64 format_switches;
+};
+
+struct _GstAccelMultiTransformClass {
+  GstElementClass parent_class;
+};
+
+GType gst_accel_multi_transform_get_type (void);
+GType gst_accel_multi_transform_pad_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_ACCEL_MULTI_TRANSFORM_H__ */
@@ -0,0 +1,321 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstaccelstats.h"
+
+/* where the luma is in a row of the first plane */
+typedef struct {
+  guint pstride;
+  gboolean rgb;
+  guint y;          /* YUV: the luma */
+  guint r, g, b;    /* RGB: weighted to luma */
+} LumaLayout;
+
+/* what a frame adds up to, in integers until the end */
+typedef struct {
+  guint32 *histogram;
+  guint64 sum;
+  guint64 sum_sq;
+  guint64 *cells;     /* thumb_width per thumbnail row */
+  guint *col_cell;    /* the thumbnail column of each frame column */
+} Accum;
+
+
+static gboolean
+get_luma_layout (const GstVideoInfo *info, LumaLayout *l)
+{
+  const GstVideoFormatInfo *finfo = info->finfo;
+
+  if (GST_VIDEO_FORMAT_INFO_IS_YUV (finfo)) {
+    if (GST_VIDEO_INFO_COMP_PLANE (info, 0) != 0 ||
+        GST_VIDEO_FORMAT_INFO_DEPTH (finfo, 0) != 8 ||
+        GST_VIDEO_INFO_COMP_PSTRIDE (info, 0) <= 0)
+      return FALSE;
+
+    l->rgb = FALSE;
+    l->pstride = GST_VIDEO_INFO_COMP_PSTRIDE (info, 0);
+    l->y = GST_VIDEO_INFO_COMP_POFFSET (info, 0);
+    return TRUE;
+  }
+
+  /* packed only, planar GBR has no pixel to weigh in one plane */
+  if (GST_VIDEO_FORMAT_INFO_IS_RGB (finfo)) {
+    if (GST_VIDEO_INFO_N_PLANES (info) != 1 ||
+        GST_VIDEO_FORMAT_INFO_DEPTH (finfo, 0) != 8 ||
+        GST_VIDEO_INFO_COMP_PSTRIDE (info, 0) < 3)
+      return FALSE;
+
+    l->rgb = TRUE;
+    l->pstride = GST_VIDEO_INFO_COMP_PSTRIDE (info, 0);
+    l->r = GST_VIDEO_INFO_COMP_POFFSET (info, GST_VIDEO_COMP_R);
+    l->g = GST_VIDEO_INFO_COMP_POFFSET (info, GST_VIDEO_COMP_G);
+    l->b = GST_VIDEO_INFO_COMP_POFFSET (info, GST_VIDEO_COMP_B);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+gboolean
+gst_accel_stats_supported (const GstVideoInfo *info)
+{
+  LumaLayout l;
+
+  return get_luma_layout (info, &l);
+}
+
+
+static inline guint
+luma_at (const guint8 *p, const LumaLayout *l)
+{
+  if (l->rgb)
+    return (77 * p[l->r] + 150 * p[l->g] + 29 * p[l->b]) >> 8;
+  return p[l->y];
+}
+
+
+/* one row of luma into the sums, while it is still in the cache */
+static void
+accumulate_row (Accum *acc, GstAccelStatsFlags flags, const guint8 *row,
+    guint width, const LumaLayout *l, guint64 *cells)
+{
+  guint32 sum = 0;
+  guint64 sum_sq = 0;
+  guint x, v;
+
+  for (x = 0; x < width; x++, row += l->pstride) {
+    v = luma_at (row, l);
+    if (flags & GST_ACCEL_STATS_HISTOGRAM)
+      acc->histogram[v]++;
+    if (flags & GST_ACCEL_STATS_MOMENTS) {
+      sum += v;
+      sum_sq += v * v;
+    }
+    if (flags & GST_ACCEL_STATS_THUMBNAIL)
+      cells[acc->col_cell[x]] += v;
+  }
+
+  acc->sum += sum;
+  acc->sum_sq += sum_sq;
+}
+
+
+/* each cell's sum over the pixels in its box */
+static void
+finish_thumbnail (GstAccelStats *stats, const Accum *acc, guint width,
+    guint height)
+{
+  guint cx, cy, cols, rows;
+
+  for (cy = 0; cy < stats->thumb_height; cy++) {
+    rows = (cy + 1) * height / stats->thumb_height -
+        cy * height / stats->thumb_height;
+    for (cx = 0; cx < stats->thumb_width; cx++) {
+      cols = (cx + 1) * width / stats->thumb_width -
+          cx * width / stats->thumb_width;
+      stats->thumbnail[cy * stats->thumb_width + cx] =
+          (acc->cells[cy * stats->thumb_width + cx] + cols * rows / 2) /
+          MAX (1, cols * rows);
+    }
+  }
+}
+
+
+void
+gst_accel_stats_copy (GstAccelStats *stats, GstAccelStatsFlags flags,
+    guint thumb_width, guint thumb_height, guint8 *dst, const guint8 *src,
+    const GstVideoInfo *info)
+{
+  LumaLayout l;
+  Accum acc;
+  gsize offset, stride, end;
+  guint width, height, x, y;
+  guint64 n;
+  gdouble mean;
+
+  gst_accel_stats_clear (stats);
+
+  width = GST_VIDEO_INFO_WIDTH (info);
+  height = GST_VIDEO_INFO_HEIGHT (info);
+  if (!get_luma_layout (info, &l) || width == 0 || height == 0)
+    flags = 0;
+
+  /* a box needs a pixel at least */
+  if (thumb_width == 0 || thumb_height == 0)
+    flags &= ~GST_ACCEL_STATS_THUMBNAIL;
+  thumb_width = MIN (thumb_width, width);
+  thumb_height = MIN (thumb_height, height);
+
+  if (flags == 0) {
+    if (dst)
+      memcpy (dst, src, info->size);
+    return;
+  }
+
+  memset (&acc, 0, sizeof (acc));
+  acc.histogram = stats->histogram;
+  if (flags & GST_ACCEL_STATS_THUMBNAIL) {
+    stats->thumb_width = thumb_width;
+    stats->thumb_height = thumb_height;
+    stats->thumbnail = g_malloc (thumb_width * thumb_height);
+    acc.cells = g_new0 (guint64, thumb_width * thumb_height);
+    acc.col_cell = g_new (guint, width);
+    for (x = 0; x < width; x++)
+      acc.col_cell[x] = (guint64) x * thumb_width / width;
+  }
+
+  offset = GST_VIDEO_INFO_PLANE_OFFSET (info, 0);
+  stride = GST_VIDEO_INFO_PLANE_STRIDE (info, 0);
+  end = offset + stride * height;
+
+  if (dst)
+    memcpy (dst, src, offset);
+
+  /* the first plane a row at a time, the row copied is the one read */
+  for (y = 0; y < height; y++) {
+    const guint8 *row = src + offset + y * stride;
+
+    if (dst) {
+      memcpy (dst + offset + y * stride, row, stride);
+      row = dst + offset + y * stride;
+    }
+    accumulate_row (&acc, flags, row, width, &l, acc.cells ?
+        acc.cells + (guint64) y * thumb_height / height * thumb_width : NULL);
+  }
+
+  if (dst && end < info->size)
+    memcpy (dst + end, src + end, info->size - end);
+
+  n = (guint64) width * height;
+  if (flags & GST_ACCEL_STATS_MOMENTS) {
+    mean = (gdouble) acc.sum / n;
+    stats->mean = mean;
+    stats->variance = MAX (0.0, (gdouble) acc.sum_sq / n - mean * mean);
+  }
+  if (flags & GST_ACCEL_STATS_THUMBNAIL)
+    finish_thumbnail (stats, &acc, width, height);
+
+  g_free (acc.cells);
+  g_free (acc.col_cell);
+
+  stats->flags = flags;
+}
+
+
+void
+gst_accel_stats_clear (GstAccelStats *stats)
+{
+  g_free (stats->thumbnail);
+  memset (stats, 0, sizeof (*stats));
+}
+
+
+static gboolean
+gst_accel_stats_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstAccelStatsMeta *smeta = (GstAccelStatsMeta *) meta;
+
+  memset (&smeta->stats, 0, sizeof (smeta->stats));
+
+  return TRUE;
+}
+
+static void
+gst_accel_stats_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstAccelStatsMeta *smeta = (GstAccelStatsMeta *) meta;
+
+  gst_accel_stats_clear (&smeta->stats);
+}
+
+static gboolean
+gst_accel_stats_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstAccelStatsMeta *smeta = (GstAccelStatsMeta *) meta;
+  GstAccelStats stats;
+
+  /* the statistics describe the frame, keep them on every copy */
+  if (GST_META_TRANSFORM_IS_COPY (type)) {
+    stats = smeta->stats;
+    if (stats.thumbnail) {
+      stats.thumbnail = g_malloc (stats.thumb_width * stats.thumb_height);
+      memcpy (stats.thumbnail, smeta->stats.thumbnail,
+          stats.thumb_width * stats.thumb_height);
+    }
+    if (!gst_buffer_add_accel_stats_meta (dest, &stats))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+GType
+gst_accel_stats_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstAccelStatsMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+const GstMetaInfo *
+gst_accel_stats_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_ACCEL_STATS_META_API_TYPE, "GstAccelStatsMeta",
+        sizeof (GstAccelStatsMeta), gst_accel_stats_meta_init,
+        gst_accel_stats_meta_free, gst_accel_stats_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+GstAccelStatsMeta *
+gst_buffer_add_accel_stats_meta (GstBuffer * buffer, GstAccelStats * stats)
+{
+  GstAccelStatsMeta *meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  meta = (GstAccelStatsMeta *) gst_buffer_add_meta (buffer,
+      GST_ACCEL_STATS_META_INFO, NULL);
+  if (meta == NULL) {
+    gst_accel_stats_clear (stats);
+    return NULL;
+  }
+
+  meta->stats = *stats;
+  stats->thumbnail = NULL;
+
+  return meta;
+}
@@ -0,0 +1,114 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ACCEL_STATS_H__
+#define __GST_ACCEL_STATS_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstAccelStats GstAccelStats;
+typedef struct _GstAccelStatsMeta GstAccelStatsMeta;
+
+#define GST_ACCEL_STATS_HISTOGRAM_BINS 256
+
+/**
+ * GstAccelStatsFlags:
+ * @GST_ACCEL_STATS_HISTOGRAM: luma histogram
+ * @GST_ACCEL_STATS_MOMENTS: luma mean and variance
+ * @GST_ACCEL_STATS_THUMBNAIL: box-filtered GRAY8 thumbnail of the luma
+ */
+typedef enum {
+  GST_ACCEL_STATS_HISTOGRAM = (1 << 0),
+  GST_ACCEL_STATS_MOMENTS = (1 << 1),
+  GST_ACCEL_STATS_THUMBNAIL = (1 << 2),
+} GstAccelStatsFlags;
+
+/**
+ * GstAccelStats:
+ * @flags: what was computed, the other fields are zero
+ * @histogram: luma levels, one bin per value
+ * @mean: mean luma level
+ * @variance: variance of the luma level
+ * @thumb_width: thumbnail width
+ * @thumb_height: thumbnail height
+ * @thumbnail: thumb_width * thumb_height GRAY8 pixels, each the mean of
+ *     its box of the frame
+ *
+ * Luma statistics of one output frame. RGB output is weighted to luma
+ * (BT.601).
+ */
+struct _GstAccelStats
+{
+  GstAccelStatsFlags flags;
+  guint32 histogram[GST_ACCEL_STATS_HISTOGRAM_BINS];
+  gdouble mean;
+  gdouble variance;
+  guint thumb_width;
+  guint thumb_height;
+  guint8 *thumbnail;
+};
+
+/**
+ * GstAccelStatsMeta:
+ * @meta: parent #GstMeta
+ * @stats: the frame's statistics, the meta owns the thumbnail
+ *
+ * Attached to output buffers by acceltransform when any of histogram,
+ * moments or thumbnail-width/height is set.
+ */
+struct _GstAccelStatsMeta
+{
+  GstMeta meta;
+
+  GstAccelStats stats;
+};
+
+GType gst_accel_stats_meta_api_get_type (void);
+#define GST_ACCEL_STATS_META_API_TYPE (gst_accel_stats_meta_api_get_type())
+
+const GstMetaInfo *gst_accel_stats_meta_get_info (void);
+#define GST_ACCEL_STATS_META_INFO (gst_accel_stats_meta_get_info())
+
+#define gst_buffer_get_accel_stats_meta(b) \
+  ((GstAccelStatsMeta*)gst_buffer_get_meta((b),GST_ACCEL_STATS_META_API_TYPE))
+
+/* takes the thumbnail, stats is left without one */
+GstAccelStatsMeta *gst_buffer_add_accel_stats_meta (GstBuffer * buffer,
+    GstAccelStats * stats);
+
+/* whether the frame's luma can be read, 8 bits in the first plane */
+gboolean gst_accel_stats_supported (const GstVideoInfo * info);
+
+/*
+ * Copies a frame laid out as info from src to dst, or only reads src when
+ * dst is NULL, and computes flags' statistics on the way. The luma rows
+ * are read again right after their copy, while still in the cache, so
+ * memory sees the frame once. Any thumbnail in stats is replaced.
+ */
+void gst_accel_stats_copy (GstAccelStats * stats, GstAccelStatsFlags flags,
+    guint thumb_width, guint thumb_height, guint8 * dst, const guint8 * src,
+    const GstVideoInfo * info);
+
+void gst_accel_stats_clear (GstAccelStats * stats);
+
+G_END_DECLS
+
+#endif /* __GST_ACCEL_STATS_H__ */
@@ -0,0 +1,107 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstacceltimingmeta.h"
+
+void
+gst_accel_timing_reset (GstAccelTiming * timing)
+{
+  timing->copy_in_start = GST_CLOCK_TIME_NONE;
+  timing->copy_in_end = GST_CLOCK_TIME_NONE;
+  timing->cache_in_start = GST_CLOCK_TIME_NONE;
+  timing->cache_in_end = GST_CLOCK_TIME_NONE;
+  timing->qbuf = GST_CLOCK_TIME_NONE;
+  timing->dqbuf = GST_CLOCK_TIME_NONE;
+  timing->copy_out_start = GST_CLOCK_TIME_NONE;
+  timing->copy_out_end = GST_CLOCK_TIME_NONE;
+  timing->cache_out_start = GST_CLOCK_TIME_NONE;
+  timing->cache_out_end = GST_CLOCK_TIME_NONE;
+}
+
+static gboolean
+gst_accel_timing_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstAccelTimingMeta *tmeta = (GstAccelTimingMeta *) meta;
+
+  gst_accel_timing_reset (&tmeta->timing);
+
+  return TRUE;
+}
+
+static gboolean
+gst_accel_timing_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstAccelTimingMeta *smeta = (GstAccelTimingMeta *) meta;
+
+  /* the timing describes the frame, keep it on every copy */
+  if (GST_META_TRANSFORM_IS_COPY (type)) {
+    if (!gst_buffer_add_accel_timing_meta (dest, &smeta->timing))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+GType
+gst_accel_timing_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstAccelTimingMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+const GstMetaInfo *
+gst_accel_timing_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_ACCEL_TIMING_META_API_TYPE, "GstAccelTimingMeta",
+        sizeof (GstAccelTimingMeta), gst_accel_timing_meta_init,
+        (GstMetaFreeFunction) NULL, gst_accel_timing_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+GstAccelTimingMeta *
+gst_buffer_add_accel_timing_meta (GstBuffer * buffer,
+    const GstAccelTiming * timing)
+{
+  GstAccelTimingMeta *meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  meta = (GstAccelTimingMeta *) gst_buffer_add_meta (buffer,
+      GST_ACCEL_TIMING_META_INFO, NULL);
+  if (meta && timing)
+    meta->timing = *timing;
+
+  return meta;
+}
@@ -0,0 +1,90 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ACCEL_TIMING_META_H__
+#define __GST_ACCEL_TIMING_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstAccelTiming GstAccelTiming;
+typedef struct _GstAccelTimingMeta GstAccelTimingMeta;
+
+/**
+ * GstAccelTiming:
+ * @copy_in_start: start of the copy into the work buffer
+ * @copy_in_end: end of the copy into the work buffer
+ * @cache_in_start: start of the input cache flush
+ * @cache_in_end: end of the input cache flush
+ * @qbuf: input queued on the device (VIDIOC_QBUF)
+ * @dqbuf: output dequeued from the device (VIDIOC_DQBUF)
+ * @copy_out_start: start of the copy out of the device buffer
+ * @copy_out_end: end of the copy out of the device buffer
+ * @cache_out_start: start of the output cache invalidation
+ * @cache_out_end: end of the output cache invalidation
+ *
+ * Monotonic timestamps (gst_util_get_timestamp()) of one frame's trip
+ * through the device. Steps the frame did not take are
+ * #GST_CLOCK_TIME_NONE, e.g. the copy in for CMEM input.
+ */
+struct _GstAccelTiming
+{
+  GstClockTime copy_in_start;
+  GstClockTime copy_in_end;
+  GstClockTime cache_in_start;
+  GstClockTime cache_in_end;
+  GstClockTime qbuf;
+  GstClockTime dqbuf;
+  GstClockTime copy_out_start;
+  GstClockTime copy_out_end;
+  GstClockTime cache_out_start;
+  GstClockTime cache_out_end;
+};
+
+/**
+ * GstAccelTimingMeta:
+ * @meta: parent #GstMeta
+ * @timing: per-frame hardware timing
+ *
+ * Attached to output buffers by acceltransform when timing-meta is set.
+ */
+struct _GstAccelTimingMeta
+{
+  GstMeta meta;
+
+  GstAccelTiming timing;
+};
+
+GType gst_accel_timing_meta_api_get_type (void);
+#define GST_ACCEL_TIMING_META_API_TYPE (gst_accel_timing_meta_api_get_type())
+
+const GstMetaInfo *gst_accel_timing_meta_get_info (void);
+#define GST_ACCEL_TIMING_META_INFO (gst_accel_timing_meta_get_info())
+
+#define gst_buffer_get_accel_timing_meta(b) \
+  ((GstAccelTimingMeta*)gst_buffer_get_meta((b),GST_ACCEL_TIMING_META_API_TYPE))
+
+GstAccelTimingMeta *gst_buffer_add_accel_timing_meta (GstBuffer * buffer,
+    const GstAccelTiming * timing);
+
+void gst_accel_timing_reset (GstAccelTiming * timing);
+
+G_END_DECLS
+
+#endif /* __GST_ACCEL_TIMING_META_H__ */
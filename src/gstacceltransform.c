@@ -33,9 +33,12 @@
 #include <gst/gst.h>
 
 #include "gstacceltransform.h"
+#include "gstaccelmultitransform.h"
+#include "gstacceluvcsrc.h"
+#include "gstaccelfixup.h"
+#include "gstaccelcaps.h"
 #include "cmempool.h"
 #include "cmem_buf.h"
-#include "v4l2_m2m.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_acceltransform_debug);
 #define GST_CAT_DEFAULT gst_acceltransform_debug
@@ -44,335 +47,2744 @@ enum
 {
   PROP_0,
   PROP_DEVNAME,
+  PROP_MODE,
+  PROP_TIMING_META,
+  PROP_WATCHDOG_TIMEOUT,
+  PROP_RECOVERIES,
+  PROP_FRAMES_LOST,
+  PROP_CROP_X,
+  PROP_CROP_Y,
+  PROP_CROP_WIDTH,
+  PROP_CROP_HEIGHT,
+  PROP_CMEM_QUOTA,
+  PROP_CMEM_STATS,
+  PROP_IDLE_TIMEOUT,
+  PROP_RELEASE_ON_PAUSE,
+  PROP_DIRECT_OUTPUT,
+  PROP_DIRECT_INPUT,
+  PROP_CPU_THREADS,
+  PROP_DEDUP,
+  PROP_DEDUP_THRESHOLD,
+  PROP_DEDUP_REFRESH,
+  PROP_DEDUP_FRAMES,
+  PROP_DEDUP_HITS,
+  PROP_HISTOGRAM,
+  PROP_MOMENTS,
+  PROP_THUMBNAIL_WIDTH,
+  PROP_THUMBNAIL_HEIGHT,
+  PROP_ANALYTICS_MESSAGE,
 };
 
 #define DEFAULT_DEVICE_NAME "/dev/v4l/by-path/platform-489d0000.vpe-video-index0"
+#define DEFAULT_MODE GST_ACCEL_TRANSFORM_MODE_LOW_LATENCY
+#define DEFAULT_TIMING_META FALSE
+#define DEFAULT_WATCHDOG_TIMEOUT 500
+#define DEFAULT_IDLE_TIMEOUT 0
+#define DEFAULT_RELEASE_ON_PAUSE FALSE
+#define DEFAULT_DIRECT_OUTPUT FALSE
+#define DEFAULT_DIRECT_INPUT FALSE
+#define DEFAULT_CPU_THREADS 0
+#define DEFAULT_DEDUP FALSE
+#define DEFAULT_DEDUP_THRESHOLD 2
+#define DEFAULT_DEDUP_REFRESH 30
+#define DEFAULT_HISTOGRAM FALSE
+#define DEFAULT_MOMENTS FALSE
+#define DEFAULT_ANALYTICS_MESSAGE FALSE
+
+/* how often an idle or paused stream is looked for */
+#define IDLE_CHECK_INTERVAL (100 * GST_MSECOND)
+
+/* VPDMA start address alignment */
+#define VPE_DMA_ALIGN 16
+
+/* stop trying downstream buffers the device keeps refusing */
+#define MAX_DIRECT_REJECTS 8
+
+/* give up when the device faults again right after being reset */
+#define MAX_CONSECUTIVE_FAULTS 3
+
+/* the device failed a job, the frames in flight are lost */
+#define GST_ACCEL_FLOW_DEVICE_ERROR GST_FLOW_CUSTOM_ERROR
+
+/* the frame is still being converted, its output follows a later input */
+#define GST_ACCEL_FLOW_QUEUED GST_FLOW_CUSTOM_SUCCESS
+
+/* scaling ratios of one VPE pass */
+#define VPE_MAX_DOWNSCALE 4
+#define VPE_MAX_UPSCALE 4
+#define VPE_MIN_SIZE 16
+#define VPE_MAX_WIDTH 2048
+#define VPE_MAX_HEIGHT 2048
+
+/* input columns a strip scales past each side it shares with another,
+ * beyond the reach of the scaler's filters; the output of them is not
+ * kept */
+#define STRIP_OVERLAP 32
+
+/* the widest frame the strips cover */
+#define STRIP_MAX_WIDTH \
+  (GST_ACCEL_TRANSFORM_MAX_STRIPS * (VPE_MAX_WIDTH - 2 * STRIP_OVERLAP))
+
+/* output buffers queued in low-latency mode */
+#define OUTPUT_BUF_QUEUE_NUM 2
+
+#define GST_TYPE_ACCEL_TRANSFORM_MODE (gst_acceltrans_mode_get_type ())
+static GType
+gst_acceltrans_mode_get_type (void)
+{
+  static GType mode_type = 0;
+  static const GEnumValue modes[] = {
+    {GST_ACCEL_TRANSFORM_MODE_LOW_LATENCY,
+        "Complete each frame before returning", "low-latency"},
+    {GST_ACCEL_TRANSFORM_MODE_THROUGHPUT,
+        "Keep several frames queued on each device", "throughput"},
+    {0, NULL, NULL},
+  };
+
+  if (!mode_type)
+    mode_type = g_enum_register_static ("GstAccelTransformMode", modes);
+
+  return mode_type;
+}
+
+
+gboolean
+get_v4l2_fmt (const GstVideoInfo *vinfo, uint32_t *fourcc, enum v4l2_colorspace *clrspc)
+{
+  gboolean ret = TRUE;
+  GstVideoFormat gfmt = GST_VIDEO_INFO_FORMAT(vinfo);
+
+  if (GST_VIDEO_INFO_IS_YUV(vinfo)) {
+    /* only these, the fourccs of the other YUV formats are no VPE's */
+    switch (gfmt) {
+    case GST_VIDEO_FORMAT_NV12:
+      *fourcc = V4L2_PIX_FMT_NV12;
+      break;
+
+    case GST_VIDEO_FORMAT_UYVY:
+      *fourcc = V4L2_PIX_FMT_UYVY;
+      break;
+
+    case GST_VIDEO_FORMAT_YUY2:
+      *fourcc = V4L2_PIX_FMT_YUYV;
+      break;
+
+    default:
+      ret = FALSE;
+      goto end;
+    }
+
+    *clrspc = V4L2_COLORSPACE_SMPTE170M;
+  }
+  else {
+    switch (gfmt) {
+    case GST_VIDEO_FORMAT_RGB:
+      *fourcc = V4L2_PIX_FMT_RGB24;
+      break;
+
+    case GST_VIDEO_FORMAT_BGR:
+      *fourcc = V4L2_PIX_FMT_BGR24;
+      break;
+
+    case GST_VIDEO_FORMAT_ARGB:
+    case GST_VIDEO_FORMAT_xRGB:
+      *fourcc = V4L2_PIX_FMT_RGB32;
+      break;
+
+    case GST_VIDEO_FORMAT_ABGR:
+    case GST_VIDEO_FORMAT_xBGR:
+      *fourcc = V4L2_PIX_FMT_BGR32;
+      break;
+
+    default:
+      ret = FALSE;
+      goto end;
+    }
+
+    *clrspc = V4L2_COLORSPACE_SRGB;
+  }
+
+end:
+  return ret;
+}
+
+
+/* set the formats of one pass on its session */
+static gboolean
+configure_pass (GstAccelTransform *atrans, vpeconv_session *session,
+    const GstVideoInfo *in_vinfo, const GstVideoInfo *out_vinfo, guint slots,
+    uint32_t *in_size, uint32_t *out_size)
+{
+  gint ret, i;
+  uint32_t fourcc = 0;
+  enum v4l2_colorspace clrspc = 0;
+  vpeconv_format fmt[2];
+  const GstVideoInfo *vinfo;
+
+  vinfo = in_vinfo;
+
+  for (i = 0; i < 2; i++) {
+    /* input/output buffer settings */
+
+    if (!get_v4l2_fmt (vinfo, &fourcc, &clrspc)) {
+      GST_ERROR_OBJECT (atrans, "color format is incompatible(index:%d)", i);
+      return FALSE;
+    }
+
+    fmt[i].width = GST_VIDEO_INFO_WIDTH (vinfo);
+    fmt[i].height = GST_VIDEO_INFO_HEIGHT (vinfo);
+    fmt[i].fourcc = fourcc;
+    fmt[i].colorspace = clrspc;
+
+    vinfo = out_vinfo;
+  }
+
+  ret = vpeconv_configure (session, &fmt[0], &fmt[1], slots, in_size, out_size);
+  if (ret < 0) {
+    GST_ERROR_OBJECT (atrans, "buffer initialize failed");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/* size after one pass from towards to */
+static gint
+scale_step (gint from, gint to)
+{
+  gint size;
+
+  if (to < from)
+    size = MAX (to, (from + VPE_MAX_DOWNSCALE - 1) / VPE_MAX_DOWNSCALE);
+  else
+    size = MIN (to, from * VPE_MAX_UPSCALE);
+
+  /* keep chroma subsampling whole */
+  return size == to ? size : GST_ROUND_UP_2 (size);
+}
+
+
+/* the intermediate sizes when one pass can't scale the crop rectangle r
+ * to o of the output */
+static gboolean
+plan_passes (GstAccelTransform *atrans, const struct v4l2_rect *r,
+    const struct v4l2_rect *o)
+{
+  gint w, h, out_w, out_h;
+  guint n = 0;
+
+  w = r->width;
+  h = r->height;
+  out_w = o->width;
+  out_h = o->height;
+
+  while (scale_step (w, out_w) != out_w || scale_step (h, out_h) != out_h) {
+    if (n == GST_ACCEL_TRANSFORM_MAX_PREPASSES) {
+      GST_ERROR_OBJECT (atrans, "%dx%d -> %dx%d needs more than %d passes",
+          r->width, r->height, out_w, out_h,
+          GST_ACCEL_TRANSFORM_MAX_PREPASSES + 1);
+      return FALSE;
+    }
+
+    w = scale_step (w, out_w);
+    h = scale_step (h, out_h);
+
+    /* intermediates keep the input format, the VPE reads and writes it */
+    gst_video_info_init (&atrans->prepass_info[n]);
+    gst_video_info_set_format (&atrans->prepass_info[n],
+        GST_VIDEO_INFO_FORMAT (&atrans->in_info), w, h);
+    GST_DEBUG_OBJECT (atrans, "scale pass %u: %dx%d", n, w, h);
+    n++;
+  }
+
+  atrans->num_prepasses = n;
+  return TRUE;
+}
+
+
+/* columns a window or band starts on: even for the chroma, and at a
+ * byte the VPDMA takes */
+static gint
+strip_align (const GstVideoInfo *vinfo)
+{
+  gint pstride = GST_VIDEO_INFO_COMP_PSTRIDE (vinfo, 0);
+
+  return MAX (2, VPE_DMA_ALIGN /
+      gst_util_greatest_common_divisor (VPE_DMA_ALIGN, pstride));
+}
+
+
+/* where column x starts in a line */
+static gsize
+strip_offset (const GstVideoInfo *vinfo, gint x)
+{
+  return (gsize)x * GST_VIDEO_INFO_COMP_PSTRIDE (vinfo, 0);
+}
+
+
+/*
+ * Split the crop rectangle r, written to o of the output, into the
+ * fewest vertical strips the device
+ * takes. Strips meet on columns where the input and output grids
+ * coincide on an even pixel, so each one scales with the phase the whole
+ * frame would have; each also scales STRIP_OVERLAP input columns or more
+ * of its neighbours, where its filters would see the edge of the window.
+ * The bands are laid side by side in tile_info, each starting aligned.
+ */
+static gboolean
+plan_strips (GstAccelTransform *atrans, const struct v4l2_rect *r,
+    const struct v4l2_rect *o)
+{
+  const GstVideoInfo *in_vinfo = &atrans->in_info;
+  const GstVideoInfo *out_vinfo = &atrans->hw_out_info;
+  GstAccelTransformStrip *strip;
+  gint out_w, g, ui, uo, step, steps, overlap, in_align, out_align;
+  gint e0, e1, left, right, start, end, band_x = 0;
+  guint n, k;
+
+  /* the VPDMA reads each line of a window from its first byte */
+  if (GST_VIDEO_INFO_PLANE_STRIDE (in_vinfo, 0) % VPE_DMA_ALIGN != 0)
+    return FALSE;
+
+  /* ui input columns scale to uo output columns, step of them to an
+   * even number on both sides */
+  out_w = o->width;
+  g = gst_util_greatest_common_divisor (r->width, out_w);
+  ui = r->width / g;
+  uo = out_w / g;
+  step = (ui % 2 || uo % 2) ? 2 * ui : ui;
+  steps = r->width / step;
+  overlap = (STRIP_OVERLAP + step - 1) / step * step;
+
+  in_align = strip_align (in_vinfo);
+  out_align = strip_align (out_vinfo);
+
+  for (n = 1; n <= GST_ACCEL_TRANSFORM_MAX_STRIPS && n <= steps; n++) {
+    band_x = 0;
+    for (k = 0; k < n; k++) {
+      strip = &atrans->strips[k];
+      e0 = k * steps / n * step;
+      e1 = k + 1 == n ? r->width : (k + 1) * steps / n * step;
+      left = k > 0 ? overlap : 0;
+      right = k + 1 < n ? overlap : 0;
+      if (e0 < left || e1 + right > r->width)
+        break;
+
+      start = r->left + e0 - left;
+      end = r->left + e1 + right;
+      strip->in_x = start & ~(in_align - 1);
+      strip->in_width = end - strip->in_x;
+      strip->crop.left = start - strip->in_x;
+      strip->crop.top = r->top;
+      strip->crop.width = end - start;
+      strip->crop.height = r->height;
+
+      strip->band_x = band_x;
+      strip->band_width = (end - start) / ui * uo;
+      strip->skip = left / ui * uo;
+      strip->out_x = e0 / ui * uo;
+      strip->out_width = (k + 1 == n ? out_w : e1 / ui * uo) - strip->out_x;
+
+      if (strip->in_width > VPE_MAX_WIDTH ||
+          strip->crop.width < VPE_MIN_SIZE ||
+          strip->band_width < VPE_MIN_SIZE ||
+          strip->band_width > VPE_MAX_WIDTH)
+        break;
+      band_x += GST_ROUND_UP_N (strip->band_width, out_align);
+    }
+    if (k == n)
+      break;
+  }
+
+  if (n > GST_ACCEL_TRANSFORM_MAX_STRIPS || n > steps)
+    return FALSE;
+
+  atrans->num_strips = n;
+  gst_video_info_init (&atrans->tile_info);
+  gst_video_info_set_format (&atrans->tile_info,
+      GST_VIDEO_INFO_FORMAT (out_vinfo), band_x, o->height);
+
+  return TRUE;
+}
+
+
+/* input bytes a strip can reach, its window starts up to a line in */
+static gsize
+strip_in_size (GstAccelTransform *atrans)
+{
+  return atrans->in_info.size +
+      GST_VIDEO_INFO_PLANE_STRIDE (&atrans->in_info, 0);
+}
+
+
+/* slots of a device session, the frames are spread over the devices */
+static guint
+get_device_slots (GstAccelTransform *atrans)
+{
+  return MIN (atrans->num_out_bufs, GST_ACCEL_TRANSFORM_DEVICE_QUEUE_DEPTH);
+}
+
+
+/* set the formats and crop of one strip, its lines as long as the
+ * frame's and the intermediate's */
+static gboolean
+configure_strip (GstAccelTransform *atrans, vpeconv_session *session,
+    const GstAccelTransformStrip *strip, guint slots)
+{
+  GstVideoInfo in_vinfo, out_vinfo;
+  uint32_t in_size, out_size;
+
+  gst_video_info_init (&in_vinfo);
+  gst_video_info_set_format (&in_vinfo,
+      GST_VIDEO_INFO_FORMAT (&atrans->in_info), strip->in_width,
+      GST_VIDEO_INFO_HEIGHT (&atrans->in_info));
+  gst_video_info_init (&out_vinfo);
+  gst_video_info_set_format (&out_vinfo,
+      GST_VIDEO_INFO_FORMAT (&atrans->tile_info), strip->band_width,
+      GST_VIDEO_INFO_HEIGHT (&atrans->tile_info));
+
+  (void)vpeconv_set_memory (session, VPECONV_MEMORY_USERPTR,
+      VPECONV_MEMORY_USERPTR);
+  (void)vpeconv_set_stride (session,
+      GST_VIDEO_INFO_PLANE_STRIDE (&atrans->in_info, 0),
+      GST_VIDEO_INFO_PLANE_STRIDE (&atrans->tile_info, 0));
+  if (!configure_pass (atrans, session, &in_vinfo, &out_vinfo, slots,
+          &in_size, &out_size))
+    return FALSE;
+
+  /* a USERPTR buffer is pinned from the strip's first byte on */
+  if (strip_offset (&atrans->in_info, strip->in_x) + in_size >
+      strip_in_size (atrans)) {
+    GST_ERROR_OBJECT (atrans, "strip at column %d reads past the frame",
+        strip->in_x);
+    return FALSE;
+  }
+  atrans->strip_out_size = MAX (atrans->strip_out_size,
+      strip_offset (&atrans->tile_info, strip->band_x) + out_size);
+
+  if (vpeconv_set_crop (session, strip->crop.left, strip->crop.top,
+          strip->crop.width, strip->crop.height) < 0) {
+    GST_ERROR_OBJECT (atrans, "set crop failed");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/* plan the strips over the crop rectangle and set them up, the last one
+ * on every device */
+static gboolean
+configure_strips (GstAccelTransform *atrans, const struct v4l2_rect *r,
+    const struct v4l2_rect *o)
+{
+  const gchar *devname = atrans->devices[0].name;
+  guint i;
+
+  if (!plan_strips (atrans, r, o)) {
+    GST_WARNING_OBJECT (atrans, "%dx%d -> %dx%d doesn't split into strips",
+        r->width, r->height, o->width, o->height);
+    return FALSE;
+  }
+  GST_DEBUG_OBJECT (atrans, "%u strip(s), intermediate %dx%d",
+      atrans->num_strips, GST_VIDEO_INFO_WIDTH (&atrans->tile_info),
+      GST_VIDEO_INFO_HEIGHT (&atrans->tile_info));
+
+  atrans->strip_out_size = 0;
+  for (i = 0; i + 1 < atrans->num_strips; i++) {
+    if (atrans->strip_session[i] == NULL) {
+      atrans->strip_session[i] = vpeconv_open (devname);
+      if (atrans->strip_session[i] == NULL) {
+        GST_ERROR_OBJECT (atrans, "open %s failed: %s", devname,
+            strerror (errno));
+        return FALSE;
+      }
+    }
+    if (!configure_strip (atrans, atrans->strip_session[i],
+            &atrans->strips[i], atrans->num_out_bufs))
+      return FALSE;
+  }
+
+  for (i = 0; i < atrans->num_devices; i++) {
+    if (!configure_strip (atrans, atrans->devices[i].session,
+            &atrans->strips[atrans->num_strips - 1], get_device_slots (atrans)))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static vpeconv_memory
+memory_type (gboolean userptr)
+{
+  return userptr ? VPECONV_MEMORY_USERPTR : VPECONV_MEMORY_DMABUF;
+}
+
+
+/*
+ * The passes run in order, the last one writes the output buffers. The
+ * first reads the input, USERPTR with direct input; the intermediates
+ * are always dmabufs.
+ */
+static gboolean
+try_configure_passes (GstAccelTransform *atrans)
+{
+  const GstVideoInfo *vinfo = &atrans->in_info;
+  gboolean in_userptr = atrans->in_userptr;
+  guint i;
+
+  /* the earlier passes finish before the next frame, one slot is enough */
+  for (i = 0; i < atrans->num_prepasses; i++) {
+    (void)vpeconv_set_memory (atrans->prepass[i], memory_type (in_userptr),
+        VPECONV_MEMORY_DMABUF);
+    if (!configure_pass (atrans, atrans->prepass[i], vinfo,
+            &atrans->prepass_info[i], 1, i == 0 ? &atrans->v4l2_in_size : NULL,
+            &atrans->prepass_size[i]))
+      return FALSE;
+    vinfo = &atrans->prepass_info[i];
+    in_userptr = FALSE;
+  }
+
+  /* the jobs are spread over the devices, none takes more than its slots */
+  atrans->v4l2_out_size = 0;
+  if (atrans->num_prepasses == 0)
+    atrans->v4l2_in_size = 0;
+  for (i = 0; i < atrans->num_devices; i++) {
+    GstAccelTransformDevice *dev = &atrans->devices[i];
+    uint32_t in_size, out_size;
+
+    (void)vpeconv_set_memory (dev->session, memory_type (in_userptr),
+        memory_type (atrans->out_userptr));
+    if (!configure_pass (atrans, dev->session, vinfo, &atrans->hw_out_info,
+            get_device_slots (atrans), &in_size, &out_size))
+      return FALSE;
+
+    /* the buffers must do for whichever device gets them */
+    if (atrans->num_prepasses == 0)
+      atrans->v4l2_in_size = MAX (atrans->v4l2_in_size, in_size);
+    atrans->v4l2_out_size = MAX (atrans->v4l2_out_size, out_size);
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+configure_passes (GstAccelTransform *atrans)
+{
+  struct v4l2_rect r = { 0, }, o = { 0, };
+
+  /* set for the whole frame, the first frame's crop plans them again */
+  if (atrans->tiled) {
+    r.width = GST_VIDEO_INFO_WIDTH (&atrans->in_info);
+    r.height = GST_VIDEO_INFO_HEIGHT (&atrans->in_info);
+    o.width = GST_VIDEO_INFO_WIDTH (&atrans->hw_out_info);
+    o.height = GST_VIDEO_INFO_HEIGHT (&atrans->hw_out_info);
+    return configure_strips (atrans, &r, &o);
+  }
+
+  if (try_configure_passes (atrans))
+    return TRUE;
+
+  if (!atrans->in_userptr && !atrans->out_userptr)
+    return FALSE;
+
+  /* older drivers only take dmabufs */
+  GST_WARNING_OBJECT (atrans, "no USERPTR buffers, copying in and out");
+  atrans->in_userptr = FALSE;
+  atrans->out_userptr = FALSE;
+  return try_configure_passes (atrans);
+}
+
+
+static void
+close_sessions (GstAccelTransform *atrans)
+{
+  guint i;
+
+  for (i = 0; i < atrans->num_prepasses; i++) {
+    vpeconv_close (atrans->prepass[i]);
+    atrans->prepass[i] = NULL;
+  }
+  atrans->num_prepasses = 0;
+
+  for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_STRIPS - 1; i++) {
+    if (atrans->strip_session[i])
+      vpeconv_close (atrans->strip_session[i]);
+    atrans->strip_session[i] = NULL;
+  }
+  atrans->num_strips = 0;
+
+  for (i = 0; i < atrans->num_devices; i++) {
+    vpeconv_close (atrans->devices[i].session);
+    g_free (atrans->devices[i].name);
+    memset (&atrans->devices[i], 0, sizeof (atrans->devices[i]));
+  }
+  atrans->num_devices = 0;
+}
+
+
+/* device-name, a comma separated list of nodes */
+static gchar **
+get_device_names (GstAccelTransform *atrans)
+{
+  gchar **names;
+
+  GST_OBJECT_LOCK (atrans);
+  names = g_strsplit (atrans->device_name ? atrans->device_name :
+      DEFAULT_DEVICE_NAME, ",", -1);
+  GST_OBJECT_UNLOCK (atrans);
+
+  return names;
+}
+
+
+/* DEVICE_QUEUE_DEPTH frames on each device for throughput. Every frame
+ * in strips has one on each strip session, those hold as many as a
+ * session can. */
+static void
+set_num_out_bufs (GstAccelTransform *atrans)
+{
+  GST_OBJECT_LOCK (atrans);
+  if (atrans->mode == GST_ACCEL_TRANSFORM_MODE_THROUGHPUT)
+    atrans->num_out_bufs =
+        GST_ACCEL_TRANSFORM_DEVICE_QUEUE_DEPTH * atrans->num_devices;
+  else
+    atrans->num_out_bufs = OUTPUT_BUF_QUEUE_NUM;
+  GST_OBJECT_UNLOCK (atrans);
+
+  if (atrans->tiled)
+    atrans->num_out_bufs = MIN (atrans->num_out_bufs, VPECONV_MAX_SLOTS);
+}
+
+
+static gboolean
+init_device (GstAccelTransform *atrans)
+{
+  gchar **names = NULL;
+  const gchar *devname = NULL;
+  struct v4l2_rect r = { 0, }, o = { 0, };
+  guint i;
+
+  /* for the whole frame, a crop plans them again */
+  r.width = GST_VIDEO_INFO_WIDTH (&atrans->in_info);
+  r.height = GST_VIDEO_INFO_HEIGHT (&atrans->in_info);
+  o.width = GST_VIDEO_INFO_WIDTH (&atrans->hw_out_info);
+  o.height = GST_VIDEO_INFO_HEIGHT (&atrans->hw_out_info);
+  if (!plan_passes (atrans, &r, &o))
+    goto err_end;
+
+  GST_OBJECT_LOCK (atrans);
+  atrans->in_userptr = atrans->direct_input;
+  atrans->out_userptr = atrans->direct_output;
+  GST_OBJECT_UNLOCK (atrans);
+  atrans->in_rejects = 0;
+  atrans->out_rejects = 0;
+
+  /* every open is a separate context with its own formats */
+  names = get_device_names (atrans);
+  for (i = 0; names[i] != NULL; i++) {
+    GstAccelTransformDevice *dev = &atrans->devices[atrans->num_devices];
+
+    devname = g_strstrip (names[i]);
+    if (*devname == '\0')
+      continue;
+    if (atrans->num_devices == GST_ACCEL_TRANSFORM_MAX_DEVICES) {
+      GST_WARNING_OBJECT (atrans, "only %d devices are used, ignoring %s",
+          GST_ACCEL_TRANSFORM_MAX_DEVICES, devname);
+      continue;
+    }
+
+    dev->session = vpeconv_open (devname);
+    if (dev->session == NULL)
+      goto err_open;
+    dev->name = g_strdup (devname);
+    dev->in_flight = 0;
+    dev->frame_time = 0;
+    dev->last_done = GST_CLOCK_TIME_NONE;
+    atrans->num_devices++;
+  }
+
+  if (atrans->num_devices == 0) {
+    GST_ERROR_OBJECT (atrans, "no device given");
+    goto err_close;
+  }
+
+  /* the earlier passes finish before the last is queued, on the first
+   * device */
+  devname = atrans->devices[0].name;
+  for (i = 0; i < atrans->num_prepasses; i++) {
+    atrans->prepass[i] = vpeconv_open (devname);
+    if (atrans->prepass[i] == NULL)
+      goto err_open;
+  }
+  g_strfreev (names);
+  names = NULL;
+
+  /* the output buffers follow how many devices there are */
+  set_num_out_bufs (atrans);
+  if (!configure_passes (atrans))
+    goto err_close;
+
+  GST_DEBUG_OBJECT (atrans, "%u device(s)", atrans->num_devices);
+
+  return TRUE;
+
+err_open:
+  GST_ERROR_OBJECT (atrans, "open %s failed: %s", devname, strerror(errno));
+err_close:
+  g_strfreev (names);
+  close_sessions (atrans);
+err_end:
+  return FALSE;
+}
+
+
+/* rows of a plane covered by the rectangle r */
+static void
+get_rect_rows (const GstVideoInfo *vinfo, const struct v4l2_rect *r,
+    gint plane, gsize *offset, gsize *size)
+{
+  gint first, last;
+
+  /* the formats have one component per plane at its start */
+  first = GST_VIDEO_SUB_SCALE (GST_VIDEO_FORMAT_INFO_H_SUB (vinfo->finfo, plane),
+      r->top);
+  last = GST_VIDEO_SUB_SCALE (GST_VIDEO_FORMAT_INFO_H_SUB (vinfo->finfo, plane),
+      r->top + r->height);
+
+  *offset = GST_VIDEO_INFO_PLANE_OFFSET (vinfo, plane) +
+      (gsize)first * GST_VIDEO_INFO_PLANE_STRIDE (vinfo, plane);
+  *size = (gsize)(last - first) * GST_VIDEO_INFO_PLANE_STRIDE (vinfo, plane);
+}
+
+
+/* the device only touches the rows of r, sync just those */
+static gint
+sync_rect_rows (const GstVideoInfo *vinfo, const struct v4l2_rect *r,
+    guint8 *data, gint op)
+{
+  gint plane, ret = 0;
+  gsize offset, size;
+
+  for (plane = 0; plane < GST_VIDEO_INFO_N_PLANES (vinfo); plane++) {
+    get_rect_rows (vinfo, r, plane, &offset, &size);
+    if (cmem_do_cache_operation (data + offset, size, op) < 0)
+      ret = -1;
+  }
+
+  return ret;
+}
+
+
+/* copy the rows the device will read into a work buffer of the same layout */
+static void
+copy_crop_rows (GstAccelTransform *atrans, guint8 *dst, const guint8 *src,
+    gsize src_size)
+{
+  gint plane;
+  gsize offset, size;
+
+  for (plane = 0; plane < GST_VIDEO_INFO_N_PLANES (&atrans->in_info); plane++) {
+    get_rect_rows (&atrans->in_info, &atrans->cur_crop, plane, &offset, &size);
+    if (offset >= src_size)
+      break;
+    memcpy (dst + offset, src + offset, MIN (size, src_size - offset));
+  }
+}
+
+
+/* where the rectangle r starts in a plane */
+static gsize
+rect_offset (const GstVideoInfo *vinfo, const struct v4l2_rect *r, gint plane)
+{
+  return GST_VIDEO_INFO_PLANE_OFFSET (vinfo, plane) +
+      (gsize)GST_VIDEO_SUB_SCALE (GST_VIDEO_FORMAT_INFO_H_SUB (vinfo->finfo,
+          plane), r->top) * GST_VIDEO_INFO_PLANE_STRIDE (vinfo, plane) +
+      (gsize)GST_VIDEO_SUB_SCALE (GST_VIDEO_FORMAT_INFO_W_SUB (vinfo->finfo,
+          plane), r->left) * GST_VIDEO_INFO_COMP_PSTRIDE (vinfo, plane);
+}
+
+
+/* the rectangle r of a frame laid out as vinfo, as a frame of its own
+ * starting where r does in the first plane */
+static void
+get_rect_info (const GstVideoInfo *vinfo, const struct v4l2_rect *r,
+    GstVideoInfo *rinfo)
+{
+  gsize base;
+  gint plane;
+
+  base = rect_offset (vinfo, r, 0);
+  *rinfo = *vinfo;
+  rinfo->width = r->width;
+  rinfo->height = r->height;
+  for (plane = 0; plane < GST_VIDEO_INFO_N_PLANES (vinfo); plane++)
+    rinfo->offset[plane] = rect_offset (vinfo, r, plane) - base;
+  rinfo->size = vinfo->size - base;
+}
+
+
+/* the same for a mapped frame, its planes' data moved to the rectangle */
+static void
+get_rect_frame (const GstVideoFrame *frame, const struct v4l2_rect *r,
+    GstVideoFrame *rframe)
+{
+  gint plane;
+
+  *rframe = *frame;
+  get_rect_info (&frame->info, r, &rframe->info);
+  for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES (frame); plane++)
+    rframe->data[plane] = (guint8 *)frame->data[plane] +
+        rect_offset (&frame->info, r, plane) -
+        GST_VIDEO_INFO_PLANE_OFFSET (&frame->info, plane);
+}
+
+
+/* copy a frame of the same format and size, row by row */
+static void
+copy_rect (GstVideoFrame *dest, const guint8 *src, const GstVideoInfo *src_info)
+{
+  const guint8 *s;
+  guint8 *d;
+  gint plane, row, rows;
+  gsize bytes;
+
+  for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES (dest); plane++) {
+    s = src + GST_VIDEO_INFO_PLANE_OFFSET (src_info, plane);
+    d = GST_VIDEO_FRAME_PLANE_DATA (dest, plane);
+    rows = GST_VIDEO_INFO_COMP_HEIGHT (src_info, plane);
+    bytes = (gsize)GST_VIDEO_INFO_COMP_WIDTH (src_info, plane) *
+        GST_VIDEO_INFO_COMP_PSTRIDE (src_info, plane);
+
+    for (row = 0; row < rows; row++) {
+      memcpy (d, s, bytes);
+      s += GST_VIDEO_INFO_PLANE_STRIDE (src_info, plane);
+      d += GST_VIDEO_FRAME_PLANE_STRIDE (dest, plane);
+    }
+  }
+}
+
+
+/* the crop rectangle for this frame: a crop meta from upstream wins over
+ * the properties. Clamped to the frame and kept to even coordinates for
+ * the subsampled formats. */
+static void
+get_crop_rect (GstAccelTransform *atrans, GstBuffer *inbuf, struct v4l2_rect *r)
+{
+  GstVideoCropMeta *meta;
+  gint width, height;
+
+  width = GST_VIDEO_INFO_WIDTH (&atrans->in_info);
+  height = GST_VIDEO_INFO_HEIGHT (&atrans->in_info);
+
+  meta = gst_buffer_get_video_crop_meta (inbuf);
+  if (meta) {
+    r->left = meta->x;
+    r->top = meta->y;
+    r->width = meta->width;
+    r->height = meta->height;
+  }
+  else {
+    GST_OBJECT_LOCK (atrans);
+    *r = atrans->crop;
+    GST_OBJECT_UNLOCK (atrans);
+  }
+
+  r->left = CLAMP (r->left, 0, width - 2) & ~1;
+  r->top = CLAMP (r->top, 0, height - 2) & ~1;
+
+  /* 0 extends to the right/bottom edge */
+  if (r->width == 0 || r->width > width - r->left)
+    r->width = width - r->left;
+  if (r->height == 0 || r->height > height - r->top)
+    r->height = height - r->top;
+
+  r->width &= ~1;
+  r->height &= ~1;
+}
+
+
+/* timing is NULL unless the timing meta is enabled, buf NULL skips the cache op */
+static void
+sync_buffer (GstAccelTransform *atrans, void *buf, gsize size,
+    gboolean is_input, GstAccelTiming *timing)
+{
+  gint ret, op;
+  GstClockTime cache_start = GST_CLOCK_TIME_NONE;
+
+  if (is_input) {
+    /* flush cache for device read after cpu write */
+    op = CMEM_CACHE_FLUSH;
+  }
+  else {
+    /* invalidate cache for next cpu read after device write */
+    op = CMEM_CACHE_INVALIDATE;
+  }
+
+  if (timing)
+    cache_start = gst_util_get_timestamp ();
+
+  if (buf == NULL)
+    ret = 0;    /* already clean */
+  else if (is_input && atrans->crop_active)
+    ret = sync_rect_rows (&atrans->in_info, &atrans->cur_crop, buf, op);
+  else if (!is_input && atrans->crop_active && !atrans->tiled)
+    ret = sync_rect_rows (&atrans->hw_out_info, &atrans->out_rect, buf, op);
+  else
+    ret = cmem_do_cache_operation (buf, size, op);
+  if (ret < 0)
+    GST_WARNING_OBJECT (atrans, "cache operation(%d) failed", op);
+
+  if (timing) {
+    if (is_input) {
+      timing->cache_in_start = cache_start;
+      timing->cache_in_end = gst_util_get_timestamp ();
+    }
+    else {
+      timing->cache_out_start = cache_start;
+      timing->cache_out_end = gst_util_get_timestamp ();
+    }
+  }
+}
+
+
+static void
+free_cbuf (cmem_buf *cbuf)
+{
+  if (cbuf->buf)
+    free_cmem_buffer (cbuf->buf);
+  cbuf->buf = NULL;
+  cbuf->fd = -1;
+}
+
+
+static void
+free_output_buffers (GstAccelTransform *atrans)
+{
+  guint i, j;
+
+  for (i = 0; i < atrans->num_out_bufs; i++) {
+    free_cbuf (&atrans->out_cbuf[i]);
+    for (j = 0; j < atrans->num_prepasses; j++)
+      free_cbuf (&atrans->prepass_cbuf[j][i]);
+  }
+}
+
+
+/* accounted to the same consumer as the work buffers */
+static gboolean
+alloc_cbuf (GstAccelTransform *atrans, gsize size, cmem_buf *cbuf)
+{
+  gint fd;
+  void *buf;
+
+  fd = alloc_cmem_buffer_for (
+      gst_cmem_memory_allocator_get_consumer (atrans->allocator), size, 1, &buf);
+  if (fd < 0) {
+    GST_ERROR_OBJECT (atrans, "alloc cmem failed(ret:%d)", fd);
+    return FALSE;
+  }
+
+  cbuf->fd = fd;
+  cbuf->buf = buf;
+  return TRUE;
+}
+
+
+/*
+ * The device writes each job's output into the buffer of its slot. With
+ * more than one pass the slot also has an intermediate per earlier pass,
+ * the CPU never touches those so they need no cache maintenance.
+ */
+static gboolean
+alloc_output_buffers (GstAccelTransform *atrans)
+{
+  guint i, j;
+
+  /* strips write their bands of a wider intermediate */
+  atrans->out_cbuf_size = atrans->tiled ?
+      atrans->strip_out_size : atrans->hw_out_info.size;
+
+  for (i = 0; i < atrans->num_out_bufs; i++) {
+    if (!alloc_cbuf (atrans, atrans->out_cbuf_size, &atrans->out_cbuf[i]))
+      goto failed;
+
+    for (j = 0; j < atrans->num_prepasses; j++) {
+      if (!alloc_cbuf (atrans, MAX (atrans->prepass_info[j].size,
+                  atrans->prepass_size[j]), &atrans->prepass_cbuf[j][i]))
+        goto failed;
+    }
+  }
+
+  return TRUE;
+
+failed:
+  free_output_buffers (atrans);
+  return FALSE;
+}
+
+
+/* the VPE reads YUV only and writes RGB too */
+static gboolean
+fits_device (const GstVideoInfo *vinfo, gint max_width, gboolean is_input)
+{
+  uint32_t fourcc;
+  enum v4l2_colorspace clrspc;
+
+  return get_v4l2_fmt (vinfo, &fourcc, &clrspc) &&
+      (!is_input || GST_VIDEO_INFO_IS_YUV (vinfo)) &&
+      GST_VIDEO_INFO_WIDTH (vinfo) >= VPE_MIN_SIZE &&
+      GST_VIDEO_INFO_HEIGHT (vinfo) >= VPE_MIN_SIZE &&
+      GST_VIDEO_INFO_WIDTH (vinfo) <= max_width &&
+      GST_VIDEO_INFO_HEIGHT (vinfo) <= VPE_MAX_HEIGHT;
+}
+
+
+/* whether the formats and sizes are ones the VPE takes at all, frames
+ * wider than a line in strips of one pass each */
+static gboolean
+device_can_convert (GstAccelTransform *atrans)
+{
+  const GstVideoInfo *in_vinfo = &atrans->in_info;
+  const GstVideoInfo *out_vinfo = &atrans->hw_out_info;
+  struct v4l2_rect r = { 0, }, o = { 0, };
+
+  atrans->tiled = FALSE;
+  if (fits_device (in_vinfo, VPE_MAX_WIDTH, TRUE) &&
+      fits_device (out_vinfo, VPE_MAX_WIDTH, FALSE))
+    return TRUE;
+
+  if (atrans->fixup || !fits_device (in_vinfo, STRIP_MAX_WIDTH, TRUE) ||
+      !fits_device (out_vinfo, STRIP_MAX_WIDTH, FALSE) ||
+      scale_step (GST_VIDEO_INFO_WIDTH (in_vinfo),
+          GST_VIDEO_INFO_WIDTH (out_vinfo)) != GST_VIDEO_INFO_WIDTH (out_vinfo) ||
+      scale_step (GST_VIDEO_INFO_HEIGHT (in_vinfo),
+          GST_VIDEO_INFO_HEIGHT (out_vinfo)) != GST_VIDEO_INFO_HEIGHT (out_vinfo))
+    return FALSE;
+
+  r.width = GST_VIDEO_INFO_WIDTH (in_vinfo);
+  r.height = GST_VIDEO_INFO_HEIGHT (in_vinfo);
+  o.width = GST_VIDEO_INFO_WIDTH (out_vinfo);
+  o.height = GST_VIDEO_INFO_HEIGHT (out_vinfo);
+  atrans->tiled = plan_strips (atrans, &r, &o);
+  if (atrans->tiled)
+    GST_DEBUG_OBJECT (atrans, "%dx%d in %u strips", r.width, r.height,
+        atrans->num_strips);
+
+  return atrans->tiled;
+}
+
+
+static gboolean setup_device (GstAccelTransform *atrans)
+{
+  if (!init_device (atrans))
+    goto failed;
+
+  /* S_FMT reset the crop, the first job sets it again */
+  atrans->cur_crop.width = 0;
+  atrans->crop_active = FALSE;
+  atrans->released = FALSE;
+
+  /* input work buffers are allocated on first use */
+  atrans->allocator = g_object_new (GST_TYPE_CMEM_MEMORY_ALLOCATOR, NULL);
+  GST_OBJECT_LOCK (atrans);
+  gst_cmem_memory_allocator_set_quota (atrans->allocator, atrans->cmem_quota);
+  GST_OBJECT_UNLOCK (atrans);
+
+  if (!alloc_output_buffers (atrans))
+    goto failed_alloc;
+
+  return TRUE;
+
+failed_alloc:
+  gst_object_unref (atrans->allocator);
+  atrans->allocator = NULL;
+
+  close_sessions (atrans);
+failed:
+  atrans->num_out_bufs = 0;
+  atrans->tiled = FALSE;
+  return FALSE;
+}
+
+
+/* no device takes these caps, convert on the CPU instead. warn is set
+ * when the device should have taken them. */
+static gboolean
+setup_workers (GstAccelTransform *atrans, gboolean warn)
+{
+  guint n;
+
+  GST_OBJECT_LOCK (atrans);
+  n = atrans->cpu_threads;
+  GST_OBJECT_UNLOCK (atrans);
+
+  atrans->workers = gst_accel_workers_new (&atrans->in_info,
+      &atrans->out_info, n);
+  if (atrans->workers == NULL)
+    return FALSE;
+
+  GST_OBJECT_LOCK (atrans);
+  atrans->num_workers = gst_accel_workers_get_count (atrans->workers);
+  GST_OBJECT_UNLOCK (atrans);
+
+  /* no crop set on the converters yet */
+  atrans->cur_crop.width = 0;
+  atrans->crop_active = FALSE;
+
+  if (warn)
+    GST_ELEMENT_WARNING (atrans, RESOURCE, OPEN_READ_WRITE,
+        ("No usable video transform device, converting on the CPU"),
+        ("%u worker thread(s)", atrans->num_workers));
+  else
+    GST_INFO_OBJECT (atrans, "the device can't convert these caps, "
+        "%u worker thread(s)", atrans->num_workers);
+
+  /* the queue depth follows the number of workers */
+  gst_element_post_message (GST_ELEMENT_CAST (atrans),
+      gst_message_new_latency (GST_OBJECT_CAST (atrans)));
+
+  return TRUE;
+}
+
+
+/* forget the dedup reference, the next frame is converted */
+static void
+clear_reference (GstAccelTransform *atrans)
+{
+  atrans->ref_valid = FALSE;
+  gst_buffer_replace (&atrans->last_out, NULL);
+}
+
+
+/* drop the outputs not handed on yet */
+static void
+clear_ready (GstAccelTransform *atrans)
+{
+  GstBuffer *outbuf;
+
+  while ((outbuf = g_queue_pop_head (&atrans->ready)) != NULL)
+    gst_buffer_unref (outbuf);
+  atrans->out_dropped = FALSE;
+}
+
+
+/* with dedup on, the last output pushed is kept to be sent again */
+static inline void
+remember_output (GstAccelTransform *atrans, GstBuffer *outbuf)
+{
+  if (atrans->ref_valid)
+    gst_buffer_replace (&atrans->last_out, outbuf);
+}
+
+
+/* the analytics to compute on the next output, 0 for none */
+static GstAccelStatsFlags
+get_stats_flags (GstAccelTransform *atrans, guint *thumb_width,
+    guint *thumb_height)
+{
+  GstAccelStatsFlags flags = 0;
+
+  GST_OBJECT_LOCK (atrans);
+  if (atrans->histogram)
+    flags |= GST_ACCEL_STATS_HISTOGRAM;
+  if (atrans->moments)
+    flags |= GST_ACCEL_STATS_MOMENTS;
+  if (atrans->thumb_width > 0 && atrans->thumb_height > 0)
+    flags |= GST_ACCEL_STATS_THUMBNAIL;
+  *thumb_width = atrans->thumb_width;
+  *thumb_height = atrans->thumb_height;
+  GST_OBJECT_UNLOCK (atrans);
+
+  return flags;
+}
+
+
+static GstMessage *
+stats_message (GstAccelTransform *atrans, GstBuffer *outbuf,
+    const GstAccelStats *stats)
+{
+  GstStructure *st;
+  GValue array = G_VALUE_INIT, val = G_VALUE_INIT;
+  GstBuffer *thumb;
+  guint8 *data;
+  gsize size;
+  guint i;
+
+  st = gst_structure_new ("accel-stats",
+      "timestamp", G_TYPE_UINT64, GST_BUFFER_PTS (outbuf), NULL);
+
+  if (stats->flags & GST_ACCEL_STATS_HISTOGRAM) {
+    g_value_init (&array, GST_TYPE_ARRAY);
+    g_value_init (&val, G_TYPE_UINT);
+    for (i = 0; i < GST_ACCEL_STATS_HISTOGRAM_BINS; i++) {
+      g_value_set_uint (&val, stats->histogram[i]);
+      gst_value_array_append_value (&array, &val);
+    }
+    gst_structure_take_value (st, "histogram", &array);
+    g_value_unset (&val);
+  }
+
+  if (stats->flags & GST_ACCEL_STATS_MOMENTS)
+    gst_structure_set (st, "mean", G_TYPE_DOUBLE, stats->mean,
+        "variance", G_TYPE_DOUBLE, stats->variance, NULL);
+
+  /* GRAY8, rows packed */
+  if (stats->flags & GST_ACCEL_STATS_THUMBNAIL) {
+    size = stats->thumb_width * stats->thumb_height;
+    data = g_malloc (size);
+    memcpy (data, stats->thumbnail, size);
+    thumb = gst_buffer_new_wrapped (data, size);
+    gst_structure_set (st, "thumbnail", GST_TYPE_BUFFER, thumb,
+        "thumbnail-width", G_TYPE_UINT, stats->thumb_width,
+        "thumbnail-height", G_TYPE_UINT, stats->thumb_height, NULL);
+    gst_buffer_unref (thumb);
+  }
+
+  return gst_message_new_element (GST_OBJECT_CAST (atrans), st);
+}
+
+
+/* attach what the copy out computed to its output, and post it */
+static void
+report_stats (GstAccelTransform *atrans, GstBuffer *outbuf,
+    GstAccelStats *stats)
+{
+  gboolean message;
+
+  if (stats->flags == 0)
+    return;
+
+  GST_OBJECT_LOCK (atrans);
+  message = atrans->analytics_message;
+  GST_OBJECT_UNLOCK (atrans);
+
+  if (message)
+    gst_element_post_message (GST_ELEMENT_CAST (atrans),
+        stats_message (atrans, outbuf, stats));
+
+  gst_buffer_add_accel_stats_meta (outbuf, stats);
+}
+
+
+/* the rest of the frame is left as it was, downstream shows out_rect */
+static void
+set_crop_meta (GstAccelTransform *atrans, GstBuffer *outbuf)
+{
+  GstVideoCropMeta *meta;
+
+  if (!atrans->crop_active || !atrans->crop_meta)
+    return;
+
+  meta = gst_buffer_get_video_crop_meta (outbuf);
+  if (meta == NULL)
+    meta = gst_buffer_add_video_crop_meta (outbuf);
+  meta->x = atrans->out_rect.left;
+  meta->y = atrans->out_rect.top;
+  meta->width = atrans->out_rect.width;
+  meta->height = atrans->out_rect.height;
+}
+
+
+/* the workers' outputs have no copy out to share, they are read again */
+static void
+analyse_output (GstAccelTransform *atrans, GstBuffer *outbuf)
+{
+  GstAccelStats stats = { 0, };
+  GstAccelStatsFlags flags;
+  GstVideoFrame frame, rframe;
+  guint tw, th;
+
+  flags = get_stats_flags (atrans, &tw, &th);
+  if (flags == 0)
+    return;
+
+  /* the crop changes between frames only, all were written to out_rect */
+  if (!gst_video_frame_map (&frame, &atrans->out_info, outbuf, GST_MAP_READ))
+    return;
+  get_rect_frame (&frame, &atrans->out_rect, &rframe);
+  gst_accel_stats_copy (&stats, flags, tw, th, NULL,
+      GST_VIDEO_FRAME_PLANE_DATA (&rframe, 0), &rframe.info);
+  gst_video_frame_unmap (&frame);
+
+  report_stats (atrans, outbuf, &stats);
+}
+
+
+static void
+release_job_input (GstAccelTransformJob *job)
+{
+  if (job->in_mapped) {
+    gst_buffer_unmap (job->inbuf, &job->in_map);
+    job->in_mapped = FALSE;
+  }
+  if (job->inbuf) {
+    gst_buffer_unref (job->inbuf);
+    job->inbuf = NULL;
+  }
+}
+
+
+static void
+release_jobs (GstAccelTransform *atrans)
+{
+  GstAccelTransformJob *job;
+
+  while (atrans->job_count > 0) {
+    job = &atrans->jobs[atrans->job_head];
+    release_job_input (job);
+    atrans->devices[job->device].in_flight--;
+    if (job->outbuf) {
+      gst_buffer_unmap (job->outbuf, &job->out_map);
+      job->outbuf = NULL;
+    }
+
+    atrans->job_head = (atrans->job_head + 1) % atrans->num_out_bufs;
+    atrans->job_count--;
+  }
+
+  atrans->job_head = 0;
+}
+
+
+/* stop every device, the frames in flight are dropped */
+static void
+flush_devices (GstAccelTransform *atrans)
+{
+  guint i;
+
+  for (i = 0; i < atrans->num_devices; i++) {
+    (void)vpeconv_flush (atrans->devices[i].session);
+    atrans->devices[i].last_done = GST_CLOCK_TIME_NONE;
+  }
+  for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_STRIPS - 1; i++) {
+    if (atrans->strip_session[i])
+      (void)vpeconv_flush (atrans->strip_session[i]);
+  }
+}
+
+
+static void cleanup_device (GstAccelTransform *atrans)
+{
+  int i;
+
+  clear_reference (atrans);
+  clear_ready (atrans);
+
+  if (atrans->workers) {
+    gst_accel_workers_free (atrans->workers);
+    atrans->workers = NULL;
+    GST_OBJECT_LOCK (atrans);
+    atrans->num_workers = 0;
+    GST_OBJECT_UNLOCK (atrans);
+  }
+
+  /* the device stops reading the inputs we hold */
+  flush_devices (atrans);
+  atrans->released = FALSE;
+  release_jobs (atrans);
 
-#define OUTPUT_BUF_QUEUE_NUM 2
+  free_output_buffers (atrans);
+  atrans->num_out_bufs = 0;
 
-typedef struct {
-  void *buf;
-  int fd;
-} cmem_buf;
+  /* work buffers are sized for the current input caps */
+  for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH; i++) {
+    if (atrans->work_mem[i]) {
+      gst_memory_unref (atrans->work_mem[i]);
+      atrans->work_mem[i] = NULL;
+    }
+  }
+
+  if (atrans->allocator) {
+    gst_object_unref (atrans->allocator);
+    atrans->allocator = NULL;
+  }
+
+  close_sessions (atrans);
+}
+
+
+/* discard all in-flight frames */
+static void
+flush_jobs (GstAccelTransform *atrans)
+{
+  clear_reference (atrans);
+  clear_ready (atrans);
+
+  if (atrans->workers) {
+    (void)gst_accel_workers_flush (atrans->workers);
+    return;
+  }
+
+  /* nothing is queued while the buffers are released */
+  if (atrans->num_devices == 0 || atrans->released)
+    return;
+
+  flush_devices (atrans);
+  release_jobs (atrans);
+}
+
+
+/*
+ * Bring the device back after a failed or stuck job, the session resets
+ * its queues or reopens the device. Only the frames in flight are lost.
+ */
+static gboolean
+recover_device (GstAccelTransform *atrans)
+{
+  guint lost, i;
+
+  lost = atrans->job_count;
+
+  GST_OBJECT_LOCK (atrans);
+  atrans->consecutive_faults++;
+  if (atrans->consecutive_faults >= MAX_CONSECUTIVE_FAULTS) {
+    GST_OBJECT_UNLOCK (atrans);
+    goto failed;
+  }
+  GST_OBJECT_UNLOCK (atrans);
+
+  /* the earlier passes have nothing in flight between frames */
+  for (i = 0; i < atrans->num_prepasses; i++) {
+    if (vpeconv_reset (atrans->prepass[i]) < 0)
+      goto failed;
+  }
+  for (i = 0; i < atrans->num_devices; i++) {
+    if (vpeconv_reset (atrans->devices[i].session) < 0)
+      goto failed;
+    atrans->devices[i].last_done = GST_CLOCK_TIME_NONE;
+  }
+  for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_STRIPS - 1; i++) {
+    if (atrans->strip_session[i] &&
+        vpeconv_reset (atrans->strip_session[i]) < 0)
+      goto failed;
+  }
+  release_jobs (atrans);
+  clear_reference (atrans);
+
+  atrans->cur_crop.width = 0;
+  atrans->crop_active = FALSE;
+
+  GST_OBJECT_LOCK (atrans);
+  atrans->recoveries++;
+  atrans->frames_lost += lost;
+  GST_OBJECT_UNLOCK (atrans);
+
+  GST_ELEMENT_WARNING (atrans, RESOURCE, FAILED,
+      ("Video transform device recovered from a fault"),
+      ("%u frame(s) in flight were dropped", lost));
+
+  return TRUE;
+
+failed:
+  GST_ELEMENT_ERROR (atrans, RESOURCE, FAILED,
+      ("Video transform device could not be recovered"), (NULL));
+  return FALSE;
+}
+
+
+/* number of frames kept queued on the device */
+static guint
+get_queue_depth (GstAccelTransform *atrans)
+{
+  guint depth, workers;
+
+  GST_OBJECT_LOCK (atrans);
+  if (atrans->mode == GST_ACCEL_TRANSFORM_MODE_THROUGHPUT)
+    depth = atrans->queue_depth;
+  else
+    depth = 1;
+  workers = atrans->num_workers;
+  GST_OBJECT_UNLOCK (atrans);
+
+  /* every queued frame needs a capture buffer, or a worker on the CPU */
+  if (workers > 0)
+    depth = MIN (depth, workers);
+  else if (atrans->num_out_bufs > 0)
+    depth = MIN (depth, atrans->num_out_bufs);
+
+  return MAX (depth, 1);
+}
+
+
+/*
+ * Run the passes before the last, each one waits for the previous. The
+ * first reads the input from fd or, on a USERPTR queue, ptr. Returns 1
+ * with the last intermediate in fd, 0 when the input was refused.
+ */
+static gint
+run_prepasses (GstAccelTransform *atrans, guint slot, gint *fd, void *ptr)
+{
+  vpeconv_frame frame;
+  vpeconv_completion done;
+  guint i, timeout;
+  gint ret;
+
+  GST_OBJECT_LOCK (atrans);
+  timeout = atrans->watchdog_timeout;
+  GST_OBJECT_UNLOCK (atrans);
+
+  for (i = 0; i < atrans->num_prepasses; i++) {
+    frame.in_fd = *fd;
+    frame.out_fd = atrans->prepass_cbuf[i][slot].fd;
+    frame.in_ptr = ptr;
+    frame.out_ptr = NULL;
+    frame.user_data = NULL;
+
+    ret = vpeconv_submit (atrans->prepass[i], &frame, 1);
+    if (ret == 0 && vpeconv_refused (atrans->prepass[i]))
+      return 0;
+    if (ret != 1) {
+      GST_WARNING_OBJECT (atrans, "queue scale pass %u failed", i);
+      return -1;
+    }
+
+    ret = vpeconv_complete (atrans->prepass[i], &done, 1,
+        timeout > 0 ? (gint)timeout : -1);
+    if (ret != 1 || done.status != 0) {
+      GST_WARNING_OBJECT (atrans, "scale pass %u failed", i);
+      return -1;
+    }
+
+    *fd = frame.out_fd;
+    ptr = NULL;
+  }
+
+  return 1;
+}
+
+
+/*
+ * Map a buffer the device can use in place: the layout it reads or
+ * writes, an address the VPDMA takes and one block of memory. Whether
+ * the pages are physically contiguous only shows when the device pins
+ * them at queue time.
+ */
+static gboolean
+map_direct (GstBuffer *buf, const GstVideoInfo *vinfo, gsize size,
+    GstMapFlags flags, GstMapInfo *map)
+{
+  GstVideoMeta *vmeta;
+  guint i;
+
+  if (gst_buffer_n_memory (buf) != 1)
+    return FALSE;
+
+  vmeta = gst_buffer_get_video_meta (buf);
+  if (vmeta) {
+    for (i = 0; i < vmeta->n_planes; i++) {
+      if (vmeta->offset[i] != GST_VIDEO_INFO_PLANE_OFFSET (vinfo, i) ||
+          vmeta->stride[i] != GST_VIDEO_INFO_PLANE_STRIDE (vinfo, i))
+        return FALSE;
+    }
+  }
+
+  if (!gst_buffer_map (buf, map, flags))
+    return FALSE;
+
+  if (map->size < size || ((guintptr)map->data & (VPE_DMA_ALIGN - 1)) != 0) {
+    gst_buffer_unmap (buf, map);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/* copy a system-memory input into the work buffer of its slot */
+static GstFlowReturn
+stage_input (GstAccelTransform *atrans, GstBuffer *inbuf, guint slot,
+    GstAccelTiming *timing, GstCMemMemory **staged)
+{
+  GstMapInfo map;
+  GstCMemMemory *cmem;
+
+  /* the strips' windows are pinned from their first byte */
+  if (G_UNLIKELY (atrans->work_mem[slot] == NULL)) {
+    atrans->work_mem[slot] = gst_allocator_alloc (atrans->allocator,
+        atrans->tiled ? strip_in_size (atrans) : atrans->in_info.size, NULL);
+    if (atrans->work_mem[slot] == NULL) {
+      GST_ERROR_OBJECT (atrans, "gst_allocator_alloc failed");
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  if (!gst_buffer_map (inbuf, &map, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (atrans, "Could not map buffer, skipping");
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  }
+
+  cmem = (GstCMemMemory *)atrans->work_mem[slot];
+  if (timing)
+    timing->copy_in_start = gst_util_get_timestamp ();
+  if (atrans->crop_active)
+    copy_crop_rows (atrans, cmem->data, map.data, map.size);
+  else
+    memcpy (cmem->data, map.data, MIN (map.size, atrans->in_info.size));
+  if (timing)
+    timing->copy_in_end = gst_util_get_timestamp ();
+  gst_buffer_unmap (inbuf, &map);
+
+  *staged = cmem;
+  return GST_FLOW_OK;
+}
+
+
+/* the device refused the input in place, go through the work buffer */
+static GstFlowReturn
+fall_back_input (GstAccelTransform *atrans, GstAccelTransformJob *job,
+    GstBuffer *inbuf, guint slot, GstAccelTiming *timing, gint *in_fd,
+    void **in_ptr)
+{
+  GstCMemMemory *cmem;
+  GstFlowReturn res;
+
+  release_job_input (job);
+  if (++atrans->in_rejects == MAX_DIRECT_REJECTS)
+    GST_INFO_OBJECT (atrans, "upstream buffers keep being refused, copying in");
+
+  res = stage_input (atrans, inbuf, slot, timing, &cmem);
+  if (res != GST_FLOW_OK)
+    return res;
+  sync_buffer (atrans, cmem->data, atrans->in_info.size, TRUE, timing);
+
+  *in_fd = cmem->fd;
+  *in_ptr = cmem->data;
+  return GST_FLOW_OK;
+}
+
+
+/*
+ * The device expected to finish a new frame first, from the time its
+ * frames took to complete and how many it has queued. One not measured
+ * yet gets frames until it is, one with every slot taken none. The
+ * queue depth leaves a slot free on one of them.
+ */
+static guint
+pick_device (GstAccelTransform *atrans)
+{
+  GstAccelTransformDevice *dev;
+  GstClockTime cost, best_cost = GST_CLOCK_TIME_NONE;
+  guint i, best = 0, slots = get_device_slots (atrans);
+
+  for (i = 0; i < atrans->num_devices; i++) {
+    dev = &atrans->devices[i];
+    if (dev->in_flight >= slots)
+      continue;
+    cost = (dev->in_flight + 1) * dev->frame_time;
+    if (best_cost == GST_CLOCK_TIME_NONE || cost < best_cost ||
+        (cost == best_cost &&
+            dev->in_flight < atrans->devices[best].in_flight)) {
+      best = i;
+      best_cost = cost;
+    }
+  }
+
+  return best;
+}
+
+
+/* the device refused the output in place, copy out as usual */
+static void
+fall_back_output (GstAccelTransform *atrans, GstAccelTransformJob *job,
+    guint slot, GstAccelTiming *timing)
+{
+  gst_buffer_unmap (job->outbuf, &job->out_map);
+  job->outbuf = NULL;
+  if (++atrans->out_rejects == MAX_DIRECT_REJECTS)
+    GST_INFO_OBJECT (atrans, "downstream buffers keep being refused, "
+        "copying out");
+
+  sync_buffer (atrans, atrans->out_cbuf[slot].buf, atrans->hw_out_info.size,
+      FALSE, timing);
+}
+
+
+/*
+ * Queue the strips before the last, each reading its window of in_ptr
+ * and writing its band of the slot's intermediate. Returns 1 when all
+ * are queued, 0 when the first refused the input.
+ */
+static gint
+submit_strips (GstAccelTransform *atrans, GstAccelTransformJob *job,
+    guint slot, void *in_ptr)
+{
+  GstAccelTransformStrip *strip;
+  vpeconv_frame frame;
+  guint i;
+  gint ret;
+
+  for (i = 0; i + 1 < atrans->num_strips; i++) {
+    strip = &atrans->strips[i];
+    frame.in_fd = -1;
+    frame.out_fd = -1;
+    frame.in_ptr = (guint8 *)in_ptr +
+        strip_offset (&atrans->in_info, strip->in_x);
+    frame.out_ptr = (guint8 *)atrans->out_cbuf[slot].buf +
+        strip_offset (&atrans->tile_info, strip->band_x);
+    frame.user_data = job;
+
+    ret = vpeconv_submit (atrans->strip_session[i], &frame, 1);
+    if (ret == 0 && i == 0 &&
+        vpeconv_refused (atrans->strip_session[i]) == VPECONV_REFUSED_INPUT)
+      return 0;
+    if (ret != 1) {
+      GST_WARNING_OBJECT (atrans, "queue strip %u failed", i);
+      return -1;
+    }
+  }
+
+  return 1;
+}
+
+
+/*
+ * Queue the input frame on the device. outbuf, if not NULL, is where
+ * this frame completes, the device writes it in place when it can.
+ */
+static GstFlowReturn
+submit_job (GstAccelTransform *atrans, GstBuffer *inbuf, GstBuffer *outbuf)
+{
+  gint ret, in_fd = -1;
+  void *in_ptr = NULL;
+  guint slot, i;
+  GstMemory *mem;
+  GstCMemMemory *cmem;
+  GstCMemMeta *cmeta;
+  GstAccelTransformJob *job;
+  GstAccelTiming *timing = NULL;
+  GstFlowReturn res;
+  GstAccelTransformDevice *dev;
+  vpeconv_frame frame;
+  void *flush_buf = NULL;
+
+  slot = (atrans->job_head + atrans->job_count) % atrans->num_out_bufs;
+  job = &atrans->jobs[slot];
+
+  gst_accel_timing_reset (&job->timing);
+  GST_OBJECT_LOCK (atrans);
+  if (G_UNLIKELY (atrans->timing_meta))
+    timing = &job->timing;
+  GST_OBJECT_UNLOCK (atrans);
+
+  job->inbuf = NULL;
+  job->in_mapped = FALSE;
+  mem = gst_buffer_peek_memory (inbuf, 0);
+  if (atrans->tiled) {
+    /* the strips read their windows of contiguous memory in place */
+    if (GST_IS_CMEM_MEMORY_ALLOCATOR (mem->allocator) &&
+        map_direct (inbuf, &atrans->in_info, strip_in_size (atrans),
+            GST_MAP_READ, &job->in_map)) {
+      job->inbuf = gst_buffer_ref (inbuf);
+      job->in_mapped = TRUE;
+      in_ptr = job->in_map.data;
+
+      cmeta = gst_buffer_get_cmem_meta (inbuf);
+      if (cmeta == NULL || cmeta->cache_state != GST_CMEM_CACHE_CLEAN)
+        flush_buf = in_ptr;
+    }
+  }
+  else if (atrans->in_userptr) {
+    /* any memory the device can reach, held until the job completes */
+    if (atrans->in_rejects < MAX_DIRECT_REJECTS &&
+        map_direct (inbuf, &atrans->in_info, atrans->v4l2_in_size,
+            GST_MAP_READ, &job->in_map)) {
+      job->inbuf = gst_buffer_ref (inbuf);
+      job->in_mapped = TRUE;
+      in_ptr = job->in_map.data;
+
+      /* vb2 syncs the pages it pins, not PFN-mapped CMEM */
+      if (GST_IS_CMEM_MEMORY_ALLOCATOR (mem->allocator)) {
+        cmeta = gst_buffer_get_cmem_meta (inbuf);
+        if (cmeta == NULL || cmeta->cache_state != GST_CMEM_CACHE_CLEAN)
+          flush_buf = in_ptr;
+      }
+    }
+  }
+  else if (GST_IS_CMEM_MEMORY_ALLOCATOR (mem->allocator)) {
+    /* the device reads it directly, keep it alive until the job completes */
+    cmem = (GstCMemMemory *)mem;
+    job->inbuf = gst_buffer_ref (inbuf);
+    in_fd = cmem->fd;
+
+    /* an upstream that flushed already says so in the meta */
+    cmeta = gst_buffer_get_cmem_meta (inbuf);
+    if (cmeta == NULL || cmeta->cache_state != GST_CMEM_CACHE_CLEAN)
+      flush_buf = cmem->data;
+  }
+
+  if (job->inbuf == NULL) {
+    res = stage_input (atrans, inbuf, slot, timing, &cmem);
+    if (res != GST_FLOW_OK)
+      return res;
+    in_fd = cmem->fd;
+    in_ptr = cmem->data;
+    flush_buf = cmem->data;
+  }
+
+  /* what the CPU wrote to CMEM, NULL when it is clean or not CMEM */
+  sync_buffer (atrans, flush_buf,
+      atrans->tiled ? strip_in_size (atrans) : atrans->in_info.size, TRUE,
+      timing);
+
+  /* strips write their bands of a USERPTR intermediate, stitched on the
+   * copy out */
+  job->outbuf = NULL;
+  if (outbuf && atrans->out_userptr && !atrans->fixup && !atrans->tiled &&
+      atrans->out_rejects < MAX_DIRECT_REJECTS &&
+      map_direct (outbuf, &atrans->out_info, atrans->v4l2_out_size,
+          GST_MAP_WRITE, &job->out_map))
+    job->outbuf = outbuf;
+  else if (atrans->tiled)
+    sync_buffer (atrans, atrans->out_cbuf[slot].buf, atrans->out_cbuf_size,
+        FALSE, timing);
+  else
+    sync_buffer (atrans, atrans->out_cbuf[slot].buf, atrans->hw_out_info.size,
+        FALSE, timing);
+
+  res = GST_ACCEL_FLOW_DEVICE_ERROR;
+
+  /* the intermediates stay on the device side, no cache maintenance */
+  if (atrans->num_prepasses > 0) {
+    ret = run_prepasses (atrans, slot, &in_fd, in_ptr);
+    if (ret == 0 && job->in_mapped) {
+      res = fall_back_input (atrans, job, inbuf, slot, timing, &in_fd, &in_ptr);
+      if (res != GST_FLOW_OK)
+        goto failed;
+      res = GST_ACCEL_FLOW_DEVICE_ERROR;
+      ret = run_prepasses (atrans, slot, &in_fd, in_ptr);
+    }
+    if (ret != 1)
+      goto failed;
+    in_ptr = NULL;
+  }
+
+  /* all but the last strip, that one goes to the picked device */
+  if (atrans->tiled) {
+    ret = submit_strips (atrans, job, slot, in_ptr);
+    if (ret == 0 && job->in_mapped) {
+      res = fall_back_input (atrans, job, inbuf, slot, timing, &in_fd, &in_ptr);
+      if (res != GST_FLOW_OK)
+        goto failed;
+      res = GST_ACCEL_FLOW_DEVICE_ERROR;
+      ret = submit_strips (atrans, job, slot, in_ptr);
+    }
+    if (ret != 1)
+      goto failed;
+  }
+
+  job->device = pick_device (atrans);
+  dev = &atrans->devices[job->device];
+
+  frame.in_fd = in_fd;
+  frame.out_fd = atrans->out_cbuf[slot].fd;
+  frame.in_ptr = in_ptr;
+  frame.out_ptr = job->outbuf ? job->out_map.data : atrans->out_cbuf[slot].buf;
+  frame.user_data = job;
+
+  if (atrans->tiled) {
+    frame.in_ptr = (guint8 *)in_ptr + strip_offset (&atrans->in_info,
+        atrans->strips[atrans->num_strips - 1].in_x);
+    frame.out_ptr = (guint8 *)frame.out_ptr + strip_offset (&atrans->tile_info,
+        atrans->strips[atrans->num_strips - 1].band_x);
+  }
+
+  while ((ret = vpeconv_submit (dev->session, &frame, 1)) == 0) {
+    switch (vpeconv_refused (dev->session)) {
+      case VPECONV_REFUSED_INPUT:
+        /* the strips read it at their own offsets */
+        if (!job->in_mapped || atrans->tiled)
+          goto failed;
+        res = fall_back_input (atrans, job, inbuf, slot, timing, &frame.in_fd,
+            &frame.in_ptr);
+        if (res != GST_FLOW_OK)
+          goto failed;
+        res = GST_ACCEL_FLOW_DEVICE_ERROR;
+        break;
+      case VPECONV_REFUSED_OUTPUT:
+        if (!job->outbuf)
+          goto failed;
+        fall_back_output (atrans, job, slot, timing);
+        frame.out_ptr = atrans->out_cbuf[slot].buf;
+        break;
+      default:
+        goto failed;
+    }
+  }
+
+  if (ret != 1) {
+    GST_WARNING_OBJECT (atrans, "queue buffers on %s failed(dma_fd:%d)",
+        dev->name, frame.in_fd);
+    goto failed;
+  }
+
+  job->submitted = gst_util_get_timestamp ();
+  dev->in_flight++;
+
+  if (job->in_mapped)
+    atrans->in_rejects = 0;
+  if (job->outbuf)
+    atrans->out_rejects = 0;
+
+  if (timing)
+    timing->qbuf = gst_util_get_timestamp ();
+
+  job->pts = GST_BUFFER_PTS (inbuf);
+  job->dts = GST_BUFFER_DTS (inbuf);
+  job->duration = GST_BUFFER_DURATION (inbuf);
+
+  /* variable framerate caps, take the latency unit from the stream */
+  if (!GST_CLOCK_TIME_IS_VALID (atrans->frame_duration))
+    atrans->frame_duration = job->duration;
+
+  atrans->job_count++;
+
+  return GST_FLOW_OK;
+
+failed:
+  /* strips already queued still read the input, drop them before it is
+   * released; the recovery that follows drops the other frames in flight */
+  if (atrans->tiled && res == GST_ACCEL_FLOW_DEVICE_ERROR) {
+    for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_STRIPS - 1; i++) {
+      if (atrans->strip_session[i])
+        (void)vpeconv_flush (atrans->strip_session[i]);
+    }
+  }
+  release_job_input (job);
+  if (job->outbuf) {
+    gst_buffer_unmap (job->outbuf, &job->out_map);
+    job->outbuf = NULL;
+  }
+  return res;
+}
+
+
+/*
+ * The time a frame took on its device: from its submission, or from the
+ * completion before it while the device was still busy. Taken when the
+ * frame is collected, which is late for frames behind a slower device;
+ * the average smooths that out.
+ */
+static void
+update_frame_time (GstAccelTransformDevice *dev, GstAccelTransformJob *job,
+    GstClockTime now)
+{
+  GstClockTime start, sample;
+
+  start = job->submitted;
+  if (GST_CLOCK_TIME_IS_VALID (dev->last_done) && dev->last_done > start)
+    start = dev->last_done;
+  sample = now > start ? now - start : 0;
+  dev->last_done = now;
+
+  if (dev->frame_time == 0)
+    dev->frame_time = sample;
+  else
+    dev->frame_time = (3 * dev->frame_time + sample) / 4;
+}
+
+
+/* copy the kept columns of each band into the frame, each row once */
+static void
+stitch_strips (GstAccelTransform *atrans, GstVideoFrame *frame,
+    const guint8 *tiles)
+{
+  const GstVideoInfo *tinfo = &atrans->tile_info;
+  const GstAccelTransformStrip *strip;
+  const guint8 *src;
+  guint8 *dst;
+  gint plane, row, rows, pstride, wsub;
+  guint i;
+
+  /* the formats have one component per plane, at its start */
+  for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES (frame); plane++) {
+    src = tiles + GST_VIDEO_INFO_PLANE_OFFSET (tinfo, plane);
+    dst = GST_VIDEO_FRAME_PLANE_DATA (frame, plane);
+    rows = GST_VIDEO_INFO_COMP_HEIGHT (tinfo, plane);
+    pstride = GST_VIDEO_INFO_COMP_PSTRIDE (tinfo, plane);
+    wsub = GST_VIDEO_FORMAT_INFO_W_SUB (tinfo->finfo, plane);
+
+    for (row = 0; row < rows; row++) {
+      for (i = 0; i < atrans->num_strips; i++) {
+        strip = &atrans->strips[i];
+        memcpy (dst + GST_VIDEO_SUB_SCALE (wsub, strip->out_x) * pstride,
+            src + GST_VIDEO_SUB_SCALE (wsub, strip->band_x + strip->skip) *
+            pstride, GST_VIDEO_SUB_SCALE (wsub, strip->out_width) * pstride);
+      }
+      src += GST_VIDEO_INFO_PLANE_STRIDE (tinfo, plane);
+      dst += GST_VIDEO_FRAME_PLANE_STRIDE (frame, plane);
+    }
+  }
+}
+
+
+/* wait for the oldest in-flight frame and copy it into outbuf, unless the
+ * device wrote it there */
+static GstFlowReturn
+complete_job (GstAccelTransform *atrans, GstBuffer *outbuf)
+{
+  gint ret, index;
+  guint timeout;
+  GstMemory *mem;
+  GstCMemMeta *cmeta;
+  GstVideoFrame frame, rframe;
+  GstVideoInfo rinfo;
+  const struct v4l2_rect *o = &atrans->out_rect;
+  const guint8 *src;
+  guint8 *data;
+  GstAccelTransformJob *job;
+  GstAccelTiming *timing = NULL;
+  GstAccelTransformDevice *dev;
+  GstClockTime now;
+  vpeconv_completion done;
+  GstAccelStats stats = { 0, };
+  GstAccelStatsFlags stats_flags;
+  guint thumb_w, thumb_h, i;
+
+  job = &atrans->jobs[atrans->job_head];
+  stats_flags = get_stats_flags (atrans, &thumb_w, &thumb_h);
+
+  /* watchdog: DQBUF blocks forever on a hung device. The timing is only
+   * stamped if the meta was enabled when the job was submitted */
+  GST_OBJECT_LOCK (atrans);
+  timeout = atrans->watchdog_timeout;
+  if (G_UNLIKELY (atrans->timing_meta) && GST_CLOCK_TIME_IS_VALID (job->timing.qbuf))
+    timing = &job->timing;
+  GST_OBJECT_UNLOCK (atrans);
+
+  /* later frames on faster devices wait their turn */
+  dev = &atrans->devices[job->device];
+  ret = vpeconv_complete (dev->session, &done, 1,
+      timeout > 0 ? (gint)timeout : -1);
+  if (ret == 0) {
+    GST_WARNING_OBJECT (atrans, "job stuck on %s for %u ms", dev->name,
+        timeout);
+    goto failed;
+  }
+  if (ret < 0) {
+    GST_WARNING_OBJECT (atrans, "dequeue buffer from %s failed", dev->name);
+    goto failed;
+  }
+
+  now = gst_util_get_timestamp ();
+  if (timing)
+    timing->dqbuf = now;
+
+  /* a device completes its own frames in submit order */
+  g_assert (done.user_data == job);
+  if (done.status != 0) {
+    GST_WARNING_OBJECT (atrans, "%s flagged the frame as corrupt", dev->name);
+    goto failed;
+  }
+  update_frame_time (dev, job, now);
+
+  /* the frame's other strips, on sessions of their own */
+  for (i = 0; atrans->tiled && i + 1 < atrans->num_strips; i++) {
+    ret = vpeconv_complete (atrans->strip_session[i], &done, 1,
+        timeout > 0 ? (gint)timeout : -1);
+    if (ret != 1) {
+      GST_WARNING_OBJECT (atrans, "strip %u failed", i);
+      goto failed;
+    }
+    g_assert (done.user_data == job);
+    if (done.status != 0) {
+      GST_WARNING_OBJECT (atrans, "strip %u flagged as corrupt", i);
+      goto failed;
+    }
+  }
+
+  /* with a crop only out_rect was written, the analytics cover it */
+  index = atrans->job_head;
+  if (job->outbuf) {
+    g_assert (job->outbuf == outbuf);
+
+    /* written in place: vb2 syncs pages it pinned, but leaves the caches
+     * of PFN-mapped CMEM alone, drop them before anything reads it */
+    ret = 0;
+    mem = gst_buffer_peek_memory (outbuf, 0);
+    if (GST_IS_CMEM_MEMORY_ALLOCATOR (mem->allocator)) {
+      if (atrans->crop_active)
+        ret = sync_rect_rows (&atrans->out_info, o, job->out_map.data,
+            CMEM_CACHE_INVALIDATE);
+      else
+        ret = cmem_do_cache_operation (job->out_map.data,
+            atrans->out_info.size, CMEM_CACHE_INVALIDATE);
+      if (ret < 0)
+        GST_WARNING_OBJECT (atrans, "cache operation(%d) failed",
+            CMEM_CACHE_INVALIDATE);
+    }
+
+    get_rect_info (&atrans->out_info, o, &rinfo);
+    if (stats_flags)
+      gst_accel_stats_copy (&stats, stats_flags, thumb_w, thumb_h, NULL,
+          job->out_map.data + rect_offset (&atrans->out_info, o, 0), &rinfo);
+    gst_buffer_unmap (job->outbuf, &job->out_map);
+    job->outbuf = NULL;
+
+    cmeta = gst_buffer_get_cmem_meta (outbuf);
+    if (cmeta)
+      cmeta->cache_state = ret < 0 ?
+          GST_CMEM_CACHE_DEVICE_DIRTY : GST_CMEM_CACHE_CLEAN;
+  }
+  else if (gst_video_frame_map (&frame, &atrans->out_info, outbuf,
+          GST_MAP_WRITE)) {
+    if (timing)
+      timing->copy_out_start = gst_util_get_timestamp ();
+    get_rect_frame (&frame, o, &rframe);
+    get_rect_info (&atrans->hw_out_info, o, &rinfo);
+    src = (const guint8 *)atrans->out_cbuf[index].buf +
+        rect_offset (&atrans->hw_out_info, o, 0);
+    if (atrans->tiled || atrans->fixup || atrans->crop_active) {
+      if (atrans->tiled)
+        stitch_strips (atrans, &rframe, atrans->out_cbuf[index].buf);
+      else if (atrans->fixup)
+        gst_accel_fixup_frame (&rframe, src, &rinfo);
+      else
+        copy_rect (&rframe, src, &rinfo);
+      if (stats_flags)
+        gst_accel_stats_copy (&stats, stats_flags, thumb_w, thumb_h, NULL,
+            GST_VIDEO_FRAME_PLANE_DATA (&rframe, 0), &rframe.info);
+    }
+    else {
+      /* the analytics read each row as it is copied */
+      gst_accel_stats_copy (&stats, stats_flags, thumb_w, thumb_h,
+          GST_VIDEO_FRAME_PLANE_DATA (&frame, 0), atrans->out_cbuf[index].buf,
+          &atrans->out_info);
+    }
+    if (timing)
+      timing->copy_out_end = gst_util_get_timestamp ();
+    gst_video_frame_unmap (&frame);
+
+    /* the next accelerator reads it without touching our caches */
+    cmeta = gst_buffer_get_cmem_meta (outbuf);
+    if (cmeta) {
+      mem = gst_buffer_peek_memory (outbuf, 0);
+      data = ((GstCMemMemory *)mem)->data;
+      if (atrans->crop_active)
+        ret = sync_rect_rows (&atrans->out_info, o, data, CMEM_CACHE_FLUSH);
+      else
+        ret = cmem_do_cache_operation (data, mem->size, CMEM_CACHE_FLUSH);
+      if (ret < 0)
+        cmeta->cache_state = GST_CMEM_CACHE_CPU_DIRTY;
+      else
+        cmeta->cache_state = GST_CMEM_CACHE_CLEAN;
+    }
+  }
+  else {
+    GST_WARNING_OBJECT (atrans, "Could not map buffer, skipping");
+  }
+
+  set_crop_meta (atrans, outbuf);
+
+  /* the output belongs to an earlier input when the queue is deep */
+  GST_BUFFER_PTS (outbuf) = job->pts;
+  GST_BUFFER_DTS (outbuf) = job->dts;
+  GST_BUFFER_DURATION (outbuf) = job->duration;
+
+  if (timing)
+    gst_buffer_add_accel_timing_meta (outbuf, timing);
+  report_stats (atrans, outbuf, &stats);
+
+  release_job_input (job);
+  dev->in_flight--;
+
+  atrans->job_head = (atrans->job_head + 1) % atrans->num_out_bufs;
+  atrans->job_count--;
+
+  if (G_UNLIKELY (atrans->consecutive_faults > 0)) {
+    GST_OBJECT_LOCK (atrans);
+    atrans->consecutive_faults = 0;
+    GST_OBJECT_UNLOCK (atrans);
+  }
+
+  return GST_FLOW_OK;
+
+failed:
+  return GST_ACCEL_FLOW_DEVICE_ERROR;
+}
+
+
+/* complete the oldest frame into a buffer of our own, it goes out ahead
+ * of the current one. params go to the pool, NULL waits for a buffer. */
+static GstFlowReturn
+push_oldest_job (GstAccelTransform *atrans, GstBufferPoolAcquireParams *params)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM_CAST (atrans);
+  GstBufferPool *pool;
+  GstBuffer *outbuf = NULL;
+  GstFlowReturn res;
+
+  pool = gst_base_transform_get_buffer_pool (trans);
+  if (pool) {
+    res = gst_buffer_pool_acquire_buffer (pool, &outbuf, params);
+    gst_object_unref (pool);
+    if (res != GST_FLOW_OK)
+      return res;
+  }
+  else {
+    outbuf = gst_buffer_new_allocate (NULL, atrans->out_info.size, NULL);
+  }
+
+  res = complete_job (atrans, outbuf);
+  if (res != GST_FLOW_OK) {
+    gst_buffer_unref (outbuf);
+    return res;
+  }
+
+  remember_output (atrans, outbuf);
+  g_queue_push_tail (&atrans->ready, outbuf);
+  return GST_FLOW_OK;
+}
+
+
+/*
+ * Queue the frames the workers converted, in order, waiting while more
+ * than keep are in flight. The current frame's output, once done, is
+ * left for the base class to push: GST_FLOW_OK then, QUEUED when it is
+ * still being converted.
+ */
+static GstFlowReturn
+push_converted (GstAccelTransform *atrans, guint keep, GstBuffer *current)
+{
+  GstBuffer *outbuf;
+  guint n;
+
+  while ((n = gst_accel_workers_in_flight (atrans->workers)) > 0) {
+    outbuf = gst_accel_workers_collect (atrans->workers, n > keep);
+    if (outbuf == NULL)
+      break;
+
+    /* the newest, nothing is left behind it */
+    if (outbuf == current) {
+      gst_buffer_unref (outbuf);
+      analyse_output (atrans, current);
+      return GST_FLOW_OK;
+    }
+
+    analyse_output (atrans, outbuf);
+    remember_output (atrans, outbuf);
+    g_queue_push_tail (&atrans->ready, outbuf);
+  }
 
-static cmem_buf out_cbuf[OUTPUT_BUF_QUEUE_NUM];
+  return GST_ACCEL_FLOW_QUEUED;
+}
 
 
-static gboolean
-get_v4l2_fmt (const GstVideoInfo *vinfo, uint32_t *fourcc, enum v4l2_colorspace *clrspc)
+/* push the outputs done outside of an input's streaming, the rest are
+ * dropped once downstream fails */
+static void
+push_ready (GstAccelTransform *atrans)
 {
-  gboolean ret = TRUE;
-  GstVideoFormat gfmt = GST_VIDEO_INFO_FORMAT(vinfo);
+  GstBuffer *outbuf;
+  GstFlowReturn res = GST_FLOW_OK;
 
-  if (GST_VIDEO_INFO_IS_YUV(vinfo)) {
-    if (gfmt == GST_VIDEO_FORMAT_YUY2)
-      *fourcc = V4L2_PIX_FMT_YUYV;
+  while ((outbuf = g_queue_pop_head (&atrans->ready)) != NULL) {
+    if (res == GST_FLOW_OK)
+      res = gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (atrans), outbuf);
     else
-      *fourcc = gst_video_format_to_fourcc(gfmt);
-
-    *clrspc = V4L2_COLORSPACE_SMPTE170M;
+      gst_buffer_unref (outbuf);
   }
-  else {
-    switch (gfmt) {
-    case GST_VIDEO_FORMAT_RGB:
-      *fourcc = V4L2_PIX_FMT_RGB24;
-      break;
-
-    case GST_VIDEO_FORMAT_BGR:
-      *fourcc = V4L2_PIX_FMT_BGR24;
-      break;
+  if (res != GST_FLOW_OK)
+    GST_DEBUG_OBJECT (atrans, "drain stopped: %s", gst_flow_get_name (res));
+  atrans->out_dropped = FALSE;
+}
 
-    case GST_VIDEO_FORMAT_ARGB:
-    case GST_VIDEO_FORMAT_xRGB:
-      *fourcc = V4L2_PIX_FMT_RGB32;
-      break;
 
-    case GST_VIDEO_FORMAT_ABGR:
-    case GST_VIDEO_FORMAT_xBGR:
-      *fourcc = V4L2_PIX_FMT_BGR32;
-      break;
+/* push every in-flight frame downstream */
+static void
+drain_jobs (GstAccelTransform *atrans)
+{
+  GstFlowReturn res;
 
-    default:
-      ret = FALSE;
-      goto end;
+  if (atrans->workers) {
+    res = push_converted (atrans, 0, NULL);
+    if (res != GST_ACCEL_FLOW_QUEUED) {
+      GST_DEBUG_OBJECT (atrans, "drain stopped: %s", gst_flow_get_name (res));
+      (void)gst_accel_workers_flush (atrans->workers);
     }
-
-    *clrspc = V4L2_COLORSPACE_SRGB;
+    push_ready (atrans);
+    return;
   }
 
-end:
-  return ret;
+  while (atrans->job_count > 0) {
+    res = push_oldest_job (atrans, NULL);
+    if (res == GST_ACCEL_FLOW_DEVICE_ERROR) {
+      (void)recover_device (atrans);
+      break;
+    }
+    if (res != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (atrans, "drain stopped: %s", gst_flow_get_name (res));
+      flush_jobs (atrans);
+      break;
+    }
+  }
+  push_ready (atrans);
 }
 
 
-static gboolean
-init_device (GstAccelTransform *atrans)
+/* clamp one side of the output rectangle to the frame and the device */
+static void
+clamp_out_span (gint *start, gint *length, gint size)
 {
-  gint fd, ret, i;
-  gint width, height, max_num;
-  uint32_t fourcc = 0;
-  enum v4l2_colorspace clrspc = 0;
-  uint32_t *sizeimage;
-  const GstVideoInfo *vinfo;
-  const gchar *devname = DEFAULT_DEVICE_NAME;
+  *start &= ~1;
+  *length = MAX (*length & ~1, MIN (VPE_MIN_SIZE, size));
+  *length = MIN (*length, size);
+  *start = MIN (*start, size - *length);
+}
 
-  if (atrans->device_name)
-    devname = atrans->device_name;
 
-  fd = open(devname, O_RDWR);
-  if (fd < 0) {
-    GST_ERROR_OBJECT (atrans, "open %s failed: %s", devname, strerror(errno));
-    goto err_end;
+/* where the crop rectangle r lands in the output: at the scale of the
+ * whole frame when a crop meta tells downstream, or over all of it */
+static void
+get_out_rect (GstAccelTransform *atrans, const struct v4l2_rect *r,
+    struct v4l2_rect *o)
+{
+  gint in_w, in_h, out_w, out_h, left, top, width, height;
+
+  in_w = GST_VIDEO_INFO_WIDTH (&atrans->in_info);
+  in_h = GST_VIDEO_INFO_HEIGHT (&atrans->in_info);
+  out_w = GST_VIDEO_INFO_WIDTH (&atrans->hw_out_info);
+  out_h = GST_VIDEO_INFO_HEIGHT (&atrans->hw_out_info);
+
+  if (!atrans->crop_meta) {
+    o->left = 0;
+    o->top = 0;
+    o->width = out_w;
+    o->height = out_h;
+    return;
   }
 
-  sizeimage = &atrans->v4l2_in_size;
-  vinfo = &atrans->in_info;
-  max_num = CMEM_POOL_MAX_BUF_NUM; /* all input buffers are allocated with cmem allocator */
+  left = (gint64)r->left * out_w / in_w;
+  top = (gint64)r->top * out_h / in_h;
+  width = (gint64)r->width * out_w / in_w;
+  height = (gint64)r->height * out_h / in_h;
+  clamp_out_span (&left, &width, out_w);
+  clamp_out_span (&top, &height, out_h);
+
+  o->left = left;
+  o->top = top;
+  o->width = width;
+  o->height = height;
+}
 
-  for (i = 0; i < 2; i++) {
-    /* input/output buffer settings */
 
-    ret = get_v4l2_fmt (vinfo, &fourcc, &clrspc);
-    if (ret < 0) {
-      GST_ERROR_OBJECT (atrans, "color format is incompatible(index:%d)", i);
-      goto err_close;
-    }
+/* grow one side of the crop rectangle so that passes of up to scale
+ * each reach the output span, it stays inside the frame */
+static void
+clamp_crop_span (gint *start, guint *length, gint out_length, gint size,
+    gint scale)
+{
+  gint min = GST_ROUND_UP_2 ((out_length + scale - 1) / scale);
 
-    width = GST_VIDEO_INFO_WIDTH (vinfo);
-    height = GST_VIDEO_INFO_HEIGHT (vinfo);
+  if ((gint)*length >= min)
+    return;
+  *length = MIN (min, size);
+  *start = MIN (*start, size - (gint)*length) & ~1;
+}
 
-    ret = v4l2_request_buffer (fd, width, height, fourcc, clrspc, max_num, (i == 0), sizeimage);
-    if (ret < 0) {
-      GST_ERROR_OBJECT (atrans, "buffer initialize failed(input:%s)", (i == 0 ? "yes" : "no"));
-      goto err_close;
-    }
 
-    /* XXX: */
-	/* assert (GST_VIDEO_INFO_SIZE (vinfo) == *sizeimage); */
+/* the strips are one pass each, the other frames take the earlier
+ * passes too */
+static void
+clamp_crop_scale (GstAccelTransform *atrans, struct v4l2_rect *r,
+    const struct v4l2_rect *o)
+{
+  gint scale = VPE_MAX_UPSCALE;
+  guint i;
 
-    sizeimage = &atrans->v4l2_out_size;
-    vinfo = &atrans->out_info;
-    max_num = OUTPUT_BUF_QUEUE_NUM;
+  if (!atrans->tiled) {
+    for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_PREPASSES; i++)
+      scale *= VPE_MAX_UPSCALE;
   }
 
-  atrans->devfd = fd;
-  return TRUE;
-
-err_close:
-  close (fd);
-err_end:
-  return FALSE;
+  clamp_crop_span (&r->left, &r->width, o->width,
+      GST_VIDEO_INFO_WIDTH (&atrans->in_info), scale);
+  clamp_crop_span (&r->top, &r->height, o->height,
+      GST_VIDEO_INFO_HEIGHT (&atrans->in_info), scale);
 }
 
 
+/*
+ * The crop is scaled on the first pass, so the passes follow its size.
+ * When they change, the sessions of the earlier passes, the formats and
+ * the buffers are set up again; nothing is queued between frames.
+ */
 static gboolean
-wrap_queue_buffer (GstAccelTransform *atrans,
-    gint index, gint dma_fd, void *buf, gsize size, gboolean is_input)
+replan_passes (GstAccelTransform *atrans, const struct v4l2_rect *r,
+    const struct v4l2_rect *o)
 {
-  gboolean bret = TRUE;
-  gint ret, op;
-  uint32_t sizeimage;
+  GstVideoInfo planned[GST_ACCEL_TRANSFORM_MAX_PREPASSES];
+  const gchar *devname = atrans->devices[0].name;
+  guint i, n = atrans->num_prepasses;
 
-  if (is_input) {
-    /* flush cache for device read after cpu write */
-    op = CMEM_CACHE_FLUSH;
-    sizeimage = atrans->v4l2_in_size;
-  }
-  else {
-    /* invalidate cache for next cpu read after device write */
-    op = CMEM_CACHE_INVALIDATE;
-    sizeimage = atrans->v4l2_out_size;
+  memcpy (planned, atrans->prepass_info, sizeof (planned));
+  if (!plan_passes (atrans, r, o))
+    return FALSE;
+
+  for (i = 0; i < n && atrans->num_prepasses == n; i++) {
+    if (!gst_video_info_is_equal (&planned[i], &atrans->prepass_info[i]))
+      break;
   }
+  if (i == n && atrans->num_prepasses == n)
+    return TRUE;
 
-  ret = cmem_do_cache_operation (buf, size, op);
-  if (ret < 0)
-    GST_WARNING_OBJECT (atrans, "cache operation(%d) failed", op);
+  GST_DEBUG_OBJECT (atrans, "%u scale pass(es) for the crop, were %u",
+      atrans->num_prepasses, n);
 
-  /* queue buffer */
-  ret = v4l2_queue_buffer (atrans->devfd, index, dma_fd, sizeimage, (int)is_input);
-  if (ret < 0) {
-    GST_ERROR_OBJECT (atrans, "queue buffer failed(dma_fd:%d/input:%d)", dma_fd, (int)is_input);
-    bret = FALSE;
+  /* the buffers of the passes before are freed with their count */
+  i = atrans->num_prepasses;
+  atrans->num_prepasses = n;
+  free_output_buffers (atrans);
+  atrans->num_prepasses = i;
+
+  for (i = atrans->num_prepasses; i < n; i++) {
+    vpeconv_close (atrans->prepass[i]);
+    atrans->prepass[i] = NULL;
+  }
+  for (i = n; i < atrans->num_prepasses; i++) {
+    atrans->prepass[i] = vpeconv_open (devname);
+    if (atrans->prepass[i] == NULL) {
+      GST_ERROR_OBJECT (atrans, "open %s failed: %s", devname,
+          strerror (errno));
+      atrans->num_prepasses = i;
+      return FALSE;
+    }
   }
 
-  return bret;
+  return configure_passes (atrans) && alloc_output_buffers (atrans);
 }
 
 
-static gboolean setup_device (GstAccelTransform *atrans)
+/* move the device to this frame's crop rectangle */
+static GstFlowReturn
+update_crop (GstAccelTransform *atrans, GstBuffer *inbuf)
 {
-  gint ret, fd, i;
-  gboolean bret;
-  gsize size;
-  void *buf;
-  GstMemory *mem;
-
-  if (!init_device (atrans))
-    return FALSE;
+  GstFlowReturn res;
+  struct v4l2_rect r, o;
+  vpeconv_session *session;
+  guint i;
+
+  get_crop_rect (atrans, inbuf, &r);
+  get_out_rect (atrans, &r, &o);
+  clamp_crop_scale (atrans, &r, &o);
+  if (r.left == atrans->cur_crop.left && r.top == atrans->cur_crop.top &&
+      r.width == atrans->cur_crop.width && r.height == atrans->cur_crop.height)
+    return GST_FLOW_OK;
 
-  /* setup input work buffer */
-  size = atrans->in_info.size;
-  atrans->allocator = g_object_new (GST_TYPE_CMEM_MEMORY_ALLOCATOR, NULL);
-  mem = gst_allocator_alloc (atrans->allocator, size, NULL);
-  if (mem == NULL) {
-    GST_ERROR_OBJECT (atrans, "gst_allocator_alloc failed");
-    goto failed;
+  /* queued jobs would pick up the new rectangle, finish them first */
+  while (atrans->job_count > 0) {
+    res = push_oldest_job (atrans, NULL);
+    if (res != GST_FLOW_OK)
+      return res;
   }
 
-  atrans->work_mem = mem;
-
-  /* setup output buffer */
-  size = atrans->out_info.size;
-  for (i = 0; i < OUTPUT_BUF_QUEUE_NUM; i++) {
-    fd = alloc_cmem_buffer (size, 1, &buf);
-    if (fd < 0) {
-      GST_ERROR_OBJECT (atrans, "alloc cmem failed(ret:%d)", fd);
-      goto failed;
+  GST_DEBUG_OBJECT (atrans, "crop %dx%d+%d+%d to %dx%d+%d+%d", r.width,
+      r.height, r.left, r.top, o.width, o.height, o.left, o.top);
+
+  /* the strips follow the crop, with formats of their own */
+  if (atrans->tiled) {
+    if (!configure_strips (atrans, &r, &o))
+      return GST_ACCEL_FLOW_DEVICE_ERROR;
+    if (atrans->strip_out_size > atrans->out_cbuf_size) {
+      free_output_buffers (atrans);
+      if (!alloc_output_buffers (atrans)) {
+        GST_ELEMENT_ERROR (atrans, RESOURCE, NO_SPACE_LEFT,
+            ("Could not allocate the intermediate of the strips"), (NULL));
+        return GST_FLOW_ERROR;
+      }
     }
-
-    /* queue output buffer */
-    bret = wrap_queue_buffer (atrans, i, fd, buf, size, FALSE);
-    if (!bret) {
-      GST_ERROR_OBJECT (atrans, "queue buffer failed");
-      goto failed;
+  }
+  else {
+    if (!replan_passes (atrans, &r, &o)) {
+      GST_ELEMENT_ERROR (atrans, RESOURCE, FAILED,
+          ("Could not set up the scale passes of the crop"), (NULL));
+      return GST_FLOW_ERROR;
     }
 
-    out_cbuf[i].fd = fd;
-    out_cbuf[i].buf = buf;
-  }
+    /* the first pass reads the input, on any device without earlier ones */
+    for (i = 0; i < (atrans->num_prepasses ? 1 : atrans->num_devices); i++) {
+      session = atrans->num_prepasses ?
+          atrans->prepass[0] : atrans->devices[i].session;
+      if (vpeconv_set_crop (session, r.left, r.top, r.width, r.height) < 0) {
+        GST_WARNING_OBJECT (atrans, "set crop failed");
+        return GST_ACCEL_FLOW_DEVICE_ERROR;
+      }
+    }
 
-  ret = v4l2_stream_on (atrans->devfd, 0);
-  if (ret < 0) {
-    GST_ERROR_OBJECT (atrans, "output stream start failed");
-    goto failed;
+    /* the last one writes the output */
+    for (i = 0; i < atrans->num_devices; i++) {
+      if (vpeconv_set_compose (atrans->devices[i].session, o.left, o.top,
+              o.width, o.height) < 0) {
+        GST_WARNING_OBJECT (atrans, "set compose failed");
+        return GST_ACCEL_FLOW_DEVICE_ERROR;
+      }
+    }
   }
 
-  return TRUE;
+  atrans->cur_crop = r;
+  atrans->out_rect = o;
+  atrans->crop_active =
+      (r.width != GST_VIDEO_INFO_WIDTH (&atrans->in_info) ||
+       r.height != GST_VIDEO_INFO_HEIGHT (&atrans->in_info));
 
-failed:
-  /* XXX: omit cleanup */
-  return FALSE;
+  return GST_FLOW_OK;
 }
 
 
-static void cleanup_device (GstAccelTransform *atrans)
+static GstFlowReturn
+process_frame (GstAccelTransform *atrans, GstBuffer *inbuf, GstBuffer *outbuf)
 {
-  int i;
+  GstFlowReturn res;
+  guint depth;
 
-  if (atrans->input_start) {
-    (void)v4l2_stream_off (atrans->devfd, 1);
-    atrans->input_start = FALSE;
+  depth = get_queue_depth (atrans);
+
+  /* the depth may have been lowered since the last frame */
+  while (atrans->job_count >= depth) {
+    res = push_oldest_job (atrans, NULL);
+    if (res != GST_FLOW_OK)
+      return res;
   }
 
-  (void)v4l2_stream_off (atrans->devfd, 0);
+  res = update_crop (atrans, inbuf);
+  if (res != GST_FLOW_OK)
+    return res;
 
-  for (i = 0; i < OUTPUT_BUF_QUEUE_NUM; i++) {
-    free_cmem_buffer (out_cbuf[i].buf);
-  }
+  /* this frame completes into outbuf when it is the only one queued */
+  res = submit_job (atrans, inbuf,
+      (depth == 1 && atrans->job_count == 0) ? outbuf : NULL);
+  if (res != GST_FLOW_OK)
+    return res;
 
-  close (atrans->devfd);
-  atrans->devfd = -1;
+  /* keep the queue filled, this output will follow a later input */
+  if (atrans->job_count < depth)
+    return GST_ACCEL_FLOW_QUEUED;
+
+  return complete_job (atrans, outbuf);
 }
 
 
 static GstFlowReturn
-hwtransform (GstAccelTransform *atrans, const void *in, void *out, gboolean input_is_cmem)
+hwtransform (GstAccelTransform *atrans, GstBuffer *inbuf, GstBuffer *outbuf)
 {
-  gint ret, index;
-  gboolean bret;
-  const GstCMemMemory *cmem;
+  GstFlowReturn res;
+
+  res = process_frame (atrans, inbuf, outbuf);
+  if (G_LIKELY (res != GST_ACCEL_FLOW_DEVICE_ERROR))
+    return res;
+
+  if (!recover_device (atrans))
+    return GST_FLOW_ERROR;
+
+  /* this frame was in flight when the device was reset */
+  return GST_BASE_TRANSFORM_FLOW_DROPPED;
+}
+
 
-  if (input_is_cmem) {
-    cmem = (GstCMemMemory *)in;
+/*
+ * The frame goes to the next free worker, written straight into outbuf.
+ * With all of them busy this waits for the oldest frame, which is pushed
+ * first; up to depth - 1 frames stay in flight between calls.
+ */
+static GstFlowReturn
+cputransform (GstAccelTransform *atrans, GstBuffer *inbuf, GstBuffer *outbuf)
+{
+  GstFlowReturn res;
+  struct v4l2_rect r, o;
+
+  get_crop_rect (atrans, inbuf, &r);
+  if (r.left != atrans->cur_crop.left || r.top != atrans->cur_crop.top ||
+      r.width != atrans->cur_crop.width || r.height != atrans->cur_crop.height) {
+    /* the converters can only change between frames */
+    res = push_converted (atrans, 0, NULL);
+    if (res != GST_ACCEL_FLOW_QUEUED)
+      return res;
+
+    /* written where the device would, at the scale of the whole frame */
+    get_out_rect (atrans, &r, &o);
+    GST_DEBUG_OBJECT (atrans, "crop %dx%d+%d+%d to %dx%d+%d+%d", r.width,
+        r.height, r.left, r.top, o.width, o.height, o.left, o.top);
+    if (!gst_accel_workers_set_crop (atrans->workers, r.left, r.top, r.width,
+            r.height, o.left, o.top, o.width, o.height)) {
+      GST_ELEMENT_ERROR (atrans, CORE, NEGOTIATION, (NULL),
+          ("could not set up the conversion of the crop"));
+      return GST_FLOW_ERROR;
+    }
+    atrans->cur_crop = r;
+    atrans->out_rect = o;
+    atrans->crop_active =
+        (r.width != GST_VIDEO_INFO_WIDTH (&atrans->in_info) ||
+         r.height != GST_VIDEO_INFO_HEIGHT (&atrans->in_info));
   }
-  else {
-    cmem = (GstCMemMemory *)atrans->work_mem;
-    memcpy (cmem->data, in, atrans->in_info.size);
+  set_crop_meta (atrans, outbuf);
+
+  if (!gst_accel_workers_submit (atrans->workers, inbuf, outbuf)) {
+    GST_ELEMENT_ERROR (atrans, RESOURCE, FAILED, (NULL),
+        ("could not map the frame for conversion"));
+    return GST_FLOW_ERROR;
   }
 
-  /* queue input buffer */
-  bret = wrap_queue_buffer (atrans,
-      cmem->index, cmem->fd, cmem->data, GST_MEMORY_CAST (cmem)->size, TRUE);
-  if (!bret) {
-    GST_ERROR_OBJECT (atrans, "queue input buffer failed");
-    goto failed;
+  return push_converted (atrans, get_queue_depth (atrans) - 1, outbuf);
+}
+
+
+/*
+ * Give the CMEM buffers back while the stream is idle so other pipelines
+ * can use them. The session keeps the device open with its formats set,
+ * it requests the slots again on the next submit.
+ */
+static void
+release_resources (GstAccelTransform *atrans, gboolean drain)
+{
+  GstBufferPoolAcquireParams params = { 0, };
+  GstBufferPool *pool;
+  GstFlowReturn res;
+  gsize released;
+  gint i;
+
+  if (drain)
+    drain_jobs (atrans);
+
+  /* pushing them would block in preroll while paused: they are finished
+   * into buffers of our own and go out ahead of the next frame. With
+   * none free in the pool they stay queued until the next check. */
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+  while (atrans->job_count > 0) {
+    res = push_oldest_job (atrans, &params);
+    if (res == GST_ACCEL_FLOW_DEVICE_ERROR) {
+      if (!recover_device (atrans))
+        return;
+      break;
+    }
+    if (res != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (atrans, "frames still queued, not released: %s",
+          gst_flow_get_name (res));
+      return;
+    }
   }
 
-  if (G_UNLIKELY (!atrans->input_start)) {
-    ret = v4l2_stream_on (atrans->devfd, 1);
-    if (ret < 0) {
-      GST_ERROR_OBJECT (atrans, "input stream start failed");
-      goto failed;
+  /* drop the device's references to our dmabufs */
+  for (i = 0; i < atrans->num_prepasses; i++)
+    (void)vpeconv_release (atrans->prepass[i]);
+  for (i = 0; i < atrans->num_devices; i++)
+    (void)vpeconv_release (atrans->devices[i].session);
+  for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_STRIPS - 1; i++) {
+    if (atrans->strip_session[i])
+      (void)vpeconv_release (atrans->strip_session[i]);
+  }
+  release_jobs (atrans);
+
+  free_output_buffers (atrans);
+
+  for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH; i++) {
+    if (atrans->work_mem[i]) {
+      gst_memory_unref (atrans->work_mem[i]);
+      atrans->work_mem[i] = NULL;
     }
+  }
 
-    atrans->input_start = TRUE;
+  /* the pools on either side keep only their minimum */
+  GST_OBJECT_LOCK (atrans);
+  pool = atrans->in_pool ? gst_object_ref (atrans->in_pool) : NULL;
+  GST_OBJECT_UNLOCK (atrans);
+  if (pool) {
+    gst_cmem_buffer_pool_trim (pool);
+    gst_object_unref (pool);
   }
 
-  /* wait for output */
-  ret = v4l2_dequeue_buffer (atrans->devfd, 0);
-  if (ret < 0) {
-    GST_ERROR_OBJECT (atrans, "dequeue buffer failed");
-    goto failed;
+  pool = gst_base_transform_get_buffer_pool (GST_BASE_TRANSFORM_CAST (atrans));
+  if (pool) {
+    if (GST_IS_CMEM_BUFFER_POOL (pool))
+      gst_cmem_buffer_pool_trim (pool);
+    gst_object_unref (pool);
   }
 
-  /* XXX: */
-  /* assert (ret < OUTPUT_BUF_QUEUE_NUM); */
+  released = cmem_consumer_trim (
+      gst_cmem_memory_allocator_get_consumer (atrans->allocator));
 
-  index = ret;
-  memcpy (out, out_cbuf[index].buf, atrans->out_info.size);
+  atrans->released = TRUE;
+  GST_INFO_OBJECT (atrans, "idle, released %" G_GSIZE_FORMAT " bytes", released);
+}
 
-  /* dequeue input buffer */
-  ret = v4l2_dequeue_buffer (atrans->devfd, 1);
-  if (ret < 0) {
-    GST_ERROR_OBJECT (atrans, "dequeue buffer failed");
-    goto failed;
-  }
 
-  /* XXX: */
-  /* assert (ret == cmem->index); */
+/* take back what release_resources gave away */
+static gboolean
+resume_device (GstAccelTransform *atrans)
+{
+  if (!alloc_output_buffers (atrans))
+    return FALSE;
+
+  /* requesting the slots sets the formats again, which resets the crop */
+  atrans->cur_crop.width = 0;
+  atrans->crop_active = FALSE;
 
-  /* queue output buffer */
-  bret = wrap_queue_buffer (atrans,
-      index, out_cbuf[index].fd, out_cbuf[index].buf, atrans->out_info.size, FALSE);
-  if (!bret) {
-    GST_ERROR_OBJECT (atrans, "queue output buffer failed");
-    goto failed;
+  atrans->released = FALSE;
+  GST_INFO_OBJECT (atrans, "resumed");
+
+  return TRUE;
+}
+
+
+/* runs on the clock thread, periodically while the element is started */
+static gboolean
+idle_check (GstClock * clock, GstClockTime time, GstClockID id,
+    gpointer user_data)
+{
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (user_data);
+  GstPad *sinkpad = GST_BASE_TRANSFORM_SINK_PAD (atrans);
+  gboolean paused, idle;
+  GstClockTime timeout;
+  gint activity;
+
+  activity = g_atomic_int_get (&atrans->activity);
+  if (activity != atrans->idle_activity ||
+      !GST_CLOCK_TIME_IS_VALID (atrans->idle_since)) {
+    atrans->idle_activity = activity;
+    atrans->idle_since = time;
   }
 
-  return GST_FLOW_OK;
+  GST_OBJECT_LOCK (atrans);
+  paused = atrans->release_on_pause &&
+      GST_STATE (atrans) == GST_STATE_PAUSED &&
+      GST_STATE_PENDING (atrans) == GST_STATE_VOID_PENDING;
+  timeout = atrans->idle_timeout * GST_MSECOND;
+  GST_OBJECT_UNLOCK (atrans);
 
-failed:
-  /* XXX: omit cleanup */
-  return GST_FLOW_ERROR;
+  idle = timeout > 0 && time - atrans->idle_since >= timeout;
+  if (!paused && !idle)
+    return TRUE;
+
+  /* a frame being converted holds the stream lock, try again next time */
+  if (!GST_PAD_STREAM_TRYLOCK (sinkpad))
+    return TRUE;
+
+  if (atrans->negotiated && !atrans->released && atrans->num_devices > 0)
+    release_resources (atrans, !paused);
+
+  GST_PAD_STREAM_UNLOCK (sinkpad);
+
+  return TRUE;
 }
 
 
 /* the capabilities of the inputs and outputs.
  *
- * describe the real formats here.
+ * Anything the CPU path converts, so autoplugging never fails on us. What
+ * the device takes is probed, see transform_caps.
  */
 static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("NV12")
-        ";" GST_VIDEO_CAPS_MAKE ("UYVY")
-        ";" GST_VIDEO_CAPS_MAKE ("YUYV")
-        ";" GST_VIDEO_CAPS_MAKE ("YUY2"))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL))
     );
 
 static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("NV12")
-        ";" GST_VIDEO_CAPS_MAKE ("UYVY")
-        ";" GST_VIDEO_CAPS_MAKE ("YUYV")
-        ";" GST_VIDEO_CAPS_MAKE ("YUY2")
-        ";" GST_VIDEO_CAPS_MAKE ("ARGB")
-        ";" GST_VIDEO_CAPS_MAKE ("xRGB")
-        ";" GST_VIDEO_CAPS_MAKE ("ABGR")
-        ";" GST_VIDEO_CAPS_MAKE ("xBGR")
-        ";" GST_VIDEO_CAPS_MAKE ("RGB")
-        ";" GST_VIDEO_CAPS_MAKE ("BGR"))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL))
     );
 
 
@@ -380,9 +2792,49 @@ static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
 G_DEFINE_TYPE (GstAccelTransform, gst_acceltransform, GST_TYPE_BASE_TRANSFORM);
 
 
-/* copies the given caps */
+/* widen a size field to everything the chained passes can reach from it */
+static void
+set_scale_range (GstStructure *st, const gchar *field, gint max_dim)
+{
+  const GValue *val;
+  gint lo, hi, factor, i;
+
+  val = gst_structure_get_value (st, field);
+  if (val == NULL)
+    return;
+
+  if (G_VALUE_HOLDS_INT (val)) {
+    lo = hi = g_value_get_int (val);
+  }
+  else if (GST_VALUE_HOLDS_INT_RANGE (val)) {
+    lo = gst_value_get_int_range_min (val);
+    hi = gst_value_get_int_range_max (val);
+  }
+  else {
+    return;
+  }
+
+  factor = 1;
+  for (i = 0; i <= GST_ACCEL_TRANSFORM_MAX_PREPASSES; i++)
+    factor *= VPE_MAX_DOWNSCALE;
+  lo = MAX (VPE_MIN_SIZE, lo / factor);
+
+  factor = 1;
+  for (i = 0; i <= GST_ACCEL_TRANSFORM_MAX_PREPASSES; i++)
+    factor *= VPE_MAX_UPSCALE;
+  hi = hi > max_dim / factor ? max_dim : hi * factor;
+
+  if (lo < hi)
+    gst_structure_set (st, field, GST_TYPE_INT_RANGE, lo, hi, NULL);
+  else
+    gst_structure_set (st, field, G_TYPE_INT, MIN (lo, max_dim), NULL);
+}
+
+
+/* copies the given caps, any format and the sizes the device scales to
+ * or, for the CPU, any size */
 static GstCaps *
-gst_acceltrans_caps_remove_format_info (GstCaps * caps)
+gst_acceltrans_caps_remove_format_info (GstCaps * caps, gboolean device)
 {
   GstStructure *st;
   GstCapsFeatures *f;
@@ -405,9 +2857,18 @@ gst_acceltrans_caps_remove_format_info (GstCaps * caps)
     /* Only remove format info for the cases when we can actually convert */
     if (!gst_caps_features_is_any (f)
         && gst_caps_features_is_equal (f,
-            GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY))
+            GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY)) {
       gst_structure_remove_fields (st, "format", "colorimetry", "chroma-site",
           NULL);
+      if (device) {
+        set_scale_range (st, "width", STRIP_MAX_WIDTH);
+        set_scale_range (st, "height", VPE_MAX_HEIGHT);
+      }
+      else {
+        gst_structure_set (st, "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+            "height", GST_TYPE_INT_RANGE, 1, G_MAXINT, NULL);
+      }
+    }
 
     gst_caps_append_structure_full (res, st, gst_caps_features_copy (f));
   }
@@ -425,6 +2886,7 @@ gst_acceltrans_propose_allocation (GstBaseTransform * trans,
   GstBufferPool *pool;
   GstStructure *config;
   GstCaps *caps;
+  GstAllocationParams params;
   guint size;
   gboolean need_pool;
 
@@ -433,42 +2895,264 @@ gst_acceltrans_propose_allocation (GstBaseTransform * trans,
   if (caps == NULL)
     goto invalid_caps;
 
-  if (need_pool) {
-    GstVideoInfo info;
+  if (need_pool) {
+    GstVideoInfo info;
+
+    if (!gst_video_info_from_caps (&info, caps))
+      goto invalid_caps;
+
+    /* the workers read any system memory */
+    if (atrans->workers)
+      pool = gst_video_buffer_pool_new ();
+    else
+      pool = gst_cmem_buffer_pool_new ();
+
+    /* the normal size of a frame, strips read a line past it */
+    size = info.size;
+    if (atrans->tiled)
+      size += GST_VIDEO_INFO_PLANE_STRIDE (&info, 0);
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, size, CMEM_POOL_MIN_BUF_NUM, CMEM_POOL_MAX_BUF_NUM);
+    if (!gst_buffer_pool_set_config (pool, config))
+      goto config_failed;
+
+    gst_query_add_allocation_pool (query, pool, size, CMEM_POOL_MIN_BUF_NUM, CMEM_POOL_MAX_BUF_NUM);
+
+    /* kept to be trimmed while idle */
+    GST_OBJECT_LOCK (atrans);
+    if (atrans->in_pool)
+      gst_object_unref (atrans->in_pool);
+    atrans->in_pool = atrans->workers ? NULL : pool;
+    GST_OBJECT_UNLOCK (atrans);
+    if (atrans->workers)
+      gst_object_unref (pool);
+  }
+
+  /* cropping is done by the device, upstream need not copy */
+  gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, NULL);
+
+  /* what upstream allocates itself can then be read in place */
+  gst_allocation_params_init (&params);
+  params.align = VPE_DMA_ALIGN - 1;
+  gst_query_add_allocation_param (query, NULL, &params);
+
+  return TRUE;
+
+  /* ERRORS */
+invalid_caps:
+  {
+    GST_ERROR_OBJECT (atrans, "invalid caps");
+    atrans->negotiated = FALSE;
+    return FALSE;
+  }
+
+config_failed:
+  {
+    GST_WARNING_OBJECT (atrans, "failed setting config");
+    gst_object_unref (pool);
+    atrans->negotiated = FALSE;
+    return FALSE;
+  }
+}
+
+
+/* weights of the output format cost model */
+#define COST_PER_BYTE 16    /* per output byte per pixel, copied out and invalidated */
+#define COST_UNALIGNED 16   /* 3-byte pixels copy slowly and sinks tend to convert them */
+#define COST_NOT_NATIVE 32  /* the VPE can't write it, converted on the copy out */
+#define COST_PER_RANK 4     /* per step down downstream's preference order */
+
+/* relative cost of producing the output in fmt, lower is cheaper */
+static gint
+get_format_cost (GstAccelTransform *atrans, const GstVideoInfo *in_info,
+    GstVideoFormat fmt, guint rank)
+{
+  GstVideoInfo info;
+  uint32_t fourcc;
+  enum v4l2_colorspace clrspc;
+  gint bytes, cost;
+  gboolean native, unaligned;
+
+  gst_video_info_init (&info);
+  gst_video_info_set_format (&info, fmt, GST_VIDEO_INFO_WIDTH (in_info),
+      GST_VIDEO_INFO_HEIGHT (in_info));
+
+  /* bytes per pixel, in 1/COST_PER_BYTE units */
+  bytes = (gint)(info.size * COST_PER_BYTE /
+      MAX (1, GST_VIDEO_INFO_WIDTH (in_info) * GST_VIDEO_INFO_HEIGHT (in_info)));
+  native = !gst_accel_fixup_get_native (fmt, NULL) &&
+      get_v4l2_fmt (&info, &fourcc, &clrspc);
+  unaligned = (GST_VIDEO_INFO_N_PLANES (&info) == 1 &&
+      GST_VIDEO_INFO_COMP_PSTRIDE (&info, 0) == 3);
+
+  cost = bytes + rank * COST_PER_RANK;
+  if (!native)
+    cost += COST_NOT_NATIVE;
+  if (unaligned)
+    cost += COST_UNALIGNED;
+
+  GST_DEBUG_OBJECT (atrans, "%s: %d/%d bytes/pixel, %snative%s, rank %u -> "
+      "cost %d", gst_video_format_to_string (fmt), bytes, COST_PER_BYTE,
+      native ? "" : "not ", unaligned ? ", 3-byte pixels" : "", rank, cost);
+
+  return cost;
+}
+
+
+/* pick the cheapest output format downstream accepts */
+static GstCaps *
+gst_acceltrans_fixate_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
+{
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
+  GstVideoInfo in_info;
+  GstStructure *st;
+  GstCaps *result;
+  const GValue *formats, *val;
+  const gchar *name, *best_name = NULL;
+  GstVideoFormat fmt;
+  guint i, j, n, rank = 0, best_idx = 0;
+  gint cost, best_cost = G_MAXINT;
+
+  if (direction != GST_PAD_SINK || !gst_video_info_from_caps (&in_info, caps))
+    goto fallback;
+
+  /* the input as it is needs no conversion at all */
+  if (gst_caps_can_intersect (caps, othercaps)) {
+    result = gst_caps_intersect (othercaps, caps);
+    gst_caps_unref (othercaps);
+    GST_DEBUG_OBJECT (atrans, "downstream takes the input caps");
+    return gst_caps_fixate (result);
+  }
+
+  for (i = 0; i < gst_caps_get_size (othercaps); i++) {
+    st = gst_caps_get_structure (othercaps, i);
+    formats = gst_structure_get_value (st, "format");
+    if (formats == NULL)
+      continue;
+
+    n = GST_VALUE_HOLDS_LIST (formats) ? gst_value_list_get_size (formats) : 1;
+    for (j = 0; j < n; j++, rank++) {
+      val = GST_VALUE_HOLDS_LIST (formats) ?
+          gst_value_list_get_value (formats, j) : formats;
+      if (!G_VALUE_HOLDS_STRING (val))
+        continue;
+
+      name = g_value_get_string (val);
+      fmt = gst_video_format_from_string (name);
+      if (fmt == GST_VIDEO_FORMAT_UNKNOWN)
+        continue;
+
+      cost = get_format_cost (atrans, &in_info, fmt, rank);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_name = name;
+        best_idx = i;
+      }
+    }
+  }
+
+  if (best_name == NULL)
+    goto fallback;
+
+  GST_DEBUG_OBJECT (atrans, "chose %s (cost %d)", best_name, best_cost);
+
+  st = gst_structure_copy (gst_caps_get_structure (othercaps, best_idx));
+  gst_structure_set (st, "format", G_TYPE_STRING, best_name, NULL);
+  gst_structure_fixate_field_nearest_int (st, "width",
+      GST_VIDEO_INFO_WIDTH (&in_info));
+  gst_structure_fixate_field_nearest_int (st, "height",
+      GST_VIDEO_INFO_HEIGHT (&in_info));
+  gst_structure_fixate_field_nearest_fraction (st, "framerate",
+      GST_VIDEO_INFO_FPS_N (&in_info), GST_VIDEO_INFO_FPS_D (&in_info));
 
-    if (!gst_video_info_from_caps (&info, caps))
-      goto invalid_caps;
+  result = gst_caps_new_empty ();
+  gst_caps_append_structure_full (result, st,
+      gst_caps_features_copy (gst_caps_get_features (othercaps, best_idx)));
+  gst_caps_unref (othercaps);
 
-    pool = gst_cmem_buffer_pool_new ();
+  return gst_caps_fixate (result);
 
-    /* the normal size of a frame */
-    size = info.size;
-    config = gst_buffer_pool_get_config (pool);
-    gst_buffer_pool_config_set_params (config, caps, size, CMEM_POOL_MIN_BUF_NUM, CMEM_POOL_MAX_BUF_NUM);
-    if (!gst_buffer_pool_set_config (pool, config))
-      goto config_failed;
+fallback:
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->fixate_caps (trans,
+      direction, caps, othercaps);
+}
 
-    gst_query_add_allocation_pool (query, pool, size, CMEM_POOL_MIN_BUF_NUM, CMEM_POOL_MAX_BUF_NUM);
-    gst_object_unref (pool);
+
+/* hand CMEM buffers downstream when it asks for the CMEM meta */
+static gboolean
+gst_acceltrans_decide_allocation (GstBaseTransform * trans, GstQuery * query)
+{
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  GstCaps *caps;
+  GstVideoInfo info;
+  guint size = 0, min = 0, max = 0;
+  gboolean crop_meta;
+
+  /* a crop is written in place and marked by a crop meta, or scaled to
+   * the whole output; the next frame sets it again */
+  crop_meta = gst_query_find_allocation_meta (query,
+      GST_VIDEO_CROP_META_API_TYPE, NULL);
+  if (crop_meta != atrans->crop_meta) {
+    GST_DEBUG_OBJECT (atrans, "downstream %s crop metas",
+        crop_meta ? "takes" : "doesn't take");
+    atrans->crop_meta = crop_meta;
+    atrans->cur_crop.width = 0;
   }
 
-  return TRUE;
+  if (!gst_query_find_allocation_meta (query, GST_CMEM_META_API_TYPE, NULL))
+    goto done;
 
-  /* ERRORS */
-invalid_caps:
-  {
-    GST_ERROR_OBJECT (atrans, "invalid caps");
-    atrans->negotiated = FALSE;
-    return FALSE;
+  gst_query_parse_allocation (query, &caps, NULL);
+  if (caps == NULL || !gst_video_info_from_caps (&info, caps))
+    goto done;
+
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    if (pool && GST_IS_CMEM_BUFFER_POOL (pool)) {
+      gst_object_unref (pool);
+      goto done;
+    }
+    if (pool)
+      gst_object_unref (pool);
   }
 
-config_failed:
-  {
+  pool = gst_cmem_buffer_pool_new ();
+  min = MAX (min, CMEM_POOL_MIN_BUF_NUM);
+  max = (max == 0 ? CMEM_POOL_MAX_BUF_NUM : MAX (max, min));
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, info.size, min, max);
+  if (!gst_buffer_pool_set_config (pool, config)) {
     GST_WARNING_OBJECT (atrans, "failed setting config");
     gst_object_unref (pool);
-    atrans->negotiated = FALSE;
-    return FALSE;
+    goto done;
+  }
+
+  GST_DEBUG_OBJECT (atrans, "downstream wants CMEM, using a CMEM output pool");
+
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_set_nth_allocation_pool (query, 0, pool, info.size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, info.size, min, max);
+  gst_object_unref (pool);
+
+done:
+  /* the workers hold their frames' output buffers, one each */
+  if (atrans->workers && gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    min += atrans->num_workers;
+    if (max != 0)
+      max = MAX (max + atrans->num_workers, min);
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+    if (pool)
+      gst_object_unref (pool);
   }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->decide_allocation (trans,
+      query);
 }
 
 
@@ -491,15 +3175,109 @@ gst_acceltrans_transform_size (GstBaseTransform * trans,
 }
 
 
+/* the widths a device takes in strips, from the ranges it reports */
+static GstCaps *
+widen_for_strips (GstCaps *caps)
+{
+  GstStructure *st;
+  const GValue *val;
+  guint i;
+
+  caps = gst_caps_make_writable (caps);
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    st = gst_caps_get_structure (caps, i);
+    val = gst_structure_get_value (st, "width");
+    if (val == NULL || !GST_VALUE_HOLDS_INT_RANGE (val) ||
+        gst_value_get_int_range_max (val) >= STRIP_MAX_WIDTH)
+      continue;
+    gst_structure_set (st, "width", GST_TYPE_INT_RANGE,
+        gst_value_get_int_range_min (val), STRIP_MAX_WIDTH, NULL);
+  }
+
+  return caps;
+}
+
+
+/*
+ * What every listed device takes, any frame may go to any of them, wider
+ * frames in strips. The templates only cover the VPE. FALSE when none
+ * could be probed.
+ */
+static gboolean
+probe_devices (GstAccelTransform *atrans, GstCaps **sink_caps,
+    GstCaps **src_caps)
+{
+  GstCaps *sink, *src, *tmp;
+  gchar **names;
+  guint i;
+
+  *sink_caps = *src_caps = NULL;
+
+  names = get_device_names (atrans);
+  for (i = 0; names[i] != NULL; i++) {
+    if (!gst_accel_caps_probe (g_strstrip (names[i]), &sink, &src))
+      continue;
+
+    if (*sink_caps == NULL) {
+      *sink_caps = sink;
+      *src_caps = src;
+      continue;
+    }
+
+    tmp = gst_caps_intersect (*sink_caps, sink);
+    gst_caps_unref (*sink_caps);
+    gst_caps_unref (sink);
+    *sink_caps = tmp;
+
+    tmp = gst_caps_intersect (*src_caps, src);
+    gst_caps_unref (*src_caps);
+    gst_caps_unref (src);
+    *src_caps = tmp;
+  }
+  g_strfreev (names);
+
+  if (*sink_caps == NULL)
+    return FALSE;
+
+  *sink_caps = widen_for_strips (*sink_caps);
+  *src_caps = widen_for_strips (*src_caps);
+  return TRUE;
+}
+
+
 static GstCaps *
 gst_acceltrans_transform_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * filter)
 {
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
   GstCaps *tmp, *tmp2;
   GstCaps *result;
+  GstCaps *sink_caps, *src_caps;
+
+  /* what the device converts goes first, so it is preferred */
+  if (probe_devices (atrans, &sink_caps, &src_caps)) {
+    tmp2 = gst_caps_intersect_full (caps,
+        direction == GST_PAD_SINK ? sink_caps : src_caps,
+        GST_CAPS_INTERSECT_FIRST);
+    tmp = gst_acceltrans_caps_remove_format_info (tmp2, TRUE);
+    gst_caps_unref (tmp2);
+
+    tmp2 = gst_caps_intersect_full (tmp,
+        direction == GST_PAD_SINK ? src_caps : sink_caps,
+        GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (tmp);
+    tmp = tmp2;
+
+    gst_caps_unref (sink_caps);
+    gst_caps_unref (src_caps);
+  }
+  else {
+    tmp = gst_caps_new_empty ();
+  }
 
-  /* Get all possible caps that we can transform to */
-  tmp = gst_acceltrans_caps_remove_format_info (caps);
+  /* then everything the CPU path takes */
+  tmp = gst_caps_merge (tmp, gst_acceltrans_caps_remove_format_info (caps,
+          FALSE));
 
   if (filter) {
     tmp2 = gst_caps_intersect_full (filter, tmp, GST_CAPS_INTERSECT_FIRST);
@@ -537,22 +3315,159 @@ gst_acceltrans_get_unit_size (GstBaseTransform * trans, GstCaps * caps,
 }
 
 
+/* whether a feature works on the frames, identical caps on both sides
+ * pass through only when none does */
+static gboolean
+needs_frames (GstAccelTransform *atrans)
+{
+  gboolean needed;
+
+  GST_OBJECT_LOCK (atrans);
+  needed = atrans->timing_meta || atrans->dedup || atrans->histogram ||
+      atrans->moments ||
+      (atrans->thumb_width > 0 && atrans->thumb_height > 0) ||
+      atrans->crop.left > 0 || atrans->crop.top > 0 ||
+      atrans->crop.width > 0 || atrans->crop.height > 0;
+  GST_OBJECT_UNLOCK (atrans);
+
+  return needed;
+}
+
+
 static void
 gst_acceltrans_set_property (GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
 {
   GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (object);
   const gchar *dev_name;
+  gboolean needed = needs_frames (atrans);
 
   switch (prop_id) {
     case PROP_DEVNAME:
       dev_name = g_value_get_string (value);
+      GST_OBJECT_LOCK (atrans);
       g_free (atrans->device_name);
       atrans->device_name = g_strdup (dev_name);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_TIMING_META:
+      GST_OBJECT_LOCK (atrans);
+      atrans->timing_meta = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_MODE:
+      GST_OBJECT_LOCK (atrans);
+      atrans->mode = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (atrans);
+      /* the queue depth changes our latency */
+      gst_element_post_message (GST_ELEMENT_CAST (atrans),
+          gst_message_new_latency (GST_OBJECT_CAST (atrans)));
+      break;
+    case PROP_WATCHDOG_TIMEOUT:
+      GST_OBJECT_LOCK (atrans);
+      atrans->watchdog_timeout = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CMEM_QUOTA:
+      GST_OBJECT_LOCK (atrans);
+      atrans->cmem_quota = g_value_get_uint64 (value);
+      if (atrans->allocator)
+        gst_cmem_memory_allocator_set_quota (atrans->allocator,
+            atrans->cmem_quota);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_IDLE_TIMEOUT:
+      GST_OBJECT_LOCK (atrans);
+      atrans->idle_timeout = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_RELEASE_ON_PAUSE:
+      GST_OBJECT_LOCK (atrans);
+      atrans->release_on_pause = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DIRECT_OUTPUT:
+      GST_OBJECT_LOCK (atrans);
+      atrans->direct_output = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DIRECT_INPUT:
+      GST_OBJECT_LOCK (atrans);
+      atrans->direct_input = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CPU_THREADS:
+      GST_OBJECT_LOCK (atrans);
+      atrans->cpu_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DEDUP:
+      GST_OBJECT_LOCK (atrans);
+      atrans->dedup = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DEDUP_THRESHOLD:
+      GST_OBJECT_LOCK (atrans);
+      atrans->dedup_threshold = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DEDUP_REFRESH:
+      GST_OBJECT_LOCK (atrans);
+      atrans->dedup_refresh = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_HISTOGRAM:
+      GST_OBJECT_LOCK (atrans);
+      atrans->histogram = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_MOMENTS:
+      GST_OBJECT_LOCK (atrans);
+      atrans->moments = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_THUMBNAIL_WIDTH:
+      GST_OBJECT_LOCK (atrans);
+      atrans->thumb_width = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_THUMBNAIL_HEIGHT:
+      GST_OBJECT_LOCK (atrans);
+      atrans->thumb_height = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_ANALYTICS_MESSAGE:
+      GST_OBJECT_LOCK (atrans);
+      atrans->analytics_message = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CROP_X:
+      GST_OBJECT_LOCK (atrans);
+      atrans->crop.left = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CROP_Y:
+      GST_OBJECT_LOCK (atrans);
+      atrans->crop.top = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CROP_WIDTH:
+      GST_OBJECT_LOCK (atrans);
+      atrans->crop.width = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CROP_HEIGHT:
+      GST_OBJECT_LOCK (atrans);
+      atrans->crop.height = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (atrans);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
+
+  /* set_caps decides on passing through again */
+  if (needs_frames (atrans) != needed)
+    gst_base_transform_reconfigure_src (GST_BASE_TRANSFORM_CAST (atrans));
 }
 
 
@@ -563,7 +3478,137 @@ gst_acceltrans_get_property(GObject *object, guint prop_id, GValue *value, GPara
 
   switch (prop_id) {
     case PROP_DEVNAME:
+      GST_OBJECT_LOCK (atrans);
       g_value_set_string (value, atrans->device_name);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_TIMING_META:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_boolean (value, atrans->timing_meta);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_MODE:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_enum (value, atrans->mode);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_WATCHDOG_TIMEOUT:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->watchdog_timeout);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_RECOVERIES:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->recoveries);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_FRAMES_LOST:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint64 (value, atrans->frames_lost);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CMEM_QUOTA:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint64 (value, atrans->cmem_quota);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CMEM_STATS:
+      g_value_take_boxed (value, gst_cmem_get_stats ());
+      break;
+    case PROP_IDLE_TIMEOUT:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->idle_timeout);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_RELEASE_ON_PAUSE:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_boolean (value, atrans->release_on_pause);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DIRECT_OUTPUT:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_boolean (value, atrans->direct_output);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DIRECT_INPUT:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_boolean (value, atrans->direct_input);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CPU_THREADS:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->cpu_threads);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DEDUP:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_boolean (value, atrans->dedup);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DEDUP_THRESHOLD:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->dedup_threshold);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DEDUP_REFRESH:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->dedup_refresh);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DEDUP_FRAMES:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint64 (value, atrans->dedup_frames);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_DEDUP_HITS:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint64 (value, atrans->dedup_hits);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_HISTOGRAM:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_boolean (value, atrans->histogram);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_MOMENTS:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_boolean (value, atrans->moments);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_THUMBNAIL_WIDTH:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->thumb_width);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_THUMBNAIL_HEIGHT:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->thumb_height);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_ANALYTICS_MESSAGE:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_boolean (value, atrans->analytics_message);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CROP_X:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->crop.left);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CROP_Y:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->crop.top);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CROP_WIDTH:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->crop.width);
+      GST_OBJECT_UNLOCK (atrans);
+      break;
+    case PROP_CROP_HEIGHT:
+      GST_OBJECT_LOCK (atrans);
+      g_value_set_uint (value, atrans->crop.height);
+      GST_OBJECT_UNLOCK (atrans);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -578,6 +3623,7 @@ gst_acceltrans_set_caps (GstBaseTransform * trans, GstCaps * incaps,
 {
   GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
   GstVideoInfo in_info, out_info;
+  GstVideoFormat hw_format;
 
   /* input caps */
   if (!gst_video_info_from_caps (&in_info, incaps))
@@ -587,11 +3633,53 @@ gst_acceltrans_set_caps (GstBaseTransform * trans, GstCaps * incaps,
   if (!gst_video_info_from_caps (&out_info, outcaps))
     goto invalid_caps;
 
+  /* frames converted with the previous caps go out first */
+  if (atrans->negotiated) {
+    drain_jobs (atrans);
+    cleanup_device (atrans);
+    atrans->negotiated = FALSE;
+  }
+
   atrans->in_info = in_info;
   atrans->out_info = out_info;
 
-  if (!setup_device (atrans))
+  /* formats the device can't write are converted on the way out */
+  atrans->fixup = gst_accel_fixup_get_native (GST_VIDEO_INFO_FORMAT (&out_info),
+      &hw_format);
+  if (atrans->fixup) {
+    gst_video_info_init (&atrans->hw_out_info);
+    gst_video_info_set_format (&atrans->hw_out_info, hw_format,
+        GST_VIDEO_INFO_WIDTH (&out_info), GST_VIDEO_INFO_HEIGHT (&out_info));
+    GST_DEBUG_OBJECT (atrans, "device writes %s, converted to %s",
+        gst_video_format_to_string (hw_format),
+        gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (&out_info)));
+  }
+  else {
+    atrans->hw_out_info = out_info;
+  }
+
+  if (GST_VIDEO_INFO_FPS_N (&in_info) > 0)
+    atrans->frame_duration = gst_util_uint64_scale_int (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (&in_info), GST_VIDEO_INFO_FPS_N (&in_info));
+  else
+    atrans->frame_duration = GST_CLOCK_TIME_NONE;
+
+  /* the base class passes the buffers through */
+  if (gst_caps_is_equal (incaps, outcaps) && !needs_frames (atrans)) {
+    GST_DEBUG_OBJECT (atrans, "same caps on both sides, passing through");
+    gst_base_transform_set_passthrough (trans, TRUE);
+    atrans->negotiated = TRUE;
+    return TRUE;
+  }
+  gst_base_transform_set_passthrough (trans, FALSE);
+
+  if (!device_can_convert (atrans)) {
+    if (!setup_workers (atrans, FALSE))
+      goto hw_error;
+  }
+  else if (!setup_device (atrans) && !setup_workers (atrans, TRUE)) {
     goto hw_error;
+  }
 #if 0
   /* XXX: test */
   GST_ERROR_OBJECT (atrans, "input - width:%d/height:%d/format:%#x/fourcc:%#x",
@@ -622,43 +3710,136 @@ hw_error:
 }
 
 
+/* queue every frame still in flight, the last one queued is the newest */
 static GstFlowReturn
-gst_acceltrans_transform (GstBaseTransform * trans, GstBuffer * inbuf,
-    GstBuffer * outbuf)
+push_in_flight (GstAccelTransform *atrans)
 {
-  GstFlowReturn res;
-  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
-  GstMemory *mem;
-  GstVideoFrame frame;
-  guint8 *output;
+  GstFlowReturn res = GST_FLOW_OK;
 
-  if (G_UNLIKELY (!atrans->negotiated))
-    goto unknown_format;
+  if (atrans->workers) {
+    res = push_converted (atrans, 0, NULL);
+    return res == GST_ACCEL_FLOW_QUEUED ? GST_FLOW_OK : res;
+  }
 
-  if (!gst_video_frame_map (&frame, &atrans->out_info, outbuf, GST_MAP_WRITE))
-    goto map_failed;
+  while (res == GST_FLOW_OK && atrans->job_count > 0)
+    res = push_oldest_job (atrans, NULL);
 
-  output = GST_VIDEO_FRAME_PLANE_DATA (&frame, 0);
+  if (res == GST_ACCEL_FLOW_DEVICE_ERROR)
+    res = recover_device (atrans) ?
+        GST_BASE_TRANSFORM_FLOW_DROPPED : GST_FLOW_ERROR;
 
-  mem = gst_buffer_peek_memory (inbuf, 0);
-  if (GST_IS_CMEM_MEMORY_ALLOCATOR (mem->allocator)) {
-    GstCMemMemory *cmem = (GstCMemMemory *)mem;
+  return res;
+}
 
-    res = hwtransform(atrans, cmem, output, TRUE);
+
+/*
+ * Static scenes: a frame that matches the last one converted is not
+ * converted again, that frame's output goes out once more by reference
+ * with this frame's timestamps. TRUE when the frame was handled so.
+ */
+static gboolean
+dedup_frame (GstAccelTransform *atrans, GstBuffer *inbuf, GstFlowReturn *res)
+{
+  GstAccelSignature sig;
+  GstAccelTimingMeta *tmeta;
+  GstBuffer *outbuf;
+  struct v4l2_rect r;
+  gboolean enabled, hit;
+  guint threshold, refresh;
+
+  GST_OBJECT_LOCK (atrans);
+  enabled = atrans->dedup;
+  threshold = atrans->dedup_threshold;
+  refresh = atrans->dedup_refresh;
+  if (enabled)
+    atrans->dedup_frames++;
+  GST_OBJECT_UNLOCK (atrans);
+
+  if (!enabled) {
+    if (G_UNLIKELY (atrans->ref_valid))
+      clear_reference (atrans);
+    return FALSE;
+  }
+
+  get_crop_rect (atrans, inbuf, &r);
+  if (!gst_accel_signature_compute (&sig, inbuf, &atrans->in_info)) {
+    clear_reference (atrans);
+    return FALSE;
   }
-  else {
-    GstMapInfo map;
 
-    if (!gst_buffer_map (inbuf, &map, GST_MAP_READ)) {
-      gst_video_frame_unmap (&frame);
-      goto map_failed;
+  /* compared with the frame converted, not the one before, so a slow
+   * drift still ends the run */
+  hit = atrans->ref_valid &&
+      (refresh == 0 || atrans->ref_repeats + 1 < refresh) &&
+      memcmp (&r, &atrans->ref_crop, sizeof (r)) == 0 &&
+      gst_accel_signature_match (&atrans->ref_sig, &sig, threshold);
+
+  if (hit) {
+    /* the frames before this one go out first, the reference last */
+    *res = push_in_flight (atrans);
+    if (*res != GST_FLOW_OK) {
+      clear_reference (atrans);
+      return TRUE;
     }
+  }
 
-    res = hwtransform(atrans, map.data, output, FALSE);
-    gst_buffer_unmap (inbuf, &map);
+  if (!hit || atrans->last_out == NULL) {
+    /* converted, this frame is the reference from now on */
+    atrans->ref_valid = TRUE;
+    atrans->ref_sig = sig;
+    atrans->ref_crop = r;
+    atrans->ref_repeats = 0;
+    return FALSE;
   }
 
-  gst_video_frame_unmap (&frame);
+  outbuf = gst_buffer_copy (atrans->last_out);
+  gst_buffer_copy_into (outbuf, inbuf,
+      GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+  /* this one never went through the device */
+  tmeta = gst_buffer_get_accel_timing_meta (outbuf);
+  if (tmeta)
+    gst_buffer_remove_meta (outbuf, (GstMeta *) tmeta);
+
+  atrans->ref_repeats++;
+  GST_OBJECT_LOCK (atrans);
+  atrans->dedup_hits++;
+  GST_OBJECT_UNLOCK (atrans);
+
+  /* goes out after the frames pushed ahead of it, not in place of the
+   * output buffer the base class prepared */
+  g_queue_push_tail (&atrans->ready, outbuf);
+  *res = GST_ACCEL_FLOW_QUEUED;
+
+  return TRUE;
+}
+
+
+static GstFlowReturn
+gst_acceltrans_transform (GstBaseTransform * trans, GstBuffer * inbuf,
+    GstBuffer * outbuf)
+{
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
+  GstFlowReturn res;
+
+  if (G_UNLIKELY (!atrans->negotiated))
+    goto unknown_format;
+
+  g_atomic_int_inc (&atrans->activity);
+
+  if (dedup_frame (atrans, inbuf, &res))
+    return res;
+
+  if (atrans->workers)
+    res = cputransform (atrans, inbuf, outbuf);
+  else if (G_UNLIKELY (atrans->released) && !resume_device (atrans))
+    goto resume_failed;
+  else
+    res = hwtransform (atrans, inbuf, outbuf);
+
+  /* the base class pushes it next */
+  if (res == GST_FLOW_OK)
+    remember_output (atrans, outbuf);
 
   return res;
 
@@ -669,11 +3850,158 @@ unknown_format:
         ("unknown format"));
     return GST_FLOW_NOT_NEGOTIATED;
   }
-map_failed:
+resume_failed:
   {
-    GST_WARNING_OBJECT (atrans, "Could not map buffer, skipping");
-    return GST_FLOW_OK;
+    GST_ELEMENT_ERROR (atrans, RESOURCE, NO_SPACE_LEFT,
+        ("Could not re-acquire the buffers released while idle"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+}
+
+
+/*
+ * The outputs queued while converting this input go out first, in order,
+ * then its own. Frames still converting hold no output back and mark no
+ * discontinuity; a frame lost does, after those queued ahead of it.
+ */
+static GstFlowReturn
+gst_acceltrans_generate_output (GstBaseTransform * trans, GstBuffer ** outbuf)
+{
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
+  GstFlowReturn res;
+
+  res = GST_BASE_TRANSFORM_CLASS (parent_class)->generate_output (trans,
+      outbuf);
+  if (*outbuf) {
+    if (res == GST_FLOW_OK)
+      g_queue_push_tail (&atrans->ready, *outbuf);
+    else
+      gst_buffer_unref (*outbuf);
+    *outbuf = NULL;
+  }
+
+  if (res == GST_BASE_TRANSFORM_FLOW_DROPPED) {
+    atrans->out_dropped = TRUE;
+    res = GST_FLOW_OK;
+  }
+  else if (res == GST_ACCEL_FLOW_QUEUED) {
+    res = GST_FLOW_OK;
+  }
+  if (res != GST_FLOW_OK)
+    return res;
+
+  *outbuf = g_queue_pop_head (&atrans->ready);
+  if (*outbuf == NULL && atrans->out_dropped) {
+    atrans->out_dropped = FALSE;
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  }
+
+  return GST_FLOW_OK;
+}
+
+
+static gboolean
+gst_acceltrans_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      if (atrans->negotiated)
+        drain_jobs (atrans);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      if (atrans->negotiated)
+        flush_jobs (atrans);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+
+/* Add the frames queued on the device to the upstream latency. */
+static gboolean
+gst_acceltrans_query (GstBaseTransform * trans, GstPadDirection direction,
+    GstQuery * query)
+{
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
+  gboolean ret, live;
+  GstClockTime min, max, frame_duration, latency;
+  guint depth;
+
+  ret = GST_BASE_TRANSFORM_CLASS (parent_class)->query (trans, direction, query);
+  if (!ret || direction != GST_PAD_SRC ||
+      GST_QUERY_TYPE (query) != GST_QUERY_LATENCY ||
+      gst_base_transform_is_passthrough (trans))
+    return ret;
+
+  gst_query_parse_latency (query, &live, &min, &max);
+
+  GST_OBJECT_LOCK (atrans);
+  frame_duration = atrans->frame_duration;
+  /* on the CPU, one frame per worker */
+  depth = atrans->num_workers > 0 ?
+      atrans->num_workers : GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH;
+
+  /* a live upstream only buffers (max - min), don't queue more than that */
+  if (live && GST_CLOCK_TIME_IS_VALID (max) &&
+      GST_CLOCK_TIME_IS_VALID (frame_duration) && frame_duration > 0) {
+    guint64 headroom = (max > min ? max - min : 0) / frame_duration;
+
+    depth = MIN (depth, headroom + 1);
   }
+  atrans->queue_depth = depth;
+  GST_OBJECT_UNLOCK (atrans);
+
+  depth = get_queue_depth (atrans);
+  if (GST_CLOCK_TIME_IS_VALID (frame_duration))
+    latency = frame_duration * (depth - 1);
+  else
+    latency = 0;
+
+  GST_DEBUG_OBJECT (atrans, "upstream latency min %" GST_TIME_FORMAT
+      " max %" GST_TIME_FORMAT ", %u frame(s) queued, adding %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (min), GST_TIME_ARGS (max), depth, GST_TIME_ARGS (latency));
+
+  min += latency;
+  if (GST_CLOCK_TIME_IS_VALID (max))
+    max += latency;
+
+  gst_query_set_latency (query, live, min, max);
+
+  return TRUE;
+}
+
+
+static gboolean
+gst_acceltrans_start (GstBaseTransform *trans)
+{
+  GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
+  GstClock *clock;
+  gboolean enabled;
+
+  GST_OBJECT_LOCK (atrans);
+  enabled = atrans->idle_timeout > 0 || atrans->release_on_pause;
+  GST_OBJECT_UNLOCK (atrans);
+
+  if (!enabled)
+    return TRUE;
+
+  atrans->idle_activity = g_atomic_int_get (&atrans->activity);
+  atrans->idle_since = GST_CLOCK_TIME_NONE;
+
+  clock = gst_system_clock_obtain ();
+  atrans->idle_id = gst_clock_new_periodic_id (clock,
+      gst_clock_get_time (clock) + IDLE_CHECK_INTERVAL, IDLE_CHECK_INTERVAL);
+  gst_object_unref (clock);
+
+  gst_clock_id_wait_async (atrans->idle_id, idle_check,
+      gst_object_ref (atrans), (GDestroyNotify) gst_object_unref);
+
+  return TRUE;
 }
 
 
@@ -681,21 +4009,44 @@ static gboolean
 gst_acceltrans_stop (GstBaseTransform *trans)
 {
   GstAccelTransform *atrans = GST_ACCEL_TRANSFORM_CAST (trans);
+  GstPad *sinkpad = GST_BASE_TRANSFORM_SINK_PAD (trans);
+
+  gint i;
+
+  if (atrans->idle_id) {
+    gst_clock_id_unschedule (atrans->idle_id);
+    gst_clock_id_unref (atrans->idle_id);
+    atrans->idle_id = NULL;
+  }
+
+  /* an idle check already running finishes first */
+  GST_PAD_STREAM_LOCK (sinkpad);
 
   if (atrans->negotiated) {
     cleanup_device (atrans);
     atrans->negotiated = FALSE;
   }
 
+  for (i = 0; i < GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH; i++) {
+    if (atrans->work_mem[i]) {
+      gst_memory_unref (atrans->work_mem[i]);
+      atrans->work_mem[i] = NULL;
+    }
+  }
+
   if (atrans->allocator) {
     gst_object_unref (atrans->allocator);
     atrans->allocator = NULL;
   }
 
-  if (atrans->work_mem) {
-    gst_memory_unref (atrans->work_mem);
-    atrans->work_mem = NULL;
+  GST_PAD_STREAM_UNLOCK (sinkpad);
+
+  GST_OBJECT_LOCK (atrans);
+  if (atrans->in_pool) {
+    gst_object_unref (atrans->in_pool);
+    atrans->in_pool = NULL;
   }
+  GST_OBJECT_UNLOCK (atrans);
 
   return TRUE;
 }
@@ -717,18 +4068,152 @@ gst_acceltransform_class_init (GstAccelTransformClass * klass)
   trans_class->set_caps = GST_DEBUG_FUNCPTR (gst_acceltrans_set_caps);
   trans_class->propose_allocation =
       GST_DEBUG_FUNCPTR (gst_acceltrans_propose_allocation);
+  trans_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_acceltrans_decide_allocation);
   trans_class->transform_size =
       GST_DEBUG_FUNCPTR (gst_acceltrans_transform_size);
   trans_class->transform_caps =
       GST_DEBUG_FUNCPTR (gst_acceltrans_transform_caps);
+  trans_class->fixate_caps = GST_DEBUG_FUNCPTR (gst_acceltrans_fixate_caps);
   trans_class->get_unit_size =
       GST_DEBUG_FUNCPTR (gst_acceltrans_get_unit_size);
   trans_class->transform = GST_DEBUG_FUNCPTR (gst_acceltrans_transform);
+  trans_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_acceltrans_generate_output);
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_acceltrans_start);
   trans_class->stop = GST_DEBUG_FUNCPTR (gst_acceltrans_stop);
+  trans_class->sink_event = GST_DEBUG_FUNCPTR (gst_acceltrans_sink_event);
+  trans_class->query = GST_DEBUG_FUNCPTR (gst_acceltrans_query);
 
   g_object_class_install_property (object_class, PROP_DEVNAME,
-    g_param_spec_string ("device-name", "V4L2 devie name", "V4L2 device file name(full path)",
+    g_param_spec_string ("device-name", "V4L2 devie name",
+        "V4L2 device file name(full path), or a comma separated list to "
+        "spread the frames over several devices",
         NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_MODE,
+    g_param_spec_enum ("mode", "Mode", "Trade latency against throughput",
+        GST_TYPE_ACCEL_TRANSFORM_MODE, DEFAULT_MODE,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_TIMING_META,
+    g_param_spec_boolean ("timing-meta", "Timing meta",
+        "Attach per-frame hardware timing to output buffers",
+        DEFAULT_TIMING_META,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_WATCHDOG_TIMEOUT,
+    g_param_spec_uint ("watchdog-timeout", "Watchdog timeout",
+        "Reset the device when a frame takes longer than this (ms, 0 = never)",
+        0, G_MAXUINT, DEFAULT_WATCHDOG_TIMEOUT,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_RECOVERIES,
+    g_param_spec_uint ("recoveries", "Recoveries",
+        "Number of device faults recovered from", 0, G_MAXUINT, 0,
+        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_FRAMES_LOST,
+    g_param_spec_uint64 ("frames-lost", "Frames lost",
+        "Frames dropped by device recoveries", 0, G_MAXUINT64, 0,
+        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_CMEM_QUOTA,
+    g_param_spec_uint64 ("cmem-quota", "CMEM quota",
+        "Most CMEM bytes this element may hold (0 = unlimited)",
+        0, G_MAXUINT64, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_CMEM_STATS,
+    g_param_spec_boxed ("cmem-stats", "CMEM stats",
+        "Process-wide CMEM registry counters", GST_TYPE_STRUCTURE,
+        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_IDLE_TIMEOUT,
+    g_param_spec_uint ("idle-timeout", "Idle timeout",
+        "Give the CMEM buffers back after no frame for this long (ms, 0 = never)",
+        0, G_MAXUINT, DEFAULT_IDLE_TIMEOUT,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_RELEASE_ON_PAUSE,
+    g_param_spec_boolean ("release-on-pause", "Release on pause",
+        "Give the CMEM buffers back while paused",
+        DEFAULT_RELEASE_ON_PAUSE,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_DIRECT_OUTPUT,
+    g_param_spec_boolean ("direct-output", "Direct output",
+        "Let the device write into downstream buffers it can reach through "
+        "USERPTR instead of copying out (low-latency mode only)",
+        DEFAULT_DIRECT_OUTPUT,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_DIRECT_INPUT,
+    g_param_spec_boolean ("direct-input", "Direct input",
+        "Let the device read system-memory upstream buffers it can reach "
+        "through USERPTR instead of copying them in",
+        DEFAULT_DIRECT_INPUT,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_CPU_THREADS,
+    g_param_spec_uint ("cpu-threads", "CPU threads",
+        "Threads converting whole frames when no device takes the caps "
+        "(0 = one per core)", 0, 64, DEFAULT_CPU_THREADS,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_DEDUP,
+    g_param_spec_boolean ("dedup", "Dedup",
+        "Push the previous output again instead of converting a frame "
+        "that matches it", DEFAULT_DEDUP,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_DEDUP_THRESHOLD,
+    g_param_spec_uint ("dedup-threshold", "Dedup threshold",
+        "Largest change of a block's mean level still taken as a match",
+        0, 255, DEFAULT_DEDUP_THRESHOLD,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_DEDUP_REFRESH,
+    g_param_spec_uint ("dedup-refresh", "Dedup refresh",
+        "Convert at least every this many frames (0 = only on change)",
+        0, G_MAXUINT, DEFAULT_DEDUP_REFRESH,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_DEDUP_FRAMES,
+    g_param_spec_uint64 ("dedup-frames", "Dedup frames",
+        "Frames checked for a match", 0, G_MAXUINT64, 0,
+        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_DEDUP_HITS,
+    g_param_spec_uint64 ("dedup-hits", "Dedup hits",
+        "Frames that matched and were not converted", 0, G_MAXUINT64, 0,
+        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_HISTOGRAM,
+    g_param_spec_boolean ("histogram", "Histogram",
+        "Attach the output's luma histogram (GstAccelStatsMeta)",
+        DEFAULT_HISTOGRAM,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_MOMENTS,
+    g_param_spec_boolean ("moments", "Moments",
+        "Attach the output's luma mean and variance (GstAccelStatsMeta)",
+        DEFAULT_MOMENTS,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_THUMBNAIL_WIDTH,
+    g_param_spec_uint ("thumbnail-width", "Thumbnail width",
+        "Width of the box-filtered luma thumbnail attached "
+        "(0 = no thumbnail)", 0, G_MAXINT, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_THUMBNAIL_HEIGHT,
+    g_param_spec_uint ("thumbnail-height", "Thumbnail height",
+        "Height of the box-filtered luma thumbnail attached "
+        "(0 = no thumbnail)", 0, G_MAXINT, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_ANALYTICS_MESSAGE,
+    g_param_spec_boolean ("analytics-message", "Analytics message",
+        "Also post the analytics as an accel-stats element message",
+        DEFAULT_ANALYTICS_MESSAGE,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_CROP_X,
+    g_param_spec_uint ("crop-x", "Crop x", "Left edge of the converted input region",
+        0, G_MAXINT, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_CROP_Y,
+    g_param_spec_uint ("crop-y", "Crop y", "Top edge of the converted input region",
+        0, G_MAXINT, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_CROP_WIDTH,
+    g_param_spec_uint ("crop-width", "Crop width",
+        "Width of the converted input region (0 = to the right edge)",
+        0, G_MAXINT, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+  g_object_class_install_property (object_class, PROP_CROP_HEIGHT,
+    g_param_spec_uint ("crop-height", "Crop height",
+        "Height of the converted input region (0 = to the bottom edge)",
+        0, G_MAXINT, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
   gst_element_class_set_details_simple(gstelement_class,
     "Colorspace converter",
     "Filter/Converter/Video",
@@ -749,12 +4234,59 @@ gst_acceltransform_init (GstAccelTransform * atrans)
 {
   GST_DEBUG_OBJECT (atrans, "gst_accel_transform_init");
 
-  atrans->input_start = FALSE;
   atrans->negotiated = FALSE;
   atrans->device_name = NULL;
   atrans->allocator = NULL;
-  atrans->work_mem = NULL;
-  atrans->devfd = -1;
+  memset (atrans->work_mem, 0, sizeof (atrans->work_mem));
+  atrans->num_devices = 0;
+  atrans->num_out_bufs = 0;
+  atrans->job_head = 0;
+  atrans->job_count = 0;
+  g_queue_init (&atrans->ready);
+  atrans->out_dropped = FALSE;
+  atrans->mode = DEFAULT_MODE;
+  atrans->queue_depth = GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH;
+  atrans->frame_duration = GST_CLOCK_TIME_NONE;
+  atrans->timing_meta = DEFAULT_TIMING_META;
+  atrans->watchdog_timeout = DEFAULT_WATCHDOG_TIMEOUT;
+  atrans->consecutive_faults = 0;
+  atrans->recoveries = 0;
+  atrans->frames_lost = 0;
+  atrans->cmem_quota = 0;
+  memset (&atrans->crop, 0, sizeof (atrans->crop));
+  memset (&atrans->cur_crop, 0, sizeof (atrans->cur_crop));
+  atrans->crop_active = FALSE;
+  atrans->crop_meta = FALSE;
+  atrans->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+  atrans->release_on_pause = DEFAULT_RELEASE_ON_PAUSE;
+  atrans->direct_input = DEFAULT_DIRECT_INPUT;
+  atrans->in_userptr = FALSE;
+  atrans->in_rejects = 0;
+  atrans->direct_output = DEFAULT_DIRECT_OUTPUT;
+  atrans->out_userptr = FALSE;
+  atrans->out_rejects = 0;
+  atrans->cpu_threads = DEFAULT_CPU_THREADS;
+  atrans->workers = NULL;
+  atrans->num_workers = 0;
+  atrans->dedup = DEFAULT_DEDUP;
+  atrans->dedup_threshold = DEFAULT_DEDUP_THRESHOLD;
+  atrans->dedup_refresh = DEFAULT_DEDUP_REFRESH;
+  atrans->dedup_frames = 0;
+  atrans->dedup_hits = 0;
+  atrans->histogram = DEFAULT_HISTOGRAM;
+  atrans->moments = DEFAULT_MOMENTS;
+  atrans->thumb_width = 0;
+  atrans->thumb_height = 0;
+  atrans->analytics_message = DEFAULT_ANALYTICS_MESSAGE;
+  atrans->ref_valid = FALSE;
+  atrans->ref_repeats = 0;
+  atrans->last_out = NULL;
+  atrans->idle_id = NULL;
+  atrans->activity = 0;
+  atrans->idle_activity = 0;
+  atrans->idle_since = GST_CLOCK_TIME_NONE;
+  atrans->released = FALSE;
+  atrans->in_pool = NULL;
 
   /* enable QoS */
   gst_base_transform_set_qos_enabled (GST_BASE_TRANSFORM (atrans), TRUE);
@@ -768,8 +4300,17 @@ gst_acceltransform_init (GstAccelTransform * atrans)
 static gboolean
 plugin_init (GstPlugin * plugin)
 {
-  return gst_element_register (plugin, "acceltransform", GST_RANK_NONE,
-      GST_TYPE_ACCEL_TRANSFORM);
+  /* it converts whatever the device can't on the CPU, safe to autoplug */
+  if (!gst_element_register (plugin, "acceltransform", GST_RANK_SECONDARY,
+          GST_TYPE_ACCEL_TRANSFORM))
+    return FALSE;
+
+  if (!gst_element_register (plugin, "accelmultitransform", GST_RANK_NONE,
+          GST_TYPE_ACCEL_MULTI_TRANSFORM))
+    return FALSE;
+
+  return gst_element_register (plugin, "acceluvcsrc", GST_RANK_NONE,
+      GST_TYPE_ACCEL_UVC_SRC);
 }
 
 
@@ -27,6 +27,13 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideometa.h>
 #include <gst/video/gstvideopool.h>
+#include <linux/videodev2.h>
+
+#include "gstacceltimingmeta.h"
+#include "gstacceldedup.h"
+#include "gstaccelstats.h"
+#include "gstaccelworkers.h"
+#include "vpeconv.h"
 
 G_BEGIN_DECLS
 
@@ -45,19 +52,202 @@ G_BEGIN_DECLS
 typedef struct _GstAccelTransform GstAccelTransform;
 typedef struct _GstAccelTransformClass GstAccelTransformClass;
 
+/**
+ * GstAccelTransformMode:
+ * @GST_ACCEL_TRANSFORM_MODE_LOW_LATENCY: keep exactly one frame in flight
+ * @GST_ACCEL_TRANSFORM_MODE_THROUGHPUT: keep the hardware queue full
+ */
+typedef enum {
+  GST_ACCEL_TRANSFORM_MODE_LOW_LATENCY,
+  GST_ACCEL_TRANSFORM_MODE_THROUGHPUT,
+} GstAccelTransformMode;
+
+/* scaling beyond one VPE pass runs up to this many passes before the last */
+#define GST_ACCEL_TRANSFORM_MAX_PREPASSES 2
+
+/* device-name may list this many nodes, the frames are spread over them */
+#define GST_ACCEL_TRANSFORM_MAX_DEVICES 4
+
+/* frames queued on each device in throughput mode, one output buffer each */
+#define GST_ACCEL_TRANSFORM_DEVICE_QUEUE_DEPTH 3
+#define GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH \
+  (GST_ACCEL_TRANSFORM_DEVICE_QUEUE_DEPTH * GST_ACCEL_TRANSFORM_MAX_DEVICES)
+#define GST_ACCEL_TRANSFORM_MAX_OUTPUT_BUFS GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH
+
+/* a frame wider than a line of the VPE runs in up to this many strips */
+#define GST_ACCEL_TRANSFORM_MAX_STRIPS 4
+
+typedef struct {
+  void *buf;
+  int fd;
+} cmem_buf;
+
+/* a device the last pass can run on */
+typedef struct {
+  gchar *name;
+  vpeconv_session *session;
+  guint in_flight;
+  GstClockTime frame_time;    /* measured per frame, moving average */
+  GstClockTime last_done;
+} GstAccelTransformDevice;
+
+/* a vertical strip of a frame too wide for the device, in columns. The
+ * device reads a window of the input and writes a band of the
+ * intermediate, both wider than the strip by the overlap with its
+ * neighbours, which the copy out leaves behind. */
+typedef struct {
+  gint in_x;                /* first column of the window */
+  gint in_width;
+  struct v4l2_rect crop;    /* what is scaled, within the window */
+  gint band_x;              /* first column of the band */
+  gint band_width;
+  gint skip;                /* band columns before the ones kept */
+  gint out_x;               /* first column kept, in out_rect */
+  gint out_width;
+} GstAccelTransformStrip;
+
+/* a frame queued on the device */
+typedef struct {
+  GstBuffer *inbuf;   /* held while the device reads from it in place */
+  GstMapInfo in_map;
+  gboolean in_mapped; /* queued through its mapping (USERPTR input) */
+  GstBuffer *outbuf;  /* written in place, owned by the call that submits it */
+  GstMapInfo out_map;
+  GstClockTime pts;
+  GstClockTime dts;
+  GstClockTime duration;
+  GstAccelTiming timing;
+  guint device;
+  GstClockTime submitted;
+} GstAccelTransformJob;
+
 struct _GstAccelTransform {
   GstBaseTransform element;
 
   GstAllocator *allocator;
-  GstMemory *work_mem;
+  GstMemory *work_mem[GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH];
   gchar *device_name;
   gboolean negotiated;
-  gboolean input_start;
   GstVideoInfo in_info;
   GstVideoInfo out_info;
-  gint devfd;
+  GstVideoInfo hw_out_info;   /* what the device writes, differs from out_info with a fixup */
+  gboolean fixup;
+  /* the last pass runs on any of the devices, the earlier ones on the
+   * first */
+  GstAccelTransformDevice devices[GST_ACCEL_TRANSFORM_MAX_DEVICES];
+  guint num_devices;
   guint32 v4l2_in_size;
   guint32 v4l2_out_size;
+
+  cmem_buf out_cbuf[GST_ACCEL_TRANSFORM_MAX_OUTPUT_BUFS];
+  gsize out_cbuf_size;
+  guint num_out_bufs;
+
+  /* direct input and output: the properties, guarded by the object lock,
+   * whether the first pass's input and the capture queue take USERPTR
+   * buffers and the buffers the device refused in a row */
+  gboolean direct_input;
+  gboolean in_userptr;
+  guint in_rejects;
+  gboolean direct_output;
+  gboolean out_userptr;
+  guint out_rejects;
+
+  /* multi-pass scaling: each pass before the last has its own session
+   * and writes a per-slot intermediate only the device touches */
+  guint num_prepasses;
+  vpeconv_session *prepass[GST_ACCEL_TRANSFORM_MAX_PREPASSES];
+  GstVideoInfo prepass_info[GST_ACCEL_TRANSFORM_MAX_PREPASSES];
+  guint32 prepass_size[GST_ACCEL_TRANSFORM_MAX_PREPASSES];
+  cmem_buf prepass_cbuf[GST_ACCEL_TRANSFORM_MAX_PREPASSES][GST_ACCEL_TRANSFORM_MAX_OUTPUT_BUFS];
+
+  /* strip tiling, for frames wider than a line of the device: each
+   * strip reads its window of the input in place and writes its band of
+   * the intermediate, laid out as tile_info. The last strip runs on the
+   * picked device, the others on sessions of their own on the first. */
+  gboolean tiled;
+  guint num_strips;
+  GstAccelTransformStrip strips[GST_ACCEL_TRANSFORM_MAX_STRIPS];
+  vpeconv_session *strip_session[GST_ACCEL_TRANSFORM_MAX_STRIPS - 1];
+  GstVideoInfo tile_info;
+  gsize strip_out_size;       /* of the intermediate the strips reach */
+
+  /* in-flight frames in input order, oldest at job_head; a job uses the
+   * output buffer of the same index, num_out_bufs of them. Completing
+   * the oldest first puts the output back in order when the devices
+   * finish out of it. */
+  GstAccelTransformJob jobs[GST_ACCEL_TRANSFORM_MAX_QUEUE_DEPTH];
+  guint job_head;
+  guint job_count;
+
+  /* outputs done ahead of the current input's, handed to the base class
+   * in order by generate_output; out_dropped marks a frame lost behind
+   * them */
+  GQueue ready;
+  gboolean out_dropped;
+
+  /* CPU conversion when no device takes the caps: the property, guarded
+   * by the object lock, and the workers with their count, read by the
+   * latency query under the lock */
+  guint cpu_threads;
+  GstAccelWorkers *workers;
+  guint num_workers;
+
+  GstAccelTransformMode mode;
+  guint queue_depth;
+  GstClockTime frame_duration;
+
+  gboolean timing_meta;       /* guarded by the object lock */
+  guint64 cmem_quota;
+
+  /* input crop: the properties, guarded by the object lock, and the
+   * rectangle set on the device (width 0 until the first job). When
+   * downstream takes crop metas the crop keeps the scale of the whole
+   * frame, it is written to out_rect of the output and only those rows
+   * are synced and copied; otherwise it fills the output. */
+  struct v4l2_rect crop;
+  struct v4l2_rect cur_crop;
+  struct v4l2_rect out_rect;
+  gboolean crop_active;
+  gboolean crop_meta;
+
+  /* static-scene dedup: the properties and counters, guarded by the
+   * object lock, the signature and crop of the last frame converted, the
+   * times its output went out again and the last output pushed */
+  gboolean dedup;
+  guint dedup_threshold;
+  guint dedup_refresh;
+  guint64 dedup_frames;
+  guint64 dedup_hits;
+  gboolean ref_valid;
+  GstAccelSignature ref_sig;
+  struct v4l2_rect ref_crop;
+  guint ref_repeats;
+  GstBuffer *last_out;
+
+  /* analytics computed on the copy out, guarded by the object lock */
+  gboolean histogram;
+  gboolean moments;
+  guint thumb_width;
+  guint thumb_height;
+  gboolean analytics_message;
+
+  /* fault recovery, counters guarded by the object lock */
+  guint watchdog_timeout;
+  guint consecutive_faults;
+  guint recoveries;
+  guint64 frames_lost;
+
+  /* idle reclamation: the properties, guarded by the object lock, and
+   * the periodic check, which runs with the sink pad's stream lock */
+  guint idle_timeout;
+  gboolean release_on_pause;
+  GstClockID idle_id;
+  gint activity;              /* frames seen, atomic */
+  gint idle_activity;
+  GstClockTime idle_since;
+  gboolean released;          /* device buffers given back, device still open */
+  GstBufferPool *in_pool;     /* proposed upstream, trimmed when idle */
 };
 struct _GstAccelTransformClass {
   GstBaseTransformClass parent_class;
@@ -65,6 +255,9 @@ struct _GstAccelTransformClass {
 
 GType gst_acceltransform_get_type (void);
 
+gboolean get_v4l2_fmt (const GstVideoInfo *vinfo, uint32_t *fourcc,
+    enum v4l2_colorspace *clrspc);
+
 G_END_DECLS
 
 #endif /* __GST_ACCEL_TRANSFORM_H__ */
@@ -0,0 +1,721 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * acceluvcsrc captures from a UVC camera and converts on the VPE in one
+ * element. The camera fills CMEM buffers through V4L2_MEMORY_USERPTR and
+ * each finished capture is queued on the VPE as it is, the VPE writes
+ * straight into the CMEM buffer pushed downstream. No GstBuffer sits
+ * between the two devices, so v4l2src needs no io-mode=userptr build.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+
+#include "gstacceluvcsrc.h"
+#include "cmempool.h"
+#include "cmem_buf.h"
+#include "v4l2_m2m.h"
+#include "v4l2_capture.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_accel_uvc_src_debug);
+#define GST_CAT_DEFAULT gst_accel_uvc_src_debug
+
+enum
+{
+  PROP_0,
+  PROP_DEVICE,
+  PROP_VPE_DEVICE,
+  PROP_CAPTURE_FORMAT,
+  PROP_CAPTURE_WIDTH,
+  PROP_CAPTURE_HEIGHT,
+  PROP_FRAMES_DROPPED,
+};
+
+#define DEFAULT_DEVICE "/dev/video1"
+#define DEFAULT_VPE_DEVICE "/dev/v4l/by-path/platform-489d0000.vpe-video-index0"
+#define DEFAULT_CAPTURE_FORMAT GST_VIDEO_FORMAT_YUY2
+#define DEFAULT_WIDTH 640
+#define DEFAULT_HEIGHT 480
+
+/* the camera is polled this often to notice a flush, and given up on
+ * after no frame for CAPTURE_TIMEOUT */
+#define POLL_INTERVAL_MS 100
+#define CAPTURE_TIMEOUT_MS 2000
+
+/* longest a conversion may take */
+#define CONVERT_TIMEOUT_MS 500
+
+/* what the VPE writes */
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("NV12")
+        ";" GST_VIDEO_CAPS_MAKE ("UYVY")
+        ";" GST_VIDEO_CAPS_MAKE ("YUY2")
+        ";" GST_VIDEO_CAPS_MAKE ("ARGB")
+        ";" GST_VIDEO_CAPS_MAKE ("xRGB")
+        ";" GST_VIDEO_CAPS_MAKE ("ABGR")
+        ";" GST_VIDEO_CAPS_MAKE ("xBGR")
+        ";" GST_VIDEO_CAPS_MAKE ("RGB")
+        ";" GST_VIDEO_CAPS_MAKE ("BGR"))
+    );
+
+#define gst_accel_uvc_src_parent_class parent_class
+G_DEFINE_TYPE (GstAccelUvcSrc, gst_accel_uvc_src, GST_TYPE_PUSH_SRC);
+
+
+static void
+free_capture_buffers (GstAccelUvcSrc *src)
+{
+  guint i;
+
+  for (i = 0; i < src->num_capture_bufs; i++)
+    free_cmem_buffer (src->capture_cbuf[i].buf);
+  src->num_capture_bufs = 0;
+}
+
+
+static void
+stop_capture (GstAccelUvcSrc *src)
+{
+  if (src->streaming) {
+    (void)v4l2_capture_stream_off (src->camfd);
+    src->streaming = FALSE;
+  }
+
+  /* the camera lets go of our buffers before they are freed */
+  if (src->num_capture_bufs > 0) {
+    (void)v4l2_capture_release (src->camfd);
+    free_capture_buffers (src);
+  }
+}
+
+
+static gboolean
+start_capture (GstAccelUvcSrc *src, gsize size)
+{
+  gint fd;
+  guint i;
+
+  if (v4l2_capture_request (src->camfd, GST_ACCEL_UVC_SRC_CAPTURE_BUFS) < 0)
+    return FALSE;
+
+  for (i = 0; i < GST_ACCEL_UVC_SRC_CAPTURE_BUFS; i++) {
+    fd = alloc_cmem_buffer (size, 1, &src->capture_cbuf[i].buf);
+    if (fd < 0) {
+      GST_ERROR_OBJECT (src, "alloc cmem failed(ret:%d)", fd);
+      goto failed;
+    }
+    src->capture_cbuf[i].fd = fd;
+    src->num_capture_bufs++;
+
+    if (v4l2_capture_queue (src->camfd, i, src->capture_cbuf[i].buf,
+            size) < 0)
+      goto failed;
+  }
+
+  if (v4l2_capture_stream_on (src->camfd) < 0)
+    goto failed;
+  src->streaming = TRUE;
+
+  return TRUE;
+
+failed:
+  (void)v4l2_capture_release (src->camfd);
+  free_capture_buffers (src);
+  return FALSE;
+}
+
+
+static gboolean
+gst_accel_uvc_src_set_caps (GstBaseSrc *bsrc, GstCaps *caps)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (bsrc);
+  GstVideoInfo out_info, capture_info;
+  GstVideoFormat format;
+  vpeconv_format in_fmt, out_fmt;
+  enum v4l2_colorspace clrspc;
+  uint32_t fourcc, in_size;
+  guint width, height;
+
+  if (!gst_video_info_from_caps (&out_info, caps))
+    goto invalid_caps;
+
+  stop_capture (src);
+
+  GST_OBJECT_LOCK (src);
+  format = src->capture_format;
+  width = src->capture_width ? src->capture_width :
+      GST_VIDEO_INFO_WIDTH (&out_info);
+  height = src->capture_height ? src->capture_height :
+      GST_VIDEO_INFO_HEIGHT (&out_info);
+  GST_OBJECT_UNLOCK (src);
+
+  gst_video_info_init (&capture_info);
+  gst_video_info_set_format (&capture_info, format, width, height);
+  if (!get_v4l2_fmt (&capture_info, &fourcc, &clrspc))
+    goto bad_format;
+
+  /* the camera may pick a size of its own, the VPE scales from that */
+  if (v4l2_capture_set_format (src->camfd, &width, &height, fourcc,
+          GST_VIDEO_INFO_FPS_N (&out_info), GST_VIDEO_INFO_FPS_D (&out_info),
+          &src->capture_size) < 0)
+    goto capture_failed;
+  gst_video_info_set_format (&capture_info, format, width, height);
+
+  in_fmt.width = width;
+  in_fmt.height = height;
+  in_fmt.fourcc = fourcc;
+  in_fmt.colorspace = clrspc;
+
+  if (!get_v4l2_fmt (&out_info, &out_fmt.fourcc, &clrspc))
+    goto bad_format;
+  out_fmt.width = GST_VIDEO_INFO_WIDTH (&out_info);
+  out_fmt.height = GST_VIDEO_INFO_HEIGHT (&out_info);
+  out_fmt.colorspace = clrspc;
+
+  /* one frame at a time, the camera keeps capturing meanwhile */
+  if (vpeconv_configure (src->session, &in_fmt, &out_fmt, 1, &in_size,
+          &src->v4l2_out_size) < 0)
+    goto vpe_failed;
+
+  if (!start_capture (src, MAX (src->capture_size, in_size)))
+    goto capture_failed;
+
+  src->capture_info = capture_info;
+  src->out_info = out_info;
+
+  GST_DEBUG_OBJECT (src, "capturing %ux%u %s, converting to %dx%d %s",
+      width, height, gst_video_format_to_string (format),
+      GST_VIDEO_INFO_WIDTH (&out_info), GST_VIDEO_INFO_HEIGHT (&out_info),
+      gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (&out_info)));
+
+  return TRUE;
+
+  /* ERRORS */
+invalid_caps:
+  {
+    GST_ERROR_OBJECT (src, "invalid caps");
+    return FALSE;
+  }
+bad_format:
+  {
+    GST_ELEMENT_ERROR (src, CORE, NEGOTIATION, (NULL),
+        ("the VPE can't take %s", gst_video_format_to_string (format)));
+    return FALSE;
+  }
+capture_failed:
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, SETTINGS,
+        ("Could not set up capture on %s", src->device), (NULL));
+    return FALSE;
+  }
+vpe_failed:
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, SETTINGS,
+        ("Could not configure the VPE"), (NULL));
+    return FALSE;
+  }
+}
+
+
+static GstCaps *
+gst_accel_uvc_src_fixate (GstBaseSrc *bsrc, GstCaps *caps)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (bsrc);
+  GstStructure *st;
+  guint width, height;
+
+  GST_OBJECT_LOCK (src);
+  width = src->capture_width ? src->capture_width : DEFAULT_WIDTH;
+  height = src->capture_height ? src->capture_height : DEFAULT_HEIGHT;
+  GST_OBJECT_UNLOCK (src);
+
+  /* without a preference downstream, the capture size at 30 fps */
+  caps = gst_caps_make_writable (gst_caps_truncate (caps));
+  st = gst_caps_get_structure (caps, 0);
+  gst_structure_fixate_field_nearest_int (st, "width", width);
+  gst_structure_fixate_field_nearest_int (st, "height", height);
+  gst_structure_fixate_field_nearest_fraction (st, "framerate", 30, 1);
+
+  return GST_BASE_SRC_CLASS (parent_class)->fixate (bsrc, caps);
+}
+
+
+/* the VPE writes only to CMEM, whatever downstream offers */
+static gboolean
+gst_accel_uvc_src_decide_allocation (GstBaseSrc *bsrc, GstQuery *query)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (bsrc);
+  GstBufferPool *pool;
+  GstStructure *config;
+  GstCaps *caps;
+  guint size, min = 0, max = 0;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+  if (caps == NULL)
+    return FALSE;
+
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, NULL, NULL, &min, &max);
+
+  pool = gst_cmem_buffer_pool_new ();
+  size = MAX (src->out_info.size, src->v4l2_out_size);
+  min = MAX (min, CMEM_POOL_MIN_BUF_NUM);
+  max = (max == 0 ? CMEM_POOL_MAX_BUF_NUM : MAX (max, min));
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  if (!gst_buffer_pool_set_config (pool, config)) {
+    GST_ERROR_OBJECT (src, "failed setting config");
+    gst_object_unref (pool);
+    return FALSE;
+  }
+
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, size, min, max);
+  gst_object_unref (pool);
+
+  return GST_BASE_SRC_CLASS (parent_class)->decide_allocation (bsrc, query);
+}
+
+
+/* the index of the next complete frame the camera finished */
+static GstFlowReturn
+wait_capture (GstAccelUvcSrc *src, gint *index)
+{
+  guint32 bytesused;
+  gint ret, waited = 0;
+
+  for (;;) {
+    ret = v4l2_wait_buffer (src->camfd, POLL_INTERVAL_MS);
+    if (ret < 0)
+      goto failed;
+
+    if (ret == 0) {
+      if (g_atomic_int_get (&src->flushing))
+        return GST_FLOW_FLUSHING;
+      waited += POLL_INTERVAL_MS;
+      if (waited >= CAPTURE_TIMEOUT_MS)
+        goto timeout;
+      continue;
+    }
+
+    *index = v4l2_capture_dequeue (src->camfd, &bytesused);
+    if (*index < 0)
+      goto failed;
+
+    if (bytesused >= src->capture_info.size)
+      return GST_FLOW_OK;
+
+    /* a short frame, the camera lost part of it on the bus */
+    GST_OBJECT_LOCK (src);
+    src->frames_dropped++;
+    GST_OBJECT_UNLOCK (src);
+    GST_DEBUG_OBJECT (src, "short frame (%u bytes)", bytesused);
+
+    if (v4l2_capture_queue (src->camfd, *index,
+            src->capture_cbuf[*index].buf, src->capture_size) < 0)
+      goto failed;
+  }
+
+failed:
+  GST_ELEMENT_ERROR (src, RESOURCE, READ,
+      ("Could not capture from %s", src->device), (NULL));
+  return GST_FLOW_ERROR;
+timeout:
+  GST_ELEMENT_ERROR (src, RESOURCE, READ,
+      ("No frame from %s for %d ms", src->device, CAPTURE_TIMEOUT_MS), (NULL));
+  return GST_FLOW_ERROR;
+}
+
+
+static GstFlowReturn
+gst_accel_uvc_src_create (GstPushSrc *psrc, GstBuffer **buffer)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (psrc);
+  GstBufferPool *pool;
+  GstBuffer *outbuf = NULL;
+  GstCMemMeta *cmeta;
+  GstFlowReturn res;
+  vpeconv_frame frame;
+  vpeconv_completion done;
+  gint index;
+
+  pool = gst_base_src_get_buffer_pool (GST_BASE_SRC_CAST (src));
+  if (pool == NULL)
+    return GST_FLOW_NOT_NEGOTIATED;
+  res = gst_buffer_pool_acquire_buffer (pool, &outbuf, NULL);
+  gst_object_unref (pool);
+  if (res != GST_FLOW_OK)
+    return res;
+
+  cmeta = gst_buffer_get_cmem_meta (outbuf);
+  if (cmeta == NULL)
+    goto not_cmem;
+
+  res = wait_capture (src, &index);
+  if (res != GST_FLOW_OK)
+    goto failed;
+
+  /* the capture goes to the VPE as the camera left it */
+  memset (&frame, 0, sizeof (frame));
+  frame.in_fd = src->capture_cbuf[index].fd;
+  frame.out_fd = cmeta->fd;
+  if (vpeconv_submit (src->session, &frame, 1) != 1)
+    goto convert_failed;
+  if (vpeconv_complete (src->session, &done, 1, CONVERT_TIMEOUT_MS) != 1 ||
+      done.status != 0) {
+    (void)vpeconv_reset (src->session);
+    goto convert_failed;
+  }
+
+  /* the camera refills it while the frame goes downstream */
+  if (v4l2_capture_queue (src->camfd, index, src->capture_cbuf[index].buf,
+          src->capture_size) < 0) {
+    GST_ELEMENT_ERROR (src, RESOURCE, READ,
+        ("Could not capture from %s", src->device), (NULL));
+    res = GST_FLOW_ERROR;
+    goto failed;
+  }
+
+  cmeta->cache_state = GST_CMEM_CACHE_DEVICE_DIRTY;
+  *buffer = outbuf;
+
+  return GST_FLOW_OK;
+
+  /* ERRORS */
+not_cmem:
+  {
+    GST_ELEMENT_ERROR (src, CORE, NEGOTIATION, (NULL),
+        ("output buffer is not CMEM"));
+    res = GST_FLOW_NOT_NEGOTIATED;
+    goto failed;
+  }
+convert_failed:
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, FAILED,
+        ("Video transform device failed"), (NULL));
+    res = GST_FLOW_ERROR;
+    goto failed;
+  }
+failed:
+  gst_buffer_unref (outbuf);
+  return res;
+}
+
+
+/* a captured frame waits for the next to finish at most */
+static gboolean
+gst_accel_uvc_src_query (GstBaseSrc *bsrc, GstQuery *query)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (bsrc);
+  GstClockTime duration;
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY)
+    return GST_BASE_SRC_CLASS (parent_class)->query (bsrc, query);
+
+  if (!src->streaming || GST_VIDEO_INFO_FPS_N (&src->out_info) <= 0)
+    return FALSE;
+
+  duration = gst_util_uint64_scale_int (GST_SECOND,
+      GST_VIDEO_INFO_FPS_D (&src->out_info),
+      GST_VIDEO_INFO_FPS_N (&src->out_info));
+  gst_query_set_latency (query, TRUE, duration,
+      duration * GST_ACCEL_UVC_SRC_CAPTURE_BUFS);
+
+  return TRUE;
+}
+
+
+static gboolean
+gst_accel_uvc_src_unlock (GstBaseSrc *bsrc)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (bsrc);
+
+  g_atomic_int_set (&src->flushing, 1);
+  return TRUE;
+}
+
+
+static gboolean
+gst_accel_uvc_src_unlock_stop (GstBaseSrc *bsrc)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (bsrc);
+
+  g_atomic_int_set (&src->flushing, 0);
+  return TRUE;
+}
+
+
+static gboolean
+gst_accel_uvc_src_start (GstBaseSrc *bsrc)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (bsrc);
+  gchar *device, *vpe_device;
+
+  GST_OBJECT_LOCK (src);
+  device = g_strdup (src->device);
+  vpe_device = g_strdup (src->vpe_device);
+  GST_OBJECT_UNLOCK (src);
+
+  src->camfd = open (device, O_RDWR);
+  if (src->camfd < 0) {
+    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ_WRITE,
+        ("Could not open %s", device), ("%s", g_strerror (errno)));
+    goto failed;
+  }
+
+  src->session = vpeconv_open (vpe_device);
+  if (src->session == NULL) {
+    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ_WRITE,
+        ("Could not open %s", vpe_device), ("%s", g_strerror (errno)));
+    close (src->camfd);
+    src->camfd = -1;
+    goto failed;
+  }
+
+  g_free (device);
+  g_free (vpe_device);
+  return TRUE;
+
+failed:
+  g_free (device);
+  g_free (vpe_device);
+  return FALSE;
+}
+
+
+static gboolean
+gst_accel_uvc_src_stop (GstBaseSrc *bsrc)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (bsrc);
+
+  if (src->camfd >= 0) {
+    stop_capture (src);
+    close (src->camfd);
+    src->camfd = -1;
+  }
+
+  vpeconv_close (src->session);
+  src->session = NULL;
+
+  return TRUE;
+}
+
+
+static void
+gst_accel_uvc_src_set_property (GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (object);
+  GstVideoFormat format;
+
+  switch (prop_id) {
+    case PROP_DEVICE:
+      GST_OBJECT_LOCK (src);
+      g_free (src->device);
+      src->device = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_VPE_DEVICE:
+      GST_OBJECT_LOCK (src);
+      g_free (src->vpe_device);
+      src->vpe_device = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_CAPTURE_FORMAT:
+      format = gst_video_format_from_string (g_value_get_string (value));
+      if (format == GST_VIDEO_FORMAT_UNKNOWN) {
+        GST_WARNING_OBJECT (src, "unknown format %s",
+            g_value_get_string (value));
+        break;
+      }
+      GST_OBJECT_LOCK (src);
+      src->capture_format = format;
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_CAPTURE_WIDTH:
+      GST_OBJECT_LOCK (src);
+      src->capture_width = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_CAPTURE_HEIGHT:
+      GST_OBJECT_LOCK (src);
+      src->capture_height = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+
+static void
+gst_accel_uvc_src_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (object);
+
+  switch (prop_id) {
+    case PROP_DEVICE:
+      GST_OBJECT_LOCK (src);
+      g_value_set_string (value, src->device);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_VPE_DEVICE:
+      GST_OBJECT_LOCK (src);
+      g_value_set_string (value, src->vpe_device);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_CAPTURE_FORMAT:
+      GST_OBJECT_LOCK (src);
+      g_value_set_string (value,
+          gst_video_format_to_string (src->capture_format));
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_CAPTURE_WIDTH:
+      GST_OBJECT_LOCK (src);
+      g_value_set_uint (value, src->capture_width);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_CAPTURE_HEIGHT:
+      GST_OBJECT_LOCK (src);
+      g_value_set_uint (value, src->capture_height);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_FRAMES_DROPPED:
+      GST_OBJECT_LOCK (src);
+      g_value_set_uint64 (value, src->frames_dropped);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+
+static void
+gst_accel_uvc_src_finalize (GObject *object)
+{
+  GstAccelUvcSrc *src = GST_ACCEL_UVC_SRC_CAST (object);
+
+  g_free (src->device);
+  g_free (src->vpe_device);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static void
+gst_accel_uvc_src_class_init (GstAccelUvcSrcClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  GstPushSrcClass *pushsrc_class = GST_PUSH_SRC_CLASS (klass);
+
+  object_class->set_property = gst_accel_uvc_src_set_property;
+  object_class->get_property = gst_accel_uvc_src_get_property;
+  object_class->finalize = gst_accel_uvc_src_finalize;
+
+  basesrc_class->start = GST_DEBUG_FUNCPTR (gst_accel_uvc_src_start);
+  basesrc_class->stop = GST_DEBUG_FUNCPTR (gst_accel_uvc_src_stop);
+  basesrc_class->set_caps = GST_DEBUG_FUNCPTR (gst_accel_uvc_src_set_caps);
+  basesrc_class->fixate = GST_DEBUG_FUNCPTR (gst_accel_uvc_src_fixate);
+  basesrc_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_accel_uvc_src_decide_allocation);
+  basesrc_class->query = GST_DEBUG_FUNCPTR (gst_accel_uvc_src_query);
+  basesrc_class->unlock = GST_DEBUG_FUNCPTR (gst_accel_uvc_src_unlock);
+  basesrc_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_accel_uvc_src_unlock_stop);
+  pushsrc_class->create = GST_DEBUG_FUNCPTR (gst_accel_uvc_src_create);
+
+  g_object_class_install_property (object_class, PROP_DEVICE,
+    g_param_spec_string ("device", "Device", "UVC camera device node",
+        DEFAULT_DEVICE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+        GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_VPE_DEVICE,
+    g_param_spec_string ("vpe-device", "VPE device", "VPE device node",
+        DEFAULT_VPE_DEVICE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+        GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_CAPTURE_FORMAT,
+    g_param_spec_string ("capture-format", "Capture format",
+        "Pixel format asked from the camera (YUY2, UYVY or NV12)",
+        gst_video_format_to_string (DEFAULT_CAPTURE_FORMAT),
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_CAPTURE_WIDTH,
+    g_param_spec_uint ("capture-width", "Capture width",
+        "Width asked from the camera (0 = the output width)",
+        0, G_MAXINT, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_CAPTURE_HEIGHT,
+    g_param_spec_uint ("capture-height", "Capture height",
+        "Height asked from the camera (0 = the output height)",
+        0, G_MAXINT, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (object_class, PROP_FRAMES_DROPPED,
+    g_param_spec_uint64 ("frames-dropped", "Frames dropped",
+        "Incomplete frames from the camera that were skipped",
+        0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_set_details_simple (element_class,
+    "UVC source with VPE conversion",
+    "Source/Video",
+    "Captures from a UVC camera into CMEM and converts on the VPE",
+    "AUTHOR_NAME AUTHOR_EMAIL");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_factory));
+
+  GST_DEBUG_CATEGORY_INIT (gst_accel_uvc_src_debug, "acceluvcsrc", 0,
+      "acceluvcsrc");
+}
+
+
+static void
+gst_accel_uvc_src_init (GstAccelUvcSrc *src)
+{
+  src->device = g_strdup (DEFAULT_DEVICE);
+  src->vpe_device = g_strdup (DEFAULT_VPE_DEVICE);
+  src->capture_format = DEFAULT_CAPTURE_FORMAT;
+  src->capture_width = 0;
+  src->capture_height = 0;
+  src->camfd = -1;
+  src->session = NULL;
+  src->streaming = FALSE;
+  src->num_capture_bufs = 0;
+  src->flushing = 0;
+  src->frames_dropped = 0;
+
+  /* frames are stamped with the running time they were captured at */
+  gst_base_src_set_live (GST_BASE_SRC (src), TRUE);
+  gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
+  gst_base_src_set_do_timestamp (GST_BASE_SRC (src), TRUE);
+}
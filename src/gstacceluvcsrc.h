@@ -0,0 +1,80 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ACCEL_UVC_SRC_H__
+#define __GST_ACCEL_UVC_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+#include <gst/video/video.h>
+
+#include "gstacceltransform.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ACCEL_UVC_SRC \
+  (gst_accel_uvc_src_get_type())
+#define GST_ACCEL_UVC_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ACCEL_UVC_SRC,GstAccelUvcSrc))
+#define GST_IS_ACCEL_UVC_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ACCEL_UVC_SRC))
+#define GST_ACCEL_UVC_SRC_CAST(obj)  ((GstAccelUvcSrc *)(obj))
+
+typedef struct _GstAccelUvcSrc GstAccelUvcSrc;
+typedef struct _GstAccelUvcSrcClass GstAccelUvcSrcClass;
+
+/* capture buffers the camera fills in turn */
+#define GST_ACCEL_UVC_SRC_CAPTURE_BUFS 4
+
+struct _GstAccelUvcSrc {
+  GstPushSrc element;
+
+  /* properties, guarded by the object lock */
+  gchar *device;
+  gchar *vpe_device;
+  GstVideoFormat capture_format;
+  guint capture_width;
+  guint capture_height;
+
+  gint camfd;
+  vpeconv_session *session;
+
+  /* what the camera delivers and what the VPE makes of it */
+  GstVideoInfo capture_info;
+  GstVideoInfo out_info;
+  guint32 capture_size;
+  guint32 v4l2_out_size;
+  gboolean streaming;
+  gint flushing;              /* atomic, set while unlocked */
+
+  /* the camera writes these, the VPE reads them in place */
+  cmem_buf capture_cbuf[GST_ACCEL_UVC_SRC_CAPTURE_BUFS];
+  guint num_capture_bufs;
+
+  guint64 frames_dropped;     /* by the camera, guarded by the object lock */
+};
+
+struct _GstAccelUvcSrcClass {
+  GstPushSrcClass parent_class;
+};
+
+GType gst_accel_uvc_src_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_ACCEL_UVC_SRC_H__ */
@@ -0,0 +1,316 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstaccelworkers.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_accel_workers_debug);
+#define GST_CAT_DEFAULT gst_accel_workers_debug
+
+/* most threads started for "one per core" */
+#define MAX_WORKERS 32
+
+typedef struct {
+  GstVideoFrame in;
+  GstVideoFrame out;
+  gboolean done;
+} Task;
+
+typedef struct {
+  GstAccelWorkers *workers;
+  GThread *thread;
+  GstVideoConverter *convert;
+} Worker;
+
+struct _GstAccelWorkers {
+  GstVideoInfo in_info;
+  GstVideoInfo out_info;
+  Worker *worker;
+  guint n_workers;
+
+  /* tasks no worker has taken yet, then the stop marker per worker */
+  GAsyncQueue *queue;
+  Task stop;
+
+  /* every task in flight in submit order, guarded by lock; cond is
+   * signalled when one is done */
+  GMutex lock;
+  GCond cond;
+  GQueue tasks;
+};
+
+
+static gpointer
+worker_loop (gpointer data)
+{
+  Worker *w = data;
+  GstAccelWorkers *workers = w->workers;
+  Task *task;
+
+  while ((task = g_async_queue_pop (workers->queue)) != &workers->stop) {
+    gst_video_converter_frame (w->convert, &task->in, &task->out);
+
+    g_mutex_lock (&workers->lock);
+    task->done = TRUE;
+    g_cond_broadcast (&workers->cond);
+    g_mutex_unlock (&workers->lock);
+  }
+
+  return NULL;
+}
+
+
+GstAccelWorkers *
+gst_accel_workers_new (const GstVideoInfo *in_info,
+    const GstVideoInfo *out_info, guint n_workers)
+{
+  static gsize debug_init = 0;
+  GstAccelWorkers *workers;
+  Worker *w;
+  guint i;
+
+  if (g_once_init_enter (&debug_init)) {
+    GST_DEBUG_CATEGORY_INIT (gst_accel_workers_debug, "accelworkers", 0,
+        "CPU conversion workers");
+    g_once_init_leave (&debug_init, 1);
+  }
+
+  if (n_workers == 0)
+    n_workers = CLAMP (g_get_num_processors (), 1, MAX_WORKERS);
+
+  workers = g_new0 (GstAccelWorkers, 1);
+  workers->in_info = *in_info;
+  workers->out_info = *out_info;
+  workers->queue = g_async_queue_new ();
+  g_mutex_init (&workers->lock);
+  g_cond_init (&workers->cond);
+  g_queue_init (&workers->tasks);
+
+  /* the converters keep per-line scratch space, one per thread */
+  workers->worker = g_new0 (Worker, n_workers);
+  for (i = 0; i < n_workers; i++) {
+    w = &workers->worker[i];
+    w->workers = workers;
+    w->convert = gst_video_converter_new (&workers->in_info,
+        &workers->out_info, NULL);
+    if (w->convert == NULL) {
+      GST_WARNING ("can't convert %s to %s",
+          gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (in_info)),
+          gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (out_info)));
+      goto failed;
+    }
+
+    w->thread = g_thread_new ("accelworker", worker_loop, w);
+    workers->n_workers++;
+  }
+
+  GST_DEBUG ("%u worker(s)", workers->n_workers);
+
+  return workers;
+
+failed:
+  gst_accel_workers_free (workers);
+  return NULL;
+}
+
+
+void
+gst_accel_workers_free (GstAccelWorkers *workers)
+{
+  guint i;
+
+  if (workers == NULL)
+    return;
+
+  (void)gst_accel_workers_flush (workers);
+
+  for (i = 0; i < workers->n_workers; i++)
+    g_async_queue_push (workers->queue, &workers->stop);
+  for (i = 0; i < workers->n_workers; i++)
+    g_thread_join (workers->worker[i].thread);
+
+  for (i = 0; i < workers->n_workers; i++)
+    gst_video_converter_free (workers->worker[i].convert);
+  g_free (workers->worker);
+
+  g_async_queue_unref (workers->queue);
+  g_mutex_clear (&workers->lock);
+  g_cond_clear (&workers->cond);
+  g_free (workers);
+}
+
+
+guint
+gst_accel_workers_get_count (GstAccelWorkers *workers)
+{
+  return workers->n_workers;
+}
+
+
+gboolean
+gst_accel_workers_set_crop (GstAccelWorkers *workers, gint x, gint y,
+    gint width, gint height, gint dest_x, gint dest_y, gint dest_width,
+    gint dest_height)
+{
+  GstVideoConverter **convert;
+  GstStructure *config;
+  gboolean ok = TRUE;
+  guint i;
+
+  g_return_val_if_fail (g_queue_is_empty (&workers->tasks), FALSE);
+
+  /* the converters plan their scaling when made, the rectangles can't be
+   * changed on them afterwards */
+  config = gst_structure_new ("GstVideoConverter",
+      GST_VIDEO_CONVERTER_OPT_SRC_X, G_TYPE_INT, x,
+      GST_VIDEO_CONVERTER_OPT_SRC_Y, G_TYPE_INT, y,
+      GST_VIDEO_CONVERTER_OPT_SRC_WIDTH, G_TYPE_INT, width,
+      GST_VIDEO_CONVERTER_OPT_SRC_HEIGHT, G_TYPE_INT, height,
+      GST_VIDEO_CONVERTER_OPT_DEST_X, G_TYPE_INT, dest_x,
+      GST_VIDEO_CONVERTER_OPT_DEST_Y, G_TYPE_INT, dest_y,
+      GST_VIDEO_CONVERTER_OPT_DEST_WIDTH, G_TYPE_INT, dest_width,
+      GST_VIDEO_CONVERTER_OPT_DEST_HEIGHT, G_TYPE_INT, dest_height,
+      GST_VIDEO_CONVERTER_OPT_FILL_BORDER, G_TYPE_BOOLEAN, FALSE, NULL);
+
+  convert = g_new0 (GstVideoConverter *, workers->n_workers);
+  for (i = 0; ok && i < workers->n_workers; i++) {
+    convert[i] = gst_video_converter_new (&workers->in_info,
+        &workers->out_info, gst_structure_copy (config));
+    if (convert[i] == NULL) {
+      GST_WARNING ("can't convert %dx%d+%d+%d to %dx%d+%d+%d", width, height,
+          x, y, dest_width, dest_height, dest_x, dest_y);
+      ok = FALSE;
+    }
+  }
+  gst_structure_free (config);
+
+  /* the workers only touch their converter while they have a task */
+  for (i = 0; i < workers->n_workers; i++) {
+    if (!ok) {
+      if (convert[i])
+        gst_video_converter_free (convert[i]);
+    }
+    else {
+      gst_video_converter_free (workers->worker[i].convert);
+      workers->worker[i].convert = convert[i];
+    }
+  }
+  g_free (convert);
+
+  return ok;
+}
+
+
+gboolean
+gst_accel_workers_submit (GstAccelWorkers *workers, GstBuffer *inbuf,
+    GstBuffer *outbuf)
+{
+  Task *task;
+
+  task = g_new0 (Task, 1);
+
+  /* the mappings hold both buffers until the task is collected */
+  if (!gst_video_frame_map (&task->in, &workers->in_info, inbuf,
+          GST_MAP_READ))
+    goto map_failed;
+  if (!gst_video_frame_map (&task->out, &workers->out_info, outbuf,
+          GST_MAP_WRITE)) {
+    gst_video_frame_unmap (&task->in);
+    goto map_failed;
+  }
+
+  g_mutex_lock (&workers->lock);
+  g_queue_push_tail (&workers->tasks, task);
+  g_mutex_unlock (&workers->lock);
+
+  g_async_queue_push (workers->queue, task);
+
+  return TRUE;
+
+map_failed:
+  GST_WARNING ("could not map the frame");
+  g_free (task);
+  return FALSE;
+}
+
+
+static GstBuffer *
+finish_task (Task *task)
+{
+  GstBuffer *outbuf;
+
+  outbuf = gst_buffer_ref (task->out.buffer);
+  gst_video_frame_unmap (&task->out);
+  gst_video_frame_unmap (&task->in);
+  g_free (task);
+
+  return outbuf;
+}
+
+
+GstBuffer *
+gst_accel_workers_collect (GstAccelWorkers *workers, gboolean wait)
+{
+  Task *task;
+
+  g_mutex_lock (&workers->lock);
+  while ((task = g_queue_peek_head (&workers->tasks)) != NULL &&
+      !task->done && wait)
+    g_cond_wait (&workers->cond, &workers->lock);
+
+  /* a later frame may be done already, it waits for this one */
+  if (task && task->done)
+    g_queue_pop_head (&workers->tasks);
+  else
+    task = NULL;
+  g_mutex_unlock (&workers->lock);
+
+  return task ? finish_task (task) : NULL;
+}
+
+
+guint
+gst_accel_workers_in_flight (GstAccelWorkers *workers)
+{
+  guint n;
+
+  g_mutex_lock (&workers->lock);
+  n = g_queue_get_length (&workers->tasks);
+  g_mutex_unlock (&workers->lock);
+
+  return n;
+}
+
+
+guint
+gst_accel_workers_flush (GstAccelWorkers *workers)
+{
+  GstBuffer *outbuf;
+  guint n = 0;
+
+  /* a conversion can't be stopped half way, let the queue run out */
+  while ((outbuf = gst_accel_workers_collect (workers, TRUE)) != NULL) {
+    gst_buffer_unref (outbuf);
+    n++;
+  }
+
+  return n;
+}
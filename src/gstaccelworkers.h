@@ -0,0 +1,65 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ACCEL_WORKERS_H__
+#define __GST_ACCEL_WORKERS_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Conversion on the CPU when there is no device to do it. Each worker
+ * thread converts whole frames with a converter of its own; the frames
+ * come back in the order they were submitted, however the workers
+ * finish them.
+ */
+typedef struct _GstAccelWorkers GstAccelWorkers;
+
+/* n_workers 0 starts one per core */
+GstAccelWorkers *gst_accel_workers_new (const GstVideoInfo *in_info,
+    const GstVideoInfo *out_info, guint n_workers);
+void gst_accel_workers_free (GstAccelWorkers *workers);
+
+guint gst_accel_workers_get_count (GstAccelWorkers *workers);
+
+/* the part of the input read from now on and the part of the output it
+ * is scaled to, the rest of the output is left alone. Nothing may be in
+ * flight; FALSE when the converters can't be made, they are unchanged. */
+gboolean gst_accel_workers_set_crop (GstAccelWorkers *workers, gint x, gint y,
+    gint width, gint height, gint dest_x, gint dest_y, gint dest_width,
+    gint dest_height);
+
+/* queues a frame, outbuf must be writable and is held until collected */
+gboolean gst_accel_workers_submit (GstAccelWorkers *workers,
+    GstBuffer *inbuf, GstBuffer *outbuf);
+
+/* the oldest frame's output once converted, NULL if nothing is in flight
+ * or, without wait, it isn't done yet */
+GstBuffer *gst_accel_workers_collect (GstAccelWorkers *workers,
+    gboolean wait);
+
+guint gst_accel_workers_in_flight (GstAccelWorkers *workers);
+
+/* waits for the frames being converted and drops them all */
+guint gst_accel_workers_flush (GstAccelWorkers *workers);
+
+G_END_DECLS
+
+#endif /* __GST_ACCEL_WORKERS_H__ */
@@ -0,0 +1,89 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "cmempool.h"
+#include "cmem_buf.h"
+
+static gboolean
+gst_cmem_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstCMemMeta *cmeta = (GstCMemMeta *) meta;
+
+  cmeta->fd = -1;
+  cmeta->phys = 0;
+  cmeta->offset = 0;
+  cmeta->size = 0;
+  cmeta->cache_state = GST_CMEM_CACHE_CPU_DIRTY;
+
+  return TRUE;
+}
+
+GType
+gst_cmem_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  static const gchar *tags[] = { GST_META_TAG_MEMORY_STR, NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register (GST_CMEM_META_API_NAME, tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+/* the meta describes memory, no transform: copies drop it */
+const GstMetaInfo *
+gst_cmem_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_CMEM_META_API_TYPE, "GstCMemMeta",
+        sizeof (GstCMemMeta), gst_cmem_meta_init,
+        (GstMetaFreeFunction) NULL, (GstMetaTransformFunction) NULL);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+GstCMemMeta *
+gst_buffer_add_cmem_meta (GstBuffer * buffer, GstCMemMemory * mem)
+{
+  GstCMemMeta *meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  meta = (GstCMemMeta *) gst_buffer_add_meta (buffer, GST_CMEM_META_INFO, NULL);
+  if (meta == NULL)
+    return NULL;
+
+  meta->fd = mem->fd;
+  meta->phys = cmem_get_phys (mem->data);
+  meta->offset = GST_MEMORY_CAST (mem)->offset;
+  meta->size = GST_MEMORY_CAST (mem)->size;
+
+  /* the memory stays with the pooled buffer, so does the meta */
+  GST_META_FLAG_SET (meta, GST_META_FLAG_POOLED);
+
+  return meta;
+}
@@ -0,0 +1,95 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Public: installed as <gst/accel/gstcmemmeta.h>.
+ *
+ * Buffers backed by CMEM carry a GstCMemMeta, so elements driving other
+ * accelerators (DSP, EVE, ...) can pass the memory on without mapping
+ * or copying it. The meta API is looked up by name, no library has to
+ * be linked.
+ */
+
+#ifndef __GST_CMEM_META_H__
+#define __GST_CMEM_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_CMEM_META_API_NAME "GstCMemMetaAPI"
+
+/**
+ * GstCMemCacheState:
+ * @GST_CMEM_CACHE_CLEAN: CPU caches and memory agree
+ * @GST_CMEM_CACHE_CPU_DIRTY: written by the CPU, flush before a device reads
+ * @GST_CMEM_CACHE_DEVICE_DIRTY: written by a device, invalidate before the
+ *   CPU reads
+ */
+typedef enum {
+  GST_CMEM_CACHE_CLEAN,
+  GST_CMEM_CACHE_CPU_DIRTY,
+  GST_CMEM_CACHE_DEVICE_DIRTY,
+} GstCMemCacheState;
+
+typedef struct _GstCMemMeta GstCMemMeta;
+
+/**
+ * GstCMemMeta:
+ * @meta: parent #GstMeta
+ * @fd: dmabuf fd of the memory, owned by the buffer, do not close
+ * @phys: physical address, 0 when the allocator can't tell
+ * @offset: start of the frame in the dmabuf
+ * @size: size of the frame
+ * @cache_state: who wrote the memory last, update it after writing
+ *
+ * Describes the first memory of a CMEM-backed buffer.
+ */
+struct _GstCMemMeta
+{
+  GstMeta meta;
+
+  gint fd;
+  guint64 phys;
+  gsize offset;
+  gsize size;
+  GstCMemCacheState cache_state;
+};
+
+/* 0 until a CMEM allocator was used in this process, kept once found */
+static inline GType
+gst_cmem_meta_api_lookup (void)
+{
+  static GType api = 0;
+
+  if (G_UNLIKELY (api == 0))
+    api = g_type_from_name (GST_CMEM_META_API_NAME);
+  return api;
+}
+
+static inline GstCMemMeta *
+gst_buffer_get_cmem_meta (GstBuffer * buffer)
+{
+  GType api = gst_cmem_meta_api_lookup ();
+
+  return api ? (GstCMemMeta *) gst_buffer_get_meta (buffer, api) : NULL;
+}
+
+G_END_DECLS
+
+#endif /* __GST_CMEM_META_H__ */
@@ -0,0 +1,200 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <linux/videodev2.h>
+
+#include "v4l2_capture.h"
+#include "v4l2_m2m.h"
+
+#ifdef DEBUG
+#define ERROR(fmt, ...) \
+	do { fprintf(stderr, "ERROR:%s:%d: " fmt "\n", __func__, __LINE__,\
+##__VA_ARGS__); } while (0)
+#else
+#define ERROR(fmt, ...)
+#endif
+
+
+int v4l2_capture_set_format(int devfd, unsigned int *width,
+		unsigned int *height, uint32_t fourcc, unsigned int fps_n,
+		unsigned int fps_d, uint32_t *sizeimage)
+{
+	struct v4l2_format fmt;
+	struct v4l2_streamparm parm;
+	int ret;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.fmt.pix.width = *width;
+	fmt.fmt.pix.height = *height;
+	fmt.fmt.pix.pixelformat = fourcc;
+	fmt.fmt.pix.field = V4L2_FIELD_NONE;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_S_FMT, &fmt);
+	if (ret < 0) {
+		ERROR("VIDIOC_S_FMT failed: %s (%d)", strerror(errno), ret);
+		return -1;
+	}
+
+	if (fmt.fmt.pix.pixelformat != fourcc) {
+		ERROR("format %#x not supported", fourcc);
+		return -1;
+	}
+
+	*width = fmt.fmt.pix.width;
+	*height = fmt.fmt.pix.height;
+	*sizeimage = fmt.fmt.pix.sizeimage;
+
+	if (fps_n == 0)
+		return 0;
+
+	/* not every camera sets its rate, keep whatever it runs at then */
+	memset(&parm, 0, sizeof(parm));
+	parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	parm.parm.capture.timeperframe.numerator = fps_d;
+	parm.parm.capture.timeperframe.denominator = fps_n;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_S_PARM, &parm);
+	if (ret < 0)
+		ERROR("VIDIOC_S_PARM failed: %s (%d)", strerror(errno), ret);
+
+	return 0;
+}
+
+
+int v4l2_capture_request(int devfd, unsigned int num)
+{
+	struct v4l2_requestbuffers reqbuf;
+	int ret;
+
+	memset(&reqbuf, 0, sizeof(reqbuf));
+	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.memory = V4L2_MEMORY_USERPTR;
+	reqbuf.count = num;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_REQBUFS, &reqbuf);
+	if (ret < 0) {
+		ERROR("VIDIOC_REQBUFS failed: %s (%d)", strerror(errno), ret);
+		return -1;
+	}
+
+	/* USERPTR queues take any count, fewer means no support */
+	if (reqbuf.count < num) {
+		ERROR("only %u of %u buffers", reqbuf.count, num);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int v4l2_capture_release(int devfd)
+{
+	struct v4l2_requestbuffers reqbuf;
+	int ret;
+
+	memset(&reqbuf, 0, sizeof(reqbuf));
+	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.memory = V4L2_MEMORY_USERPTR;
+	reqbuf.count = 0;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_REQBUFS, &reqbuf);
+	if (ret < 0)
+		ERROR("VIDIOC_REQBUFS(0) failed: %s (%d)", strerror(errno), ret);
+
+	return ret;
+}
+
+
+int v4l2_capture_queue(int devfd, int buf_idx, void *ptr, uint32_t length)
+{
+	struct v4l2_buffer buffer;
+	int ret;
+
+	memset(&buffer, 0, sizeof(buffer));
+	buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buffer.memory = V4L2_MEMORY_USERPTR;
+	buffer.index = buf_idx;
+	buffer.m.userptr = (unsigned long)ptr;
+	buffer.length = length;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_QBUF, &buffer);
+	if (ret < 0) {
+		ERROR("VIDIOC_QBUF(%p) failed: %s (%d)", ptr, strerror(errno), ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int v4l2_capture_dequeue(int devfd, uint32_t *bytesused)
+{
+	struct v4l2_buffer buffer;
+	int ret;
+
+	memset(&buffer, 0, sizeof(buffer));
+	buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buffer.memory = V4L2_MEMORY_USERPTR;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_DQBUF, &buffer);
+	if (ret < 0) {
+		ERROR("VIDIOC_DQBUF failed: %s (%d)", strerror(errno), ret);
+		return -1;
+	}
+
+	/* a frame the camera only partly sent */
+	if (buffer.flags & V4L2_BUF_FLAG_ERROR)
+		*bytesused = 0;
+	else
+		*bytesused = buffer.bytesused;
+
+	return (int)buffer.index;
+}
+
+
+int v4l2_capture_stream_on(int devfd)
+{
+	uint32_t type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	int ret;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_STREAMON, &type);
+	if (ret)
+		ERROR("VIDIOC_STREAMON failed: %s (%d)", strerror(errno), ret);
+
+	return ret;
+}
+
+
+int v4l2_capture_stream_off(int devfd)
+{
+	uint32_t type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	int ret;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_STREAMOFF, &type);
+	if (ret)
+		ERROR("VIDIOC_STREAMOFF failed: %s (%d)", strerror(errno), ret);
+
+	return ret;
+}
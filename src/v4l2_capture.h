@@ -0,0 +1,40 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Single-planar V4L2 capture devices such as uvcvideo, filling buffers
+ * the caller allocated (V4L2_MEMORY_USERPTR).
+ */
+
+#ifndef V4L2_CAPTURE_H
+#define V4L2_CAPTURE_H
+
+#include <stdint.h>
+
+/* applies the format and frame interval, the driver may adjust both */
+int v4l2_capture_set_format(int devfd, unsigned int *width,
+		unsigned int *height, uint32_t fourcc, unsigned int fps_n,
+		unsigned int fps_d, uint32_t *sizeimage);
+int v4l2_capture_request(int devfd, unsigned int num);
+int v4l2_capture_release(int devfd);
+int v4l2_capture_queue(int devfd, int buf_idx, void *ptr, uint32_t length);
+/* index of the filled buffer, -1 on error */
+int v4l2_capture_dequeue(int devfd, uint32_t *bytesused);
+int v4l2_capture_stream_on(int devfd);
+int v4l2_capture_stream_off(int devfd);
+
+#endif /* V4L2_CAPTURE_H */
@@ -0,0 +1,1256 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <linux/videodev2.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "v4l2_emu.h"
+
+#ifdef DEBUG
+#define ERROR(fmt, ...) \
+	do { fprintf(stderr, "ERROR:%s:%d: " fmt "\n", __func__, __LINE__,\
+##__VA_ARGS__); } while (0)
+#else
+#define ERROR(fmt, ...)
+#endif
+
+#define EMU_DRIVER "vpe-emu"
+#define EMU_VERSION ((1 << 16) | (0 << 8) | 0)
+
+/* what the VPE takes in one job */
+#define EMU_MIN_SIZE 16
+#define EMU_MAX_SIZE 2048
+
+#define EMU_DEFAULT_SETUP_US 300
+#define EMU_DEFAULT_RATE 600
+#define EMU_DEFAULT_DEPTH 8
+#define EMU_MAX_BUFS VIDEO_MAX_FRAME
+
+#define ROUND_UP_2(x) (((x) + 1) & ~1u)
+#define ROUND_UP_4(x) (((x) + 3) & ~3u)
+
+static const uint32_t input_formats[] = {
+	V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY,
+};
+
+static const uint32_t output_formats[] = {
+	V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY,
+	V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_BGR24,
+	V4L2_PIX_FMT_RGB32, V4L2_PIX_FMT_BGR32,
+};
+
+#define N_FORMATS(is_input) ((is_input) ? \
+	sizeof(input_formats) / sizeof(input_formats[0]) : \
+	sizeof(output_formats) / sizeof(output_formats[0]))
+
+enum {
+	BUF_DEQUEUED,
+	BUF_QUEUED,		/* waiting for a job */
+	BUF_ACTIVE,		/* in the running job */
+	BUF_DONE,		/* waiting for DQBUF */
+};
+
+struct emu_buffer {
+	int state;
+	uint32_t flags;
+	int fd;
+	void *ptr;
+	uint32_t length;
+};
+
+/* buffer indices in the order they came */
+struct emu_ring {
+	unsigned int idx[EMU_MAX_BUFS];
+	unsigned int head;
+	unsigned int count;
+};
+
+struct emu_queue {
+	uint32_t type;
+	uint32_t fourcc;
+	uint32_t colorspace;
+	unsigned int width;
+	unsigned int height;
+	unsigned int stride;
+	uint32_t sizeimage;
+
+	uint32_t memory;
+	unsigned int count;
+	int streaming;
+	struct emu_buffer buf[EMU_MAX_BUFS];
+	struct emu_ring queued;
+	struct emu_ring done;
+};
+
+struct emu_device;
+
+/* what an open of the device returns, a mem2mem context */
+struct v4l2_emu {
+	struct emu_device *dev;
+	int fd;				/* readable while capture buffers are done */
+	struct emu_queue q[2];		/* indexed by is_input */
+	struct v4l2_rect crop;
+	struct v4l2_rect compose;
+	int busy;			/* the device runs a job of this context */
+	pthread_cond_t cond;		/* signalled when a job is done */
+	struct v4l2_emu *next;
+};
+
+struct emu_device {
+	char *name;
+	unsigned int setup_us;
+	unsigned int rate;		/* MB/s */
+	unsigned int depth;
+	int report;
+
+	/* the context served last is at the tail */
+	struct v4l2_emu *contexts;
+	pthread_t thread;
+	pthread_cond_t cond;		/* signalled when a job may be ready */
+	int quit;
+
+	uint64_t opened_ns;
+	uint64_t busy_ns;
+	unsigned int jobs;
+	unsigned int late;
+	struct emu_device *next;
+};
+
+/* one side of a job, the buffer mapped while it runs */
+struct emu_frame {
+	uint32_t fourcc;
+	unsigned int width;
+	unsigned int height;
+	unsigned int stride;
+	int fd;
+	uint32_t length;
+	uint8_t *data;
+	void *map;			/* NULL for a USERPTR buffer */
+};
+
+struct emu_job {
+	struct emu_frame in;
+	struct emu_frame out;
+	struct v4l2_rect crop;
+	struct v4l2_rect compose;
+	uint64_t model_ns;
+	uint64_t took_ns;
+	int late;
+	int error;
+};
+
+/* one lock for every emulated device and context */
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct emu_device *devices;
+
+
+static uint64_t emu_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void ring_push(struct emu_ring *r, unsigned int idx)
+{
+	r->idx[(r->head + r->count) % EMU_MAX_BUFS] = idx;
+	r->count++;
+}
+
+
+static unsigned int ring_pop(struct emu_ring *r)
+{
+	unsigned int idx = r->idx[r->head];
+
+	r->head = (r->head + 1) % EMU_MAX_BUFS;
+	r->count--;
+	return idx;
+}
+
+
+static int is_supported(uint32_t fourcc, int is_input)
+{
+	const uint32_t *fmts = is_input ? input_formats : output_formats;
+	unsigned int i;
+
+	for (i = 0; i < N_FORMATS(is_input); i++)
+		if (fmts[i] == fourcc)
+			return 1;
+	return 0;
+}
+
+
+/* GStreamer's default layout, which the elements map the buffers with */
+static void get_layout(uint32_t fourcc, unsigned int width,
+		unsigned int height, unsigned int *stride, uint32_t *sizeimage)
+{
+	switch (fourcc) {
+	case V4L2_PIX_FMT_NV12:
+		*stride = ROUND_UP_4(width);
+		*sizeimage = *stride * ROUND_UP_2(height) * 3 / 2;
+		return;
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_UYVY:
+		*stride = ROUND_UP_4(ROUND_UP_2(width) * 2);
+		break;
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		*stride = ROUND_UP_4(width * 3);
+		break;
+	default:
+		*stride = width * 4;
+		break;
+	}
+	*sizeimage = *stride * height;
+}
+
+
+static unsigned int bits_per_pixel(uint32_t fourcc)
+{
+	switch (fourcc) {
+	case V4L2_PIX_FMT_NV12:
+		return 12;
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_UYVY:
+		return 16;
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		return 24;
+	default:
+		return 32;
+	}
+}
+
+
+static unsigned int clamp_size(unsigned int size)
+{
+	if (size < EMU_MIN_SIZE)
+		return EMU_MIN_SIZE;
+	if (size > EMU_MAX_SIZE)
+		return EMU_MAX_SIZE;
+	return size;
+}
+
+
+static struct emu_queue *get_queue(struct v4l2_emu *emu, uint32_t type)
+{
+	if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE)
+		return &emu->q[1];
+	if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+		return &emu->q[0];
+	return NULL;
+}
+
+
+/* the format the driver makes of fmt, like the VPE it falls back to
+ * its first format and clamps the size; a longer line than the format
+ * needs is kept, for a strip of a wider frame */
+static void try_format(struct emu_queue *q, struct v4l2_format *fmt)
+{
+	struct v4l2_pix_format_mplane *pix = &fmt->fmt.pix_mp;
+	int is_input = q->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	unsigned int stride, requested;
+	uint32_t sizeimage;
+
+	if (!is_supported(pix->pixelformat, is_input))
+		pix->pixelformat = is_input ? input_formats[0] : output_formats[0];
+	pix->width = clamp_size(pix->width);
+	pix->height = clamp_size(pix->height);
+	pix->field = V4L2_FIELD_NONE;
+	if (pix->colorspace == 0)
+		pix->colorspace = V4L2_COLORSPACE_SMPTE170M;
+
+	requested = pix->plane_fmt[0].bytesperline;
+	get_layout(pix->pixelformat, pix->width, pix->height, &stride,
+			&sizeimage);
+	if (requested > stride) {
+		sizeimage = sizeimage / stride * requested;
+		stride = requested;
+	}
+	pix->num_planes = 1;
+	memset(pix->plane_fmt, 0, sizeof(pix->plane_fmt));
+	pix->plane_fmt[0].bytesperline = stride;
+	pix->plane_fmt[0].sizeimage = sizeimage;
+}
+
+
+static void get_format(struct emu_queue *q, struct v4l2_format *fmt)
+{
+	struct v4l2_pix_format_mplane *pix = &fmt->fmt.pix_mp;
+
+	memset(&fmt->fmt, 0, sizeof(fmt->fmt));
+	pix->width = q->width;
+	pix->height = q->height;
+	pix->pixelformat = q->fourcc;
+	pix->colorspace = q->colorspace;
+	pix->field = V4L2_FIELD_NONE;
+	pix->num_planes = 1;
+	pix->plane_fmt[0].bytesperline = q->stride;
+	pix->plane_fmt[0].sizeimage = q->sizeimage;
+}
+
+
+static void set_format(struct v4l2_emu *emu, struct emu_queue *q,
+		const struct v4l2_format *fmt)
+{
+	const struct v4l2_pix_format_mplane *pix = &fmt->fmt.pix_mp;
+
+	q->fourcc = pix->pixelformat;
+	q->colorspace = pix->colorspace;
+	q->width = pix->width;
+	q->height = pix->height;
+	q->stride = pix->plane_fmt[0].bytesperline;
+	q->sizeimage = pix->plane_fmt[0].sizeimage;
+
+	/* a new format reads or writes the whole frame again */
+	if (q == &emu->q[1]) {
+		emu->crop.left = emu->crop.top = 0;
+		emu->crop.width = q->width;
+		emu->crop.height = q->height;
+	}
+	else {
+		emu->compose.left = emu->compose.top = 0;
+		emu->compose.width = q->width;
+		emu->compose.height = q->height;
+	}
+}
+
+
+static int querycap(struct v4l2_capability *cap)
+{
+	memset(cap, 0, sizeof(*cap));
+	snprintf((char *)cap->driver, sizeof(cap->driver), "%s", EMU_DRIVER);
+	snprintf((char *)cap->card, sizeof(cap->card), "VPE emulator");
+	snprintf((char *)cap->bus_info, sizeof(cap->bus_info),
+			"platform:%s", EMU_DRIVER);
+	cap->version = EMU_VERSION;
+	cap->device_caps = V4L2_CAP_VIDEO_M2M_MPLANE | V4L2_CAP_STREAMING;
+	cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+	return 0;
+}
+
+
+static int enum_fmt(struct v4l2_fmtdesc *desc)
+{
+	int is_input;
+	uint32_t fourcc;
+
+	if (desc->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE)
+		is_input = 1;
+	else if (desc->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+		is_input = 0;
+	else
+		return EINVAL;
+
+	if (desc->index >= N_FORMATS(is_input))
+		return EINVAL;
+
+	fourcc = is_input ? input_formats[desc->index] :
+		output_formats[desc->index];
+	desc->flags = 0;
+	desc->pixelformat = fourcc;
+	snprintf((char *)desc->description, sizeof(desc->description),
+			"%c%c%c%c", fourcc & 0xff, (fourcc >> 8) & 0xff,
+			(fourcc >> 16) & 0xff, fourcc >> 24);
+	return 0;
+}
+
+
+static int s_fmt(struct v4l2_emu *emu, struct v4l2_format *fmt, int apply)
+{
+	struct emu_queue *q = get_queue(emu, fmt->type);
+
+	if (q == NULL)
+		return EINVAL;
+
+	if (!apply) {
+		try_format(q, fmt);
+		return 0;
+	}
+
+	/* the format of a queue with buffers is fixed */
+	if (q->count > 0)
+		return EBUSY;
+
+	try_format(q, fmt);
+	set_format(emu, q, fmt);
+	return 0;
+}
+
+
+static int g_fmt(struct v4l2_emu *emu, struct v4l2_format *fmt)
+{
+	struct emu_queue *q = get_queue(emu, fmt->type);
+
+	if (q == NULL)
+		return EINVAL;
+
+	get_format(q, fmt);
+	return 0;
+}
+
+
+static int reqbufs(struct v4l2_emu *emu, struct v4l2_requestbuffers *req)
+{
+	struct emu_queue *q = get_queue(emu, req->type);
+	unsigned int i;
+
+	if (q == NULL)
+		return EINVAL;
+	if (req->memory != V4L2_MEMORY_DMABUF &&
+			req->memory != V4L2_MEMORY_USERPTR)
+		return EINVAL;
+	if (q->streaming)
+		return EBUSY;
+
+	/* fewer than asked for when the queue is shallower */
+	q->count = req->count < emu->dev->depth ? req->count :
+		emu->dev->depth;
+	q->memory = req->memory;
+	memset(q->buf, 0, sizeof(q->buf));
+	for (i = 0; i < EMU_MAX_BUFS; i++)
+		q->buf[i].fd = -1;
+	memset(&q->queued, 0, sizeof(q->queued));
+	memset(&q->done, 0, sizeof(q->done));
+
+	req->count = q->count;
+	return 0;
+}
+
+
+static int check_buffer(struct emu_queue *q, const struct v4l2_buffer *vbuf)
+{
+	if (q == NULL || vbuf->index >= q->count ||
+			vbuf->m.planes == NULL || vbuf->length < 1)
+		return EINVAL;
+	return 0;
+}
+
+
+static uint32_t buffer_flags(const struct emu_buffer *b)
+{
+	switch (b->state) {
+	case BUF_QUEUED:
+	case BUF_ACTIVE:
+		return V4L2_BUF_FLAG_QUEUED;
+	case BUF_DONE:
+		return V4L2_BUF_FLAG_DONE | b->flags;
+	default:
+		return b->flags;
+	}
+}
+
+
+static int querybuf(struct v4l2_emu *emu, struct v4l2_buffer *vbuf)
+{
+	struct emu_queue *q = get_queue(emu, vbuf->type);
+	int err;
+
+	err = check_buffer(q, vbuf);
+	if (err)
+		return err;
+
+	vbuf->memory = q->memory;
+	vbuf->flags = buffer_flags(&q->buf[vbuf->index]);
+	vbuf->length = 1;
+	vbuf->m.planes[0].length = q->sizeimage;
+	return 0;
+}
+
+
+static int qbuf(struct v4l2_emu *emu, struct v4l2_buffer *vbuf)
+{
+	struct emu_queue *q = get_queue(emu, vbuf->type);
+	struct v4l2_plane *plane;
+	struct emu_buffer *b;
+	int err;
+
+	err = check_buffer(q, vbuf);
+	if (err)
+		return err;
+	if (vbuf->memory != q->memory)
+		return EINVAL;
+
+	b = &q->buf[vbuf->index];
+	plane = &vbuf->m.planes[0];
+	if (b->state != BUF_DEQUEUED || plane->length < q->sizeimage)
+		return EINVAL;
+
+	if (q->memory == V4L2_MEMORY_USERPTR) {
+		if (plane->m.userptr == 0)
+			return EFAULT;
+		b->ptr = (void *)plane->m.userptr;
+		b->fd = -1;
+	}
+	else {
+		if (plane->m.fd < 0)
+			return EINVAL;
+		b->ptr = NULL;
+		b->fd = plane->m.fd;
+	}
+
+	b->length = plane->length;
+	b->flags = 0;
+	b->state = BUF_QUEUED;
+	ring_push(&q->queued, vbuf->index);
+
+	pthread_cond_signal(&emu->dev->cond);
+	return 0;
+}
+
+
+static int dqbuf(struct v4l2_emu *emu, struct v4l2_buffer *vbuf)
+{
+	struct emu_queue *q = get_queue(emu, vbuf->type);
+	struct emu_buffer *b;
+	unsigned int index;
+	uint64_t val;
+
+	if (q == NULL || vbuf->m.planes == NULL || vbuf->length < 1 ||
+			vbuf->memory != q->memory)
+		return EINVAL;
+
+	/* the node is opened blocking */
+	while (q->streaming && q->done.count == 0)
+		pthread_cond_wait(&emu->cond, &emu_lock);
+	if (!q->streaming)
+		return EINVAL;
+
+	index = ring_pop(&q->done);
+	b = &q->buf[index];
+	b->state = BUF_DEQUEUED;
+
+	if (q == &emu->q[0] && read(emu->fd, &val, sizeof(val)) < 0)
+		ERROR("eventfd read failed: %s", strerror(errno));
+
+	vbuf->index = index;
+	vbuf->flags = b->flags;
+	vbuf->field = V4L2_FIELD_NONE;
+	vbuf->length = 1;
+	vbuf->m.planes[0].length = b->length;
+	vbuf->m.planes[0].bytesused = q->sizeimage;
+	if (q->memory == V4L2_MEMORY_USERPTR)
+		vbuf->m.planes[0].m.userptr = (unsigned long)b->ptr;
+	else
+		vbuf->m.planes[0].m.fd = b->fd;
+	return 0;
+}
+
+
+static int stream_on(struct v4l2_emu *emu, const uint32_t *type)
+{
+	struct emu_queue *q = get_queue(emu, *type);
+
+	if (q == NULL || q->count == 0)
+		return EINVAL;
+
+	q->streaming = 1;
+	pthread_cond_signal(&emu->dev->cond);
+	return 0;
+}
+
+
+/* gives back every buffer, after the running job is done with them */
+static int stream_off(struct v4l2_emu *emu, const uint32_t *type)
+{
+	struct emu_queue *q = get_queue(emu, *type);
+	uint64_t val;
+	unsigned int i;
+
+	if (q == NULL)
+		return EINVAL;
+
+	while (emu->busy)
+		pthread_cond_wait(&emu->cond, &emu_lock);
+
+	if (q == &emu->q[0])
+		for (i = 0; i < q->done.count; i++)
+			(void)read(emu->fd, &val, sizeof(val));
+
+	for (i = 0; i < q->count; i++)
+		q->buf[i].state = BUF_DEQUEUED;
+	memset(&q->queued, 0, sizeof(q->queued));
+	memset(&q->done, 0, sizeof(q->done));
+	q->streaming = 0;
+
+	/* a DQBUF waiting on this queue fails */
+	pthread_cond_broadcast(&emu->cond);
+	return 0;
+}
+
+
+/* the crop of the input or the compose of the output */
+static int s_selection(struct v4l2_emu *emu, struct v4l2_selection *sel)
+{
+	struct emu_queue *q;
+	struct v4l2_rect *r = &sel->r;
+
+	if ((sel->type == V4L2_BUF_TYPE_VIDEO_OUTPUT ||
+			sel->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) &&
+			sel->target == V4L2_SEL_TGT_CROP)
+		q = &emu->q[1];
+	else if ((sel->type == V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+			sel->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) &&
+			sel->target == V4L2_SEL_TGT_COMPOSE)
+		q = &emu->q[0];
+	else
+		return EINVAL;
+
+	/* kept inside the frame, as the VPE does */
+	if (r->left < 0)
+		r->left = 0;
+	if (r->top < 0)
+		r->top = 0;
+	if (r->left > (int)(q->width - EMU_MIN_SIZE))
+		r->left = q->width - EMU_MIN_SIZE;
+	if (r->top > (int)(q->height - EMU_MIN_SIZE))
+		r->top = q->height - EMU_MIN_SIZE;
+	if (r->width < EMU_MIN_SIZE)
+		r->width = EMU_MIN_SIZE;
+	if (r->height < EMU_MIN_SIZE)
+		r->height = EMU_MIN_SIZE;
+	if (r->width > q->width - r->left)
+		r->width = q->width - r->left;
+	if (r->height > q->height - r->top)
+		r->height = q->height - r->top;
+
+	if (q == &emu->q[1])
+		emu->crop = *r;
+	else
+		emu->compose = *r;
+	return 0;
+}
+
+
+int v4l2_emu_ioctl(struct v4l2_emu *emu, unsigned long request, void *arg)
+{
+	int err;
+
+	pthread_mutex_lock(&emu_lock);
+
+	switch (request) {
+	case VIDIOC_QUERYCAP:
+		err = querycap(arg);
+		break;
+	case VIDIOC_ENUM_FMT:
+		err = enum_fmt(arg);
+		break;
+	case VIDIOC_TRY_FMT:
+		err = s_fmt(emu, arg, 0);
+		break;
+	case VIDIOC_S_FMT:
+		err = s_fmt(emu, arg, 1);
+		break;
+	case VIDIOC_G_FMT:
+		err = g_fmt(emu, arg);
+		break;
+	case VIDIOC_REQBUFS:
+		err = reqbufs(emu, arg);
+		break;
+	case VIDIOC_QUERYBUF:
+		err = querybuf(emu, arg);
+		break;
+	case VIDIOC_QBUF:
+		err = qbuf(emu, arg);
+		break;
+	case VIDIOC_DQBUF:
+		err = dqbuf(emu, arg);
+		break;
+	case VIDIOC_STREAMON:
+		err = stream_on(emu, arg);
+		break;
+	case VIDIOC_STREAMOFF:
+		err = stream_off(emu, arg);
+		break;
+	case VIDIOC_S_SELECTION:
+		err = s_selection(emu, arg);
+		break;
+	default:
+		/* VIDIOC_ENUM_FRAMESIZES among them, like the VPE */
+		err = ENOTTY;
+		break;
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+
+/*
+ * The software conversion: nearest neighbour from the crop into the
+ * compose rectangle, BT.601 limited range to RGB.
+ */
+
+static inline uint8_t clamp_8(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+
+static inline void read_yuv(const struct emu_frame *f, unsigned int x,
+		unsigned int y, uint8_t yuv[3])
+{
+	const uint8_t *p = f->data + (size_t)y * f->stride;
+
+	switch (f->fourcc) {
+	case V4L2_PIX_FMT_NV12:
+		yuv[0] = p[x];
+		p = f->data + (size_t)f->stride * ROUND_UP_2(f->height) +
+			(size_t)(y / 2) * f->stride + (x & ~1u);
+		yuv[1] = p[0];
+		yuv[2] = p[1];
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		p += (x & ~1u) * 2;
+		yuv[0] = p[(x & 1) * 2];
+		yuv[1] = p[1];
+		yuv[2] = p[3];
+		break;
+	default:
+		p += (x & ~1u) * 2;
+		yuv[0] = p[(x & 1) * 2 + 1];
+		yuv[1] = p[0];
+		yuv[2] = p[2];
+		break;
+	}
+}
+
+
+static inline void write_pixel(const struct emu_frame *f, unsigned int x,
+		unsigned int y, const uint8_t yuv[3])
+{
+	uint8_t *p = f->data + (size_t)y * f->stride;
+	int c, d, e;
+	uint8_t r, g, b;
+
+	switch (f->fourcc) {
+	case V4L2_PIX_FMT_NV12:
+		p[x] = yuv[0];
+		if ((x | y) & 1)
+			return;
+		p = f->data + (size_t)f->stride * ROUND_UP_2(f->height) +
+			(size_t)(y / 2) * f->stride + x;
+		p[0] = yuv[1];
+		p[1] = yuv[2];
+		return;
+	case V4L2_PIX_FMT_YUYV:
+		p += (x & ~1u) * 2;
+		p[(x & 1) * 2] = yuv[0];
+		if (!(x & 1)) {
+			p[1] = yuv[1];
+			p[3] = yuv[2];
+		}
+		return;
+	case V4L2_PIX_FMT_UYVY:
+		p += (x & ~1u) * 2;
+		p[(x & 1) * 2 + 1] = yuv[0];
+		if (!(x & 1)) {
+			p[0] = yuv[1];
+			p[2] = yuv[2];
+		}
+		return;
+	}
+
+	c = 298 * (yuv[0] - 16);
+	d = yuv[1] - 128;
+	e = yuv[2] - 128;
+	r = clamp_8((c + 409 * e + 128) >> 8);
+	g = clamp_8((c - 100 * d - 208 * e + 128) >> 8);
+	b = clamp_8((c + 516 * d + 128) >> 8);
+
+	/* the 32 bit formats as the elements map them, alpha first */
+	switch (f->fourcc) {
+	case V4L2_PIX_FMT_RGB24:
+		p += x * 3;
+		p[0] = r;
+		p[1] = g;
+		p[2] = b;
+		break;
+	case V4L2_PIX_FMT_BGR24:
+		p += x * 3;
+		p[0] = b;
+		p[1] = g;
+		p[2] = r;
+		break;
+	case V4L2_PIX_FMT_RGB32:
+		p += x * 4;
+		p[0] = 0xff;
+		p[1] = r;
+		p[2] = g;
+		p[3] = b;
+		break;
+	default:
+		p += x * 4;
+		p[0] = 0xff;
+		p[1] = b;
+		p[2] = g;
+		p[3] = r;
+		break;
+	}
+}
+
+
+static void convert(const struct emu_frame *in, const struct emu_frame *out,
+		const struct v4l2_rect *crop, const struct v4l2_rect *compose)
+{
+	unsigned int sx[EMU_MAX_SIZE];
+	unsigned int x, y, sy;
+	uint8_t yuv[3];
+
+	for (x = 0; x < compose->width; x++)
+		sx[x] = crop->left + x * crop->width / compose->width;
+
+	for (y = 0; y < compose->height; y++) {
+		sy = crop->top + y * crop->height / compose->height;
+		for (x = 0; x < compose->width; x++) {
+			read_yuv(in, sx[x], sy, yuv);
+			write_pixel(out, compose->left + x, compose->top + y,
+					yuv);
+		}
+	}
+}
+
+
+static void frame_setup(struct emu_frame *f, const struct emu_queue *q,
+		const struct emu_buffer *b)
+{
+	memset(f, 0, sizeof(*f));
+	f->fourcc = q->fourcc;
+	f->width = q->width;
+	f->height = q->height;
+	f->stride = q->stride;
+	f->fd = b->fd;
+	f->length = b->length;
+	f->data = b->ptr;
+}
+
+
+static int frame_map(struct emu_frame *f, int prot)
+{
+	if (f->data)
+		return 0;
+
+	f->map = mmap(NULL, f->length, prot, MAP_SHARED, f->fd, 0);
+	if (f->map == MAP_FAILED) {
+		ERROR("can't map dmabuf %d: %s", f->fd, strerror(errno));
+		f->map = NULL;
+		return -1;
+	}
+
+	f->data = f->map;
+	return 0;
+}
+
+
+static void frame_unmap(struct emu_frame *f)
+{
+	if (f->map)
+		munmap(f->map, f->length);
+	f->map = NULL;
+}
+
+
+/* the time the VPE takes: a fixed setup, then the bytes it moves */
+static uint64_t model_time(const struct emu_device *dev,
+		const struct emu_job *job)
+{
+	uint64_t bytes;
+
+	bytes = ((uint64_t)job->crop.width * job->crop.height *
+			bits_per_pixel(job->in.fourcc) +
+		(uint64_t)job->compose.width * job->compose.height *
+			bits_per_pixel(job->out.fourcc)) / 8;
+
+	return dev->setup_us * 1000ULL + bytes * 1000 / dev->rate;
+}
+
+
+static void run_job(struct emu_device *dev, struct emu_job *job)
+{
+	struct timespec ts;
+	uint64_t start, deadline;
+
+	start = emu_now();
+	job->model_ns = model_time(dev, job);
+	deadline = start + job->model_ns;
+
+	if (frame_map(&job->in, PROT_READ) < 0 ||
+			frame_map(&job->out, PROT_READ | PROT_WRITE) < 0)
+		job->error = 1;
+	else
+		convert(&job->in, &job->out, &job->crop, &job->compose);
+	frame_unmap(&job->in);
+	frame_unmap(&job->out);
+
+	/* the frame is done when the hardware would be, not before */
+	if (emu_now() > deadline) {
+		job->late = 1;
+	}
+	else {
+		ts.tv_sec = deadline / 1000000000ULL;
+		ts.tv_nsec = deadline % 1000000000ULL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+					NULL) == EINTR)
+			;
+	}
+
+	job->took_ns = emu_now() - start;
+}
+
+
+/* the next context with a buffer on both queues, moved to the tail so
+ * the contexts take turns */
+static struct v4l2_emu *next_job(struct emu_device *dev)
+{
+	struct v4l2_emu **link, *emu;
+
+	for (link = &dev->contexts; (emu = *link) != NULL; link = &emu->next) {
+		if (!emu->q[0].streaming || !emu->q[1].streaming ||
+				emu->q[0].queued.count == 0 ||
+				emu->q[1].queued.count == 0)
+			continue;
+
+		*link = emu->next;
+		emu->next = NULL;
+		for (link = &dev->contexts; *link; link = &(*link)->next)
+			;
+		*link = emu;
+		return emu;
+	}
+
+	return NULL;
+}
+
+
+static void finish_side(struct emu_queue *q, unsigned int index, int error)
+{
+	struct emu_buffer *b = &q->buf[index];
+
+	b->state = BUF_DONE;
+	b->flags = error ? V4L2_BUF_FLAG_ERROR : 0;
+	ring_push(&q->done, index);
+}
+
+
+static void *emu_run(void *data)
+{
+	struct emu_device *dev = data;
+	struct v4l2_emu *emu;
+	struct emu_job job;
+	unsigned int in_idx, out_idx;
+	uint64_t val = 1;
+
+	pthread_mutex_lock(&emu_lock);
+
+	while (!dev->quit) {
+		emu = next_job(dev);
+		if (emu == NULL) {
+			pthread_cond_wait(&dev->cond, &emu_lock);
+			continue;
+		}
+
+		in_idx = ring_pop(&emu->q[1].queued);
+		out_idx = ring_pop(&emu->q[0].queued);
+		emu->q[1].buf[in_idx].state = BUF_ACTIVE;
+		emu->q[0].buf[out_idx].state = BUF_ACTIVE;
+
+		memset(&job, 0, sizeof(job));
+		frame_setup(&job.in, &emu->q[1], &emu->q[1].buf[in_idx]);
+		frame_setup(&job.out, &emu->q[0], &emu->q[0].buf[out_idx]);
+		job.crop = emu->crop;
+		job.compose = emu->compose;
+		emu->busy = 1;
+
+		pthread_mutex_unlock(&emu_lock);
+		run_job(dev, &job);
+		pthread_mutex_lock(&emu_lock);
+
+		dev->jobs++;
+		dev->busy_ns += job.took_ns;
+		if (job.late)
+			dev->late++;
+
+		finish_side(&emu->q[1], in_idx, job.error);
+		finish_side(&emu->q[0], out_idx, job.error);
+		if (write(emu->fd, &val, sizeof(val)) < 0)
+			ERROR("eventfd write failed: %s", strerror(errno));
+
+		emu->busy = 0;
+		pthread_cond_broadcast(&emu->cond);
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+	return NULL;
+}
+
+
+int v4l2_emu_match(const char *device)
+{
+	size_t len = strlen(V4L2_EMU_NAME);
+
+	return strncmp(device, V4L2_EMU_NAME, len) == 0 &&
+		(device[len] == '\0' || device[len] == ':');
+}
+
+
+static int parse_options(struct emu_device *dev)
+{
+	char *opts, *opt, *value, *end, *save = NULL;
+	unsigned long val;
+
+	dev->setup_us = EMU_DEFAULT_SETUP_US;
+	dev->rate = EMU_DEFAULT_RATE;
+	dev->depth = EMU_DEFAULT_DEPTH;
+
+	opts = strdup(dev->name + strlen(V4L2_EMU_NAME));
+	if (opts == NULL)
+		return -1;
+
+	for (opt = strtok_r(opts, ":", &save); opt;
+			opt = strtok_r(NULL, ":", &save)) {
+		if (strcmp(opt, "report") == 0) {
+			dev->report = 1;
+			continue;
+		}
+
+		value = strchr(opt, '=');
+		if (value == NULL)
+			goto invalid;
+		*value++ = '\0';
+
+		errno = 0;
+		val = strtoul(value, &end, 10);
+		if (errno || end == value || *end != '\0' || val > UINT32_MAX)
+			goto invalid;
+
+		if (strcmp(opt, "setup") == 0)
+			dev->setup_us = val;
+		else if (strcmp(opt, "rate") == 0 && val > 0)
+			dev->rate = val;
+		else if (strcmp(opt, "depth") == 0 && val > 0 &&
+				val <= EMU_MAX_BUFS)
+			dev->depth = val;
+		else
+			goto invalid;
+	}
+
+	free(opts);
+	return 0;
+
+invalid:
+	ERROR("bad option %s in %s", opt, dev->name);
+	free(opts);
+	errno = EINVAL;
+	return -1;
+}
+
+
+static void free_device(struct emu_device *dev)
+{
+	pthread_cond_destroy(&dev->cond);
+	free(dev->name);
+	free(dev);
+}
+
+
+/* the device contexts opened with this name share, called locked */
+static struct emu_device *get_device(const char *device)
+{
+	struct emu_device *dev;
+	int ret;
+
+	for (dev = devices; dev; dev = dev->next)
+		if (strcmp(dev->name, device) == 0)
+			return dev;
+
+	dev = calloc(1, sizeof(*dev));
+	if (dev == NULL)
+		return NULL;
+
+	dev->name = strdup(device);
+	pthread_cond_init(&dev->cond, NULL);
+	if (dev->name == NULL || parse_options(dev) < 0)
+		goto failed;
+
+	dev->opened_ns = emu_now();
+	ret = pthread_create(&dev->thread, NULL, emu_run, dev);
+	if (ret) {
+		errno = ret;
+		goto failed;
+	}
+
+	dev->next = devices;
+	devices = dev;
+	return dev;
+
+failed:
+	free_device(dev);
+	return NULL;
+}
+
+
+static void init_queue(struct v4l2_emu *emu, struct emu_queue *q,
+		uint32_t type)
+{
+	struct v4l2_format fmt;
+	unsigned int i;
+
+	q->type = type;
+	for (i = 0; i < EMU_MAX_BUFS; i++)
+		q->buf[i].fd = -1;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = type;
+	fmt.fmt.pix_mp.width = 1280;
+	fmt.fmt.pix_mp.height = 720;
+	try_format(q, &fmt);
+	set_format(emu, q, &fmt);
+}
+
+
+int v4l2_emu_open(const char *device)
+{
+	struct v4l2_emu *emu, **link;
+	struct emu_device *dev;
+	int err;
+
+	emu = calloc(1, sizeof(*emu));
+	if (emu == NULL)
+		return -1;
+
+	emu->fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+	if (emu->fd < 0) {
+		free(emu);
+		return -1;
+	}
+
+	init_queue(emu, &emu->q[0], V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+	init_queue(emu, &emu->q[1], V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE);
+	pthread_cond_init(&emu->cond, NULL);
+
+	pthread_mutex_lock(&emu_lock);
+	dev = get_device(device);
+	if (dev) {
+		emu->dev = dev;
+		for (link = &dev->contexts; *link; link = &(*link)->next)
+			;
+		*link = emu;
+	}
+	pthread_mutex_unlock(&emu_lock);
+
+	if (dev == NULL) {
+		err = errno;
+		ERROR("can't open %s: %s", device, strerror(err));
+		pthread_cond_destroy(&emu->cond);
+		close(emu->fd);
+		free(emu);
+		errno = err;
+		return -1;
+	}
+
+	return emu->fd;
+}
+
+
+struct v4l2_emu *v4l2_emu_get(int devfd)
+{
+	struct emu_device *dev;
+	struct v4l2_emu *emu = NULL;
+
+	pthread_mutex_lock(&emu_lock);
+	for (dev = devices; dev && emu == NULL; dev = dev->next)
+		for (emu = dev->contexts; emu; emu = emu->next)
+			if (emu->fd == devfd)
+				break;
+	pthread_mutex_unlock(&emu_lock);
+
+	return emu;
+}
+
+
+static void report(const struct emu_device *dev)
+{
+	uint64_t span = emu_now() - dev->opened_ns;
+
+	fprintf(stderr, "%s: %u jobs, busy %.1f%% of %.3f s, "
+			"%u converted slower than the model\n",
+			dev->name, dev->jobs,
+			span ? 100.0 * dev->busy_ns / span : 0.0,
+			span / 1e9, dev->late);
+}
+
+
+void v4l2_emu_close(struct v4l2_emu *emu)
+{
+	struct emu_device *dev = emu->dev, **dlink;
+	struct v4l2_emu **link;
+	uint32_t type;
+
+	pthread_mutex_lock(&emu_lock);
+
+	type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	(void)stream_off(emu, &type);
+	type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	(void)stream_off(emu, &type);
+
+	for (link = &dev->contexts; *link != emu; link = &(*link)->next)
+		;
+	*link = emu->next;
+
+	/* the last context stops the device */
+	if (dev->contexts == NULL) {
+		for (dlink = &devices; *dlink != dev; dlink = &(*dlink)->next)
+			;
+		*dlink = dev->next;
+		dev->quit = 1;
+		pthread_cond_signal(&dev->cond);
+	}
+	else {
+		dev = NULL;
+	}
+
+	pthread_mutex_unlock(&emu_lock);
+
+	pthread_cond_destroy(&emu->cond);
+	close(emu->fd);
+	free(emu);
+
+	if (dev) {
+		pthread_join(dev->thread, NULL);
+		if (dev->report)
+			report(dev);
+		free_device(dev);
+	}
+}
@@ -0,0 +1,55 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * A VPE in the process, for planning pipelines without the hardware.
+ *
+ * The device name "emu", or "emu:" followed by ':' separated options,
+ * opens an emulated mem2mem context instead of a node:
+ *
+ *   setup=<us>	fixed cost of each job (default 300)
+ *   rate=<MB/s>	bytes read plus bytes written per second (default 600)
+ *   depth=<n>	most buffers a queue takes (default 8)
+ *   report	print the load of the device when the last context closes
+ *
+ * The emulator answers the ioctls v4l2_m2m.c issues and converts in
+ * software. A job takes setup plus its bytes over rate, however fast
+ * the CPU converted it; contexts opened with the same name share one
+ * device that runs their jobs one at a time, like the hardware. The fd
+ * polls readable when a capture buffer is done.
+ */
+
+#ifndef V4L2_EMU_H
+#define V4L2_EMU_H
+
+#define V4L2_EMU_NAME "emu"
+
+struct v4l2_emu;
+
+/* whether device names the emulator rather than a node */
+int v4l2_emu_match(const char *device);
+
+/* the fd of a new context, -1 with errno set */
+int v4l2_emu_open(const char *device);
+
+/* the context behind devfd, NULL for a real device */
+struct v4l2_emu *v4l2_emu_get(int devfd);
+
+int v4l2_emu_ioctl(struct v4l2_emu *emu, unsigned long request, void *arg);
+void v4l2_emu_close(struct v4l2_emu *emu);
+
+#endif /* V4L2_EMU_H */
@@ -27,6 +27,13 @@
 #include <linux/v4l2-controls.h>
 
 #include <sys/ioctl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "v4l2_m2m.h"
+#include "v4l2_trace.h"
+#include "v4l2_emu.h"
 
 #ifdef DEBUG
 #define ERROR(fmt, ...) \
@@ -37,9 +44,231 @@
 #endif
 
 
+/* the trace file, opened on the first call when GST_VPE_TRACE is set */
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file;
+
+
+static void trace_close(void)
+{
+	pthread_mutex_lock(&trace_lock);
+	if (trace_file)
+		fclose(trace_file);
+	trace_file = NULL;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+
+static void trace_open(void)
+{
+	struct v4l2_trace_header hdr;
+	const char *path;
+
+	path = getenv(V4L2_TRACE_ENV);
+	if (path == NULL || *path == '\0')
+		return;
+
+	trace_file = fopen(path, "wb");
+	if (trace_file == NULL) {
+		ERROR("can't open trace %s: %s", path, strerror(errno));
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, V4L2_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = V4L2_TRACE_VERSION;
+	hdr.word_size = sizeof(long);
+	fwrite(&hdr, sizeof(hdr), 1, trace_file);
+
+	/* stdio buffers the records, the tail is written at exit */
+	atexit(trace_close);
+}
+
+
+static uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void trace_write(struct v4l2_trace_record *rec, const void *arg,
+		uint32_t size, const void *extra, uint32_t extra_size)
+{
+	rec->size = size + extra_size;
+
+	pthread_mutex_lock(&trace_lock);
+	if (trace_file) {
+		fwrite(rec, sizeof(*rec), 1, trace_file);
+		if (size)
+			fwrite(arg, size, 1, trace_file);
+		if (extra_size)
+			fwrite(extra, extra_size, 1, trace_file);
+	}
+	pthread_mutex_unlock(&trace_lock);
+}
+
+
+/* the node's ioctl, or the emulator's */
+static int device_ioctl(int devfd, unsigned long request, void *arg)
+{
+	struct v4l2_emu *emu = v4l2_emu_get(devfd);
+
+	if (emu)
+		return v4l2_emu_ioctl(emu, request, arg);
+	return ioctl(devfd, request, arg);
+}
+
+
+/* ioctl(), recorded when tracing */
+int v4l2_ioctl(int devfd, unsigned long request, void *arg)
+{
+	struct v4l2_trace_record rec;
+	struct v4l2_buffer *buf = arg;
+	uint32_t extra_size = 0;
+	int ret;
+
+	pthread_once(&trace_once, trace_open);
+	if (trace_file == NULL)
+		return device_ioctl(devfd, request, arg);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.start_ns = trace_now();
+	ret = device_ioctl(devfd, request, arg);
+	rec.err = ret < 0 ? errno : 0;
+	rec.end_ns = trace_now();
+	rec.request = request;
+	rec.fd = devfd;
+	rec.ret = ret;
+
+	/* the planes hang off the buffer by pointer */
+	if ((request == VIDIOC_QBUF || request == VIDIOC_DQBUF ||
+			request == VIDIOC_QUERYBUF) &&
+			V4L2_TYPE_IS_MULTIPLANAR(buf->type) && buf->m.planes)
+		extra_size = (buf->length < VIDEO_MAX_PLANES ?
+			buf->length : VIDEO_MAX_PLANES) *
+			sizeof(struct v4l2_plane);
+
+	trace_write(&rec, arg, _IOC_SIZE(request),
+			extra_size ? buf->m.planes : NULL, extra_size);
+
+	errno = rec.err;
+	return ret;
+}
+
+
+/* poll() on one device, recorded when tracing */
+static int trace_poll(struct pollfd *pfd, int timeout_ms)
+{
+	struct v4l2_trace_record rec;
+	struct v4l2_trace_poll arg;
+	int ret;
+
+	pthread_once(&trace_once, trace_open);
+	if (trace_file == NULL)
+		return poll(pfd, 1, timeout_ms);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.start_ns = trace_now();
+	ret = poll(pfd, 1, timeout_ms);
+	rec.err = ret < 0 ? errno : 0;
+	rec.end_ns = trace_now();
+	rec.request = V4L2_TRACE_POLL;
+	rec.fd = pfd->fd;
+	rec.ret = ret;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.timeout_ms = timeout_ms;
+	arg.events = pfd->events;
+	arg.revents = pfd->revents;
+	trace_write(&rec, &arg, sizeof(arg), NULL, 0);
+
+	errno = rec.err;
+	return ret;
+}
+
+
+static int device_open(const char *device)
+{
+	if (v4l2_emu_match(device))
+		return v4l2_emu_open(device);
+	return open(device, O_RDWR);
+}
+
+
+static int device_close(int devfd)
+{
+	struct v4l2_emu *emu = v4l2_emu_get(devfd);
+
+	if (emu) {
+		v4l2_emu_close(emu);
+		return 0;
+	}
+	return close(devfd);
+}
+
+
+/* a node, or an emulated VPE for the names in v4l2_emu.h; recorded with
+ * the name when tracing */
+int v4l2_open(const char *device)
+{
+	struct v4l2_trace_record rec;
+	int fd;
+
+	pthread_once(&trace_once, trace_open);
+	if (trace_file == NULL)
+		return device_open(device);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.start_ns = trace_now();
+	fd = device_open(device);
+	rec.err = fd < 0 ? errno : 0;
+	rec.end_ns = trace_now();
+	rec.request = V4L2_TRACE_OPEN;
+	rec.fd = fd;
+	rec.ret = fd;
+	trace_write(&rec, device, strlen(device) + 1, NULL, 0);
+
+	errno = rec.err;
+	return fd;
+}
+
+
+int v4l2_close(int devfd)
+{
+	struct v4l2_trace_record rec;
+	int ret;
+
+	pthread_once(&trace_once, trace_open);
+	if (trace_file == NULL)
+		return device_close(devfd);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.start_ns = trace_now();
+	ret = device_close(devfd);
+	rec.err = ret < 0 ? errno : 0;
+	rec.end_ns = trace_now();
+	rec.request = V4L2_TRACE_CLOSE;
+	rec.fd = devfd;
+	rec.ret = ret;
+	trace_write(&rec, NULL, 0, NULL, 0);
+
+	errno = rec.err;
+	return ret;
+}
+
+
+/*
+ * memory is V4L2_MEMORY_DMABUF or V4L2_MEMORY_USERPTR, for the whole
+ * queue. stride 0 takes the driver's line pitch, otherwise the driver
+ * must keep the one given.
+ */
 int v4l2_request_buffer(int devfd,
-		int width, int height, int fourcc, int clrspc,
-		unsigned int num, int is_input, uint32_t *sizeimage)
+		int width, int height, int fourcc, int clrspc, unsigned int stride,
+		unsigned int num, int is_input, int memory, uint32_t *sizeimage)
 {
 	struct v4l2_format fmt;
 	struct v4l2_requestbuffers reqbuf;
@@ -61,29 +290,37 @@ int v4l2_request_buffer(int devfd,
 	fmt.fmt.pix_mp.pixelformat = fourcc;
 	fmt.fmt.pix_mp.colorspace = clrspc;
 	fmt.fmt.pix_mp.num_planes = 1;
+	fmt.fmt.pix_mp.plane_fmt[0].bytesperline = stride;
 	fmt.fmt.pix_mp.field = V4L2_FIELD_ANY;
 
-	ret = ioctl(devfd, VIDIOC_S_FMT, &fmt);
+	ret = v4l2_ioctl(devfd, VIDIOC_S_FMT, &fmt);
 	if (ret < 0) {
 		ERROR("VIDIOC_S_FMT failed: %s (%d)", strerror(errno), ret);
 		return -1;
 	}
 
+	if (stride && fmt.fmt.pix_mp.plane_fmt[0].bytesperline != stride) {
+		ERROR("stride %u not taken, the driver uses %u", stride,
+				fmt.fmt.pix_mp.plane_fmt[0].bytesperline);
+		errno = EINVAL;
+		return -1;
+	}
+
 	*sizeimage = fmt.fmt.pix_mp.plane_fmt[0].sizeimage;
 
 	memset(&reqbuf, 0, sizeof(reqbuf));
 	reqbuf.type = type;
-	reqbuf.memory = V4L2_MEMORY_DMABUF;
+	reqbuf.memory = memory;
 	reqbuf.count = num;
 
-	ret = ioctl(devfd, VIDIOC_REQBUFS, &reqbuf);
+	ret = v4l2_ioctl(devfd, VIDIOC_REQBUFS, &reqbuf);
 	if (ret < 0) {
 		ERROR("VIDIOC_REQBUFS failed: %s (%d)", strerror(errno), ret);
 		return -1;
 	}
 
 	if (reqbuf.count != num ||
-		reqbuf.type != type || reqbuf.memory != V4L2_MEMORY_DMABUF) {
+		reqbuf.type != type || reqbuf.memory != (uint32_t)memory) {
 			ERROR("unsupported..");
 			return -1;
 	}
@@ -98,7 +335,7 @@ int v4l2_request_buffer(int devfd,
 
 	memset(&vbuffer, 0, sizeof(vbuffer));
 	vbuffer.type = type;
-	vbuffer.memory = V4L2_MEMORY_DMABUF;
+	vbuffer.memory = memory;
 	vbuffer.field = V4L2_FIELD_ANY;
 	vbuffer.m.planes = &buf_plane;
 	vbuffer.length = 1;
@@ -106,7 +343,7 @@ int v4l2_request_buffer(int devfd,
 	for (i = 0; i < num; i++) {
 		vbuffer.index = i;
 
-		ret = ioctl(devfd, VIDIOC_QUERYBUF, &vbuffer);
+		ret = v4l2_ioctl(devfd, VIDIOC_QUERYBUF, &vbuffer);
 		if (ret < 0) {
 			ERROR("VIDIOC_QUERYBUF failed: %s (%d)", strerror(errno), ret);
 			return -1;
@@ -117,6 +354,187 @@ int v4l2_request_buffer(int devfd,
 }
 
 
+/* the driver's name and version (KERNEL_VERSION), to tell devices apart */
+int v4l2_query_driver(int devfd, char *driver, size_t size, uint32_t *version)
+{
+	struct v4l2_capability cap;
+	int ret;
+
+	memset(&cap, 0, sizeof(cap));
+	ret = v4l2_ioctl(devfd, VIDIOC_QUERYCAP, &cap);
+	if (ret < 0) {
+		ERROR("VIDIOC_QUERYCAP failed: %s (%d)", strerror(errno), ret);
+		return -1;
+	}
+
+	snprintf(driver, size, "%.*s", (int)sizeof(cap.driver), cap.driver);
+	*version = cap.version;
+
+	return 0;
+}
+
+
+/* the index-th pixel format of a queue, -1 past the last one */
+int v4l2_enum_format(int devfd, unsigned int index, int is_input,
+		uint32_t *fourcc)
+{
+	struct v4l2_fmtdesc desc;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.index = index;
+	if (is_input)
+		desc.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	else
+		desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+
+	if (v4l2_ioctl(devfd, VIDIOC_ENUM_FMT, &desc) < 0)
+		return -1;
+
+	*fourcc = desc.pixelformat;
+	return 0;
+}
+
+
+/* the size the driver makes of width x height, without applying it */
+static int try_size(int devfd, uint32_t fourcc, int is_input,
+		unsigned int *width, unsigned int *height)
+{
+	struct v4l2_format fmt;
+	int ret;
+
+	memset(&fmt, 0, sizeof(fmt));
+	if (is_input)
+		fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	else
+		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	fmt.fmt.pix_mp.width = *width;
+	fmt.fmt.pix_mp.height = *height;
+	fmt.fmt.pix_mp.pixelformat = fourcc;
+	fmt.fmt.pix_mp.field = V4L2_FIELD_ANY;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_TRY_FMT, &fmt);
+	if (ret < 0) {
+		ERROR("VIDIOC_TRY_FMT failed: %s (%d)", strerror(errno), ret);
+		return -1;
+	}
+
+	/* a driver that doesn't take the format falls back to another */
+	if (fmt.fmt.pix_mp.pixelformat != fourcc)
+		return -1;
+
+	*width = fmt.fmt.pix_mp.width;
+	*height = fmt.fmt.pix_mp.height;
+	return 0;
+}
+
+
+/*
+ * The frame sizes a queue takes in fourcc. Drivers without
+ * VIDIOC_ENUM_FRAMESIZES, the VPE among them, are asked with TRY_FMT at
+ * the extremes, which they clamp to their limits.
+ */
+int v4l2_get_size_range(int devfd, uint32_t fourcc, int is_input,
+		struct v4l2_frmsize_stepwise *range)
+{
+	struct v4l2_frmsizeenum fsize;
+	unsigned int width, height;
+
+	memset(&fsize, 0, sizeof(fsize));
+	fsize.index = 0;
+	fsize.pixel_format = fourcc;
+
+	if (v4l2_ioctl(devfd, VIDIOC_ENUM_FRAMESIZES, &fsize) == 0) {
+		if (fsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+			range->min_width = range->max_width =
+				fsize.discrete.width;
+			range->min_height = range->max_height =
+				fsize.discrete.height;
+		}
+		else {
+			*range = fsize.stepwise;
+		}
+		return 0;
+	}
+
+	width = height = 1;
+	if (try_size(devfd, fourcc, is_input, &width, &height) < 0)
+		return -1;
+	range->min_width = width;
+	range->min_height = height;
+
+	width = height = 65535;
+	if (try_size(devfd, fourcc, is_input, &width, &height) < 0)
+		return -1;
+	range->max_width = width;
+	range->max_height = height;
+
+	range->step_width = range->step_height = 1;
+	return 0;
+}
+
+
+/* free the buffers of a queue, needed before its format can change */
+int v4l2_release_buffer(int devfd, int is_input, int memory)
+{
+	struct v4l2_requestbuffers reqbuf;
+	int ret;
+
+	memset(&reqbuf, 0, sizeof(reqbuf));
+	if (is_input)
+		reqbuf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	else
+		reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	reqbuf.memory = memory;
+	reqbuf.count = 0;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_REQBUFS, &reqbuf);
+	if (ret < 0)
+		ERROR("VIDIOC_REQBUFS(0) failed: %s (%d)", strerror(errno), ret);
+
+	return ret;
+}
+
+
+static int set_selection(int devfd, uint32_t type, uint32_t target,
+		int left, int top, int width, int height)
+{
+	struct v4l2_selection sel;
+	int ret;
+
+	memset(&sel, 0, sizeof(sel));
+	sel.type = type;
+	sel.target = target;
+	sel.r.left = left;
+	sel.r.top = top;
+	sel.r.width = width;
+	sel.r.height = height;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_S_SELECTION, &sel);
+	if (ret < 0) {
+		ERROR("VIDIOC_S_SELECTION failed: %s (%d)", strerror(errno), ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* the part of the input frame the device reads, applies to later jobs */
+int v4l2_set_crop(int devfd, int left, int top, int width, int height)
+{
+	return set_selection(devfd, V4L2_BUF_TYPE_VIDEO_OUTPUT,
+			V4L2_SEL_TGT_CROP, left, top, width, height);
+}
+
+
+/* the part of the output frame the device writes, applies to later jobs */
+int v4l2_set_compose(int devfd, int left, int top, int width, int height)
+{
+	return set_selection(devfd, V4L2_BUF_TYPE_VIDEO_CAPTURE,
+			V4L2_SEL_TGT_COMPOSE, left, top, width, height);
+}
+
+
 int v4l2_queue_buffer(int devfd, int buf_idx, int dma_fd, uint32_t sizeimage, int is_input)
 {
 	int ret;
@@ -146,7 +564,7 @@ int v4l2_queue_buffer(int devfd, int buf_idx, int dma_fd, uint32_t sizeimage, in
 	buffer.m.planes = &buf_plane;
 	buffer.length = 1;
 
-	ret = ioctl(devfd, VIDIOC_QBUF, &buffer);
+	ret = v4l2_ioctl(devfd, VIDIOC_QBUF, &buffer);
 	if (ret < 0) {
 		ERROR("VIDIOC_QBUF failed: %s (%d)", strerror(errno), ret);
 		return -1;
@@ -156,7 +574,57 @@ int v4l2_queue_buffer(int devfd, int buf_idx, int dma_fd, uint32_t sizeimage, in
 }
 
 
-int v4l2_dequeue_buffer(int devfd, int is_input)
+/*
+ * Queue memory the caller mapped, on a queue requested with
+ * V4L2_MEMORY_USERPTR. The device pins the pages, it refuses them
+ * (EFAULT or EINVAL) when it can't reach them, e.g. a non-contiguous
+ * buffer on a device without an IOMMU; nothing is queued then.
+ */
+int v4l2_queue_userptr(int devfd, int buf_idx, void *ptr, uint32_t sizeimage, int is_input)
+{
+	int ret;
+	struct v4l2_buffer buffer;
+	struct v4l2_plane buf_plane;
+	uint32_t type, bytesused;
+
+	if (is_input) {
+		type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+		bytesused = sizeimage;
+	}
+	else {
+		type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+		bytesused = 0;
+	}
+
+	memset(&buf_plane, 0, sizeof(buf_plane));
+	buf_plane.m.userptr = (unsigned long)ptr;
+	buf_plane.bytesused = bytesused;
+	buf_plane.length = sizeimage;
+
+	memset(&buffer, 0, sizeof(buffer));
+	buffer.type = type;
+	buffer.memory = V4L2_MEMORY_USERPTR;
+	buffer.index = buf_idx;
+	buffer.field = V4L2_FIELD_ANY;
+	buffer.m.planes = &buf_plane;
+	buffer.length = 1;
+
+	ret = v4l2_ioctl(devfd, VIDIOC_QBUF, &buffer);
+	if (ret < 0) {
+		/* the caller tells a refused buffer by errno */
+		ret = errno;
+		ERROR("VIDIOC_QBUF(%p) failed: %s", ptr, strerror(ret));
+		errno = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* the index of a finished buffer, flags if not NULL receives its
+ * V4L2_BUF_FLAG_* */
+int v4l2_dequeue_buffer(int devfd, int is_input, int memory, uint32_t *flags)
 {
 	struct v4l2_buffer buffer;
 	struct v4l2_plane buf_plane;
@@ -172,20 +640,51 @@ int v4l2_dequeue_buffer(int devfd, int is_input)
 
 	memset(&buffer, 0, sizeof(buffer));
 	buffer.type	= type;
-	buffer.memory = V4L2_MEMORY_DMABUF;
+	buffer.memory = memory;
 	buffer.m.planes = &buf_plane;
 	buffer.length = 1;
 
-	ret = ioctl(devfd, VIDIOC_DQBUF, &buffer);
+	ret = v4l2_ioctl(devfd, VIDIOC_DQBUF, &buffer);
 	if (ret < 0) {
 		ERROR("VIDIOC_DQBUF failed: %s (%d)", strerror(errno), ret);
 		return -1;
 	}
 
+	if (flags)
+		*flags = buffer.flags;
+
 	return (int)buffer.index;
 }
 
 
+/* wait for a finished capture buffer: 1 ready, 0 timed out, -1 error */
+int v4l2_wait_buffer(int devfd, int timeout_ms)
+{
+	struct pollfd pfd;
+	int ret;
+
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.fd = devfd;
+	pfd.events = POLLIN;
+
+	do {
+		ret = trace_poll(&pfd, timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		ERROR("poll failed: %s (%d)", strerror(errno), ret);
+		return -1;
+	}
+
+	if (ret > 0 && (pfd.revents & (POLLERR | POLLNVAL))) {
+		ERROR("device error (revents:%#x)", pfd.revents);
+		return -1;
+	}
+
+	return ret > 0 ? 1 : 0;
+}
+
+
 int v4l2_stream_on(int devfd, int is_input)
 {
 	int ret;
@@ -196,7 +695,7 @@ int v4l2_stream_on(int devfd, int is_input)
 	else
 		type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 
-	ret = ioctl(devfd, VIDIOC_STREAMON, &type);
+	ret = v4l2_ioctl(devfd, VIDIOC_STREAMON, &type);
 	if (ret)
 		ERROR("VIDIOC_STREAMON failed: %s (%d)", strerror(errno), ret);
 
@@ -214,7 +713,7 @@ int v4l2_stream_off(int devfd, int is_input)
 	else
 		type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 
-	ret = ioctl(devfd, VIDIOC_STREAMOFF, &type);
+	ret = v4l2_ioctl(devfd, VIDIOC_STREAMOFF, &type);
 	if (ret)
 		ERROR("VIDIOC_STREAMOFF failed: %s (%d)", strerror(errno), ret);
 
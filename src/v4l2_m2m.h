@@ -18,11 +18,30 @@
 #ifndef V4L2_M2M_H
 #define V4L2_M2M_H
 
+struct v4l2_frmsize_stepwise;
+
+/* open(O_RDWR) and close() of a node, or of the emulator (v4l2_emu.h) */
+int v4l2_open(const char *device);
+int v4l2_close(int devfd);
+
+/* ioctl(), recorded when GST_VPE_TRACE is set (v4l2_trace.h) */
+int v4l2_ioctl(int devfd, unsigned long request, void *arg);
+
+int v4l2_query_driver(int devfd, char *driver, size_t size, uint32_t *version);
+int v4l2_enum_format(int devfd, unsigned int index, int is_input,
+		uint32_t *fourcc);
+int v4l2_get_size_range(int devfd, uint32_t fourcc, int is_input,
+		struct v4l2_frmsize_stepwise *range);
 int v4l2_request_buffer(int devfd,
-		int width, int height, int fourcc, int clrspc,
-		unsigned int num, int is_input, uint32_t *sizeimage);
+		int width, int height, int fourcc, int clrspc, unsigned int stride,
+		unsigned int num, int is_input, int memory, uint32_t *sizeimage);
+int v4l2_release_buffer(int devfd, int is_input, int memory);
+int v4l2_set_crop(int devfd, int left, int top, int width, int height);
+int v4l2_set_compose(int devfd, int left, int top, int width, int height);
 int v4l2_queue_buffer(int devfd, int buf_idx, int dma_fd, uint32_t sizeimage, int is_input);
-int v4l2_dequeue_buffer(int devfd, int is_input);
+int v4l2_queue_userptr(int devfd, int buf_idx, void *ptr, uint32_t sizeimage, int is_input);
+int v4l2_dequeue_buffer(int devfd, int is_input, int memory, uint32_t *flags);
+int v4l2_wait_buffer(int devfd, int timeout_ms);
 int v4l2_stream_on(int devfd, int is_input);
 int v4l2_stream_off(int devfd, int is_input);
 
@@ -0,0 +1,69 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Trace of the calls v4l2_m2m.c makes on the devices. With GST_VPE_TRACE
+ * naming a file, every open, close, ioctl and poll is appended to it as a
+ * record: when it was issued and returned (CLOCK_MONOTONIC), the fd, the
+ * result and the argument as the call left it. A v4l2_buffer is followed
+ * by its planes. Records are written as the calls return, calls from
+ * different threads can start out of order.
+ *
+ * The arguments keep the recording machine's struct layout, a trace
+ * replays on the same architecture only (word_size).
+ */
+
+#ifndef V4L2_TRACE_H
+#define V4L2_TRACE_H
+
+#include <stdint.h>
+
+#define V4L2_TRACE_ENV "GST_VPE_TRACE"
+
+#define V4L2_TRACE_MAGIC "VPETRACE"
+#define V4L2_TRACE_VERSION 2
+
+/* requests of the records that are not ioctls, no ioctl is this small */
+#define V4L2_TRACE_POLL 0
+#define V4L2_TRACE_OPEN 1	/* the fd returned, the node's name follows */
+#define V4L2_TRACE_CLOSE 2	/* no argument */
+
+struct v4l2_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t word_size;	/* sizeof(long) of the recording process */
+};
+
+struct v4l2_trace_record {
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint32_t request;	/* the ioctl, or V4L2_TRACE_POLL */
+	int32_t fd;
+	int32_t ret;
+	int32_t err;		/* errno, when ret < 0 */
+	uint32_t size;		/* bytes of argument after the record */
+	uint32_t reserved;
+};
+
+/* the argument of a poll() record */
+struct v4l2_trace_poll {
+	int32_t timeout_ms;
+	int16_t events;
+	int16_t revents;
+};
+
+#endif /* V4L2_TRACE_H */
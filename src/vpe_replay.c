@@ -0,0 +1,579 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * vpe-replay: drives a device with the calls of a GST_VPE_TRACE trace.
+ *
+ * Each recorded open gets a device of its own, opened and closed when the
+ * recording did, and each queued buffer a CMEM buffer standing in for the
+ * recorded one. An fd used without an open record, in a version 1 trace,
+ * is opened on first use. The calls go out at their recorded times
+ * (scaled with -s), counted from the earliest one, and the report
+ * compares how long they took then and now, and how full the queues ran.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+
+#include "vpeconv.h"
+#include "v4l2_m2m.h"
+#include "v4l2_trace.h"
+
+#define MAX_FDS 64
+#define MAX_BUFS 32
+
+/* how far behind its recorded time a call may go out */
+#define LATE_NS 1000000ULL
+
+/* a buffer standing in for a recorded one */
+typedef struct {
+	void *data;
+	int fd;
+	uint32_t size;
+} stand_in;
+
+/* the two queues of a device, indexed by is_input */
+typedef struct {
+	int rec_fd;
+	int closed;		/* the recording closed rec_fd, it may come again */
+	char *node;
+	int fd;
+	stand_in bufs[2][MAX_BUFS];
+	unsigned int queued[2];
+	unsigned int max_queued[2];
+} device;
+
+typedef struct {
+	uint32_t request;
+	const char *name;
+	unsigned int calls;
+	unsigned int rec_failed;
+	unsigned int failed;
+	uint64_t rec_ns;
+	uint64_t rec_max_ns;
+	uint64_t play_ns;
+	uint64_t play_max_ns;
+} call_stats;
+
+static call_stats calls[] = {
+	{ V4L2_TRACE_POLL, "poll" },
+	{ V4L2_TRACE_OPEN, "open" },
+	{ V4L2_TRACE_CLOSE, "close" },
+	{ VIDIOC_QUERYCAP, "QUERYCAP" },
+	{ VIDIOC_ENUM_FMT, "ENUM_FMT" },
+	{ VIDIOC_ENUM_FRAMESIZES, "ENUM_FRAMESIZES" },
+	{ VIDIOC_TRY_FMT, "TRY_FMT" },
+	{ VIDIOC_S_FMT, "S_FMT" },
+	{ VIDIOC_S_PARM, "S_PARM" },
+	{ VIDIOC_REQBUFS, "REQBUFS" },
+	{ VIDIOC_QUERYBUF, "QUERYBUF" },
+	{ VIDIOC_S_SELECTION, "S_SELECTION" },
+	{ VIDIOC_QBUF, "QBUF" },
+	{ VIDIOC_DQBUF, "DQBUF" },
+	{ VIDIOC_STREAMON, "STREAMON" },
+	{ VIDIOC_STREAMOFF, "STREAMOFF" },
+	{ 0xffffffff, "other" },
+};
+#define N_CALLS (sizeof(calls) / sizeof(calls[0]))
+
+static device devices[MAX_FDS];
+static unsigned int num_devices;
+
+/* device nodes given with -d, handed out to the recorded fds in turn */
+static const char *nodes[MAX_FDS];
+static unsigned int num_nodes;
+
+static unsigned int late_calls;
+
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+
+static call_stats *get_call(uint32_t request)
+{
+	unsigned int i;
+
+	for (i = 0; i < N_CALLS - 1; i++)
+		if (calls[i].request == request)
+			return &calls[i];
+	return &calls[N_CALLS - 1];
+}
+
+
+/*
+ * The device replaying a recorded fd. An open record, with the node it
+ * names, starts a new one that its replay opens; a device first seen on
+ * another call is opened here, unless open_it is 0 to only read the trace.
+ */
+static device *get_device(int rec_fd, const char *rec_node, int open_it)
+{
+	device *dev;
+	const char *node;
+	unsigned int i;
+
+	for (i = 0; rec_node == NULL && i < num_devices; i++)
+		if (devices[i].rec_fd == rec_fd && !devices[i].closed)
+			return &devices[i];
+
+	if (num_devices == MAX_FDS) {
+		fprintf(stderr, "more than %d devices in the trace\n", MAX_FDS);
+		return NULL;
+	}
+
+	node = num_devices < num_nodes ? nodes[num_devices] :
+		(num_nodes > 0 ? nodes[num_nodes - 1] :
+		 (rec_node ? rec_node : VPECONV_DEFAULT_DEVICE));
+
+	dev = &devices[num_devices];
+	memset(dev, 0, sizeof(*dev));
+	dev->rec_fd = rec_fd;
+	dev->node = strdup(node);
+	dev->fd = -1;
+
+	if (open_it && rec_node == NULL) {
+		dev->fd = v4l2_open(node);
+		if (dev->fd < 0) {
+			fprintf(stderr, "can't open %s: %s\n", node,
+					strerror(errno));
+			free(dev->node);
+			return NULL;
+		}
+	}
+	if (open_it)
+		printf("recorded fd %d -> %s\n", rec_fd, node);
+
+	num_devices++;
+	return dev;
+}
+
+
+static void free_stand_ins(device *dev)
+{
+	unsigned int q, b;
+
+	for (q = 0; q < 2; q++) {
+		for (b = 0; b < MAX_BUFS; b++) {
+			if (dev->bufs[q][b].data)
+				vpeconv_buffer_free(dev->bufs[q][b].data);
+			dev->bufs[q][b].data = NULL;
+		}
+	}
+}
+
+
+/* a CMEM buffer of at least size for a queued buffer */
+static stand_in *get_stand_in(device *dev, int is_input, unsigned int index,
+		uint32_t size)
+{
+	stand_in *b;
+
+	if (index >= MAX_BUFS)
+		return NULL;
+
+	b = &dev->bufs[is_input][index];
+	if (b->data && b->size >= size)
+		return b;
+
+	if (b->data)
+		vpeconv_buffer_free(b->data);
+	b->fd = vpeconv_buffer_alloc(size, &b->data);
+	if (b->fd < 0) {
+		fprintf(stderr, "can't allocate %u bytes\n", size);
+		b->data = NULL;
+		return NULL;
+	}
+	b->size = size;
+
+	return b;
+}
+
+
+/*
+ * Point a recorded v4l2_buffer at our memory: the planes follow it in the
+ * argument, the dmabuf fd or pointer is the stand-in's.
+ */
+static int fix_buffer(device *dev, struct v4l2_buffer *buf, size_t size)
+{
+	struct v4l2_plane *planes = (struct v4l2_plane *)(buf + 1);
+	stand_in *b;
+	uint32_t length;
+	int is_input;
+
+	is_input = V4L2_TYPE_IS_OUTPUT(buf->type);
+
+	if (V4L2_TYPE_IS_MULTIPLANAR(buf->type)) {
+		if (size < sizeof(*buf) + buf->length * sizeof(*planes))
+			return -1;
+		buf->m.planes = planes;
+		length = buf->length > 0 ? planes[0].length : 0;
+	}
+	else {
+		length = buf->length;
+	}
+
+	/* DQBUF and QUERYBUF only need somewhere to put the planes */
+	if (length == 0 || buf->memory == V4L2_MEMORY_MMAP)
+		return 0;
+
+	b = get_stand_in(dev, is_input, buf->index, length);
+	if (b == NULL)
+		return -1;
+
+	if (V4L2_TYPE_IS_MULTIPLANAR(buf->type)) {
+		if (buf->memory == V4L2_MEMORY_DMABUF)
+			planes[0].m.fd = b->fd;
+		else
+			planes[0].m.userptr = (unsigned long)b->data;
+	}
+	else {
+		if (buf->memory == V4L2_MEMORY_DMABUF)
+			buf->m.fd = b->fd;
+		else
+			buf->m.userptr = (unsigned long)b->data;
+	}
+
+	return 0;
+}
+
+
+/* buffers on the queues after the call, as the recording or the replay saw it */
+static void count_queued(device *dev, const struct v4l2_trace_record *rec,
+		const void *arg, int ret)
+{
+	const struct v4l2_buffer *buf = arg;
+	const struct v4l2_requestbuffers *req = arg;
+	const uint32_t *type = arg;
+	int is_input;
+
+	if (ret < 0)
+		return;
+
+	switch (rec->request) {
+	case VIDIOC_QBUF:
+		is_input = V4L2_TYPE_IS_OUTPUT(buf->type);
+		dev->queued[is_input]++;
+		if (dev->queued[is_input] > dev->max_queued[is_input])
+			dev->max_queued[is_input] = dev->queued[is_input];
+		break;
+	case VIDIOC_DQBUF:
+		is_input = V4L2_TYPE_IS_OUTPUT(buf->type);
+		if (dev->queued[is_input] > 0)
+			dev->queued[is_input]--;
+		break;
+	case VIDIOC_REQBUFS:
+		dev->queued[V4L2_TYPE_IS_OUTPUT(req->type)] = 0;
+		break;
+	case VIDIOC_STREAMOFF:
+		dev->queued[V4L2_TYPE_IS_OUTPUT(*type)] = 0;
+		break;
+	}
+}
+
+
+static int replay_call(device *dev, const struct v4l2_trace_record *rec,
+		void *arg)
+{
+	const struct v4l2_trace_poll *p = arg;
+	struct pollfd pfd;
+	int ret;
+
+	if (rec->request == V4L2_TRACE_OPEN) {
+		dev->fd = v4l2_open(dev->node);
+		return dev->fd;
+	}
+
+	if (rec->request == V4L2_TRACE_CLOSE) {
+		ret = dev->fd >= 0 ? v4l2_close(dev->fd) : 0;
+		dev->fd = -1;
+		free_stand_ins(dev);
+		return ret;
+	}
+
+	if (rec->request == V4L2_TRACE_POLL) {
+		memset(&pfd, 0, sizeof(pfd));
+		pfd.fd = dev->fd;
+		pfd.events = p->events;
+		return poll(&pfd, 1, p->timeout_ms);
+	}
+
+	if ((rec->request == VIDIOC_QBUF || rec->request == VIDIOC_DQBUF ||
+			rec->request == VIDIOC_QUERYBUF) &&
+			fix_buffer(dev, arg, rec->size) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return v4l2_ioctl(dev->fd, rec->request, arg);
+}
+
+
+static void print_call(const struct v4l2_trace_record *rec, uint64_t base,
+		const void *arg, device *dev)
+{
+	const struct v4l2_buffer *buf = arg;
+
+	printf("%12.3f ms fd %2d %-16s ret %3d %9.3f ms",
+			(rec->start_ns - base) / 1e6, rec->fd,
+			get_call(rec->request)->name, rec->ret,
+			(rec->end_ns - rec->start_ns) / 1e6);
+
+	if (rec->request == V4L2_TRACE_OPEN)
+		printf("  %s", (const char *)arg);
+	if (rec->request == VIDIOC_QBUF || rec->request == VIDIOC_DQBUF)
+		printf("  %s %2u, queued %u/%u",
+				V4L2_TYPE_IS_OUTPUT(buf->type) ? "in " : "out",
+				buf->index, dev->queued[1], dev->queued[0]);
+	if (rec->ret < 0)
+		printf("  (%s)", strerror(rec->err));
+	printf("\n");
+}
+
+
+/* the next record and its argument, 0 at the end of the trace */
+static int read_record(FILE *f, struct v4l2_trace_record *rec, void **arg,
+		size_t *arg_size)
+{
+	if (fread(rec, sizeof(*rec), 1, f) != 1)
+		return 0;
+
+	/* room for a terminating NUL after an open's name */
+	if (rec->size + 1 > *arg_size) {
+		*arg_size = rec->size + 1;
+		*arg = realloc(*arg, *arg_size);
+	}
+	if (rec->size && fread(*arg, rec->size, 1, f) != 1) {
+		fprintf(stderr, "truncated trace\n");
+		return 0;
+	}
+	((char *)*arg)[rec->size] = '\0';
+
+	return 1;
+}
+
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device]... [-s speed] [-n] [-p] trace\n"
+		"  -d  device for the next recorded open, the last one repeats\n"
+		"      (default the recorded one, or %s)\n"
+		"  -s  replay speed, 2 issues the calls twice as fast\n"
+		"  -n  no timing, each call as soon as the last returned\n"
+		"  -p  print the trace, without replaying it\n",
+		prog, VPECONV_DEFAULT_DEVICE);
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct v4l2_trace_header hdr;
+	struct v4l2_trace_record rec;
+	call_stats *c;
+	device *dev;
+	FILE *f;
+	void *arg = NULL;
+	size_t arg_size = 0;
+	uint64_t rec_base = UINT64_MAX, play_base, target, start, took;
+	double speed = 1.0;
+	int timing = 1, print_only = 0;
+	int opt, ret;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "d:s:np")) != -1) {
+		switch (opt) {
+		case 'd':
+			if (num_nodes < MAX_FDS)
+				nodes[num_nodes++] = optarg;
+			break;
+		case 's':
+			speed = atof(optarg);
+			if (speed <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'n':
+			timing = 0;
+			break;
+		case 'p':
+			print_only = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	f = fopen(argv[optind], "rb");
+	if (f == NULL) {
+		fprintf(stderr, "can't open %s: %s\n", argv[optind],
+				strerror(errno));
+		return 1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+			memcmp(hdr.magic, V4L2_TRACE_MAGIC, sizeof(hdr.magic)) ||
+			hdr.version < 1 || hdr.version > V4L2_TRACE_VERSION) {
+		fprintf(stderr, "%s is not a trace\n", argv[optind]);
+		return 1;
+	}
+	if (hdr.word_size != sizeof(long) && !print_only) {
+		fprintf(stderr, "recorded on a %u-bit machine, can't replay\n",
+				hdr.word_size * 8);
+		return 1;
+	}
+
+	/* the records follow the calls' returns, the first call issued may
+	 * come later on */
+	while (read_record(f, &rec, &arg, &arg_size))
+		if (rec.start_ns < rec_base)
+			rec_base = rec.start_ns;
+	fseek(f, sizeof(hdr), SEEK_SET);
+	play_base = now_ns();
+
+	while (read_record(f, &rec, &arg, &arg_size)) {
+		/* a failed open has no device behind it */
+		if (rec.request == V4L2_TRACE_OPEN && rec.ret < 0)
+			dev = NULL;
+		else if ((dev = get_device(rec.fd,
+				rec.request == V4L2_TRACE_OPEN ? arg : NULL,
+				!print_only)) == NULL)
+			return 1;
+
+		c = get_call(rec.request);
+		c->calls++;
+		if (rec.ret < 0)
+			c->rec_failed++;
+		c->rec_ns += rec.end_ns - rec.start_ns;
+		if (rec.end_ns - rec.start_ns > c->rec_max_ns)
+			c->rec_max_ns = rec.end_ns - rec.start_ns;
+
+		if (print_only) {
+			if (dev) {
+				count_queued(dev, &rec, arg, rec.ret);
+				dev->closed = rec.request == V4L2_TRACE_CLOSE;
+			}
+			print_call(&rec, rec_base, arg, dev);
+			continue;
+		}
+		if (dev == NULL)
+			continue;
+
+		if (timing) {
+			target = play_base +
+				(uint64_t)((rec.start_ns - rec_base) / speed);
+			start = now_ns();
+			if (start < target)
+				sleep_until(target);
+			else if (start - target > LATE_NS)
+				late_calls++;
+		}
+
+		start = now_ns();
+		ret = replay_call(dev, &rec, arg);
+		took = now_ns() - start;
+
+		if (ret < 0)
+			c->failed++;
+		c->play_ns += took;
+		if (took > c->play_max_ns)
+			c->play_max_ns = took;
+		count_queued(dev, &rec, arg, ret);
+		dev->closed = rec.request == V4L2_TRACE_CLOSE;
+
+		/* a different outcome changes the stream that follows */
+		if ((ret < 0) != (rec.ret < 0))
+			fprintf(stderr, "%.3f ms: %s %s, recorded %s\n",
+					(rec.start_ns - rec_base) / 1e6, c->name,
+					ret < 0 ? strerror(errno) : "succeeded",
+					rec.ret < 0 ? strerror(rec.err) : "success");
+	}
+	fclose(f);
+
+	printf("\n%-16s %7s %7s %12s %12s", "call", "count", "failed",
+			"rec avg ms", "rec max ms");
+	if (!print_only)
+		printf(" %7s %12s %12s", "failed", "play avg ms", "play max ms");
+	printf("\n");
+	for (i = 0; i < N_CALLS; i++) {
+		c = &calls[i];
+		if (c->calls == 0)
+			continue;
+		printf("%-16s %7u %7u %12.3f %12.3f", c->name, c->calls,
+				c->rec_failed, c->rec_ns / 1e6 / c->calls,
+				c->rec_max_ns / 1e6);
+		if (!print_only)
+			printf(" %7u %12.3f %12.3f", c->failed,
+					c->play_ns / 1e6 / c->calls,
+					c->play_max_ns / 1e6);
+		printf("\n");
+	}
+
+	printf("\n");
+	for (i = 0; i < num_devices; i++) {
+		dev = &devices[i];
+		printf("fd %d (%s): most queued %u in, %u out\n", dev->rec_fd,
+				dev->node, dev->max_queued[1],
+				dev->max_queued[0]);
+
+		free_stand_ins(dev);
+		if (dev->fd >= 0)
+			v4l2_close(dev->fd);
+		free(dev->node);
+	}
+	if (timing && !print_only)
+		printf("%u call(s) went out more than %llu ms late\n",
+				late_calls, (unsigned long long)(LATE_NS / 1000000));
+
+	free(arg);
+	return 0;
+}
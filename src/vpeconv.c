@@ -0,0 +1,471 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <linux/videodev2.h>
+
+#include "vpeconv.h"
+#include "v4l2_m2m.h"
+#include "cmem_buf.h"
+
+#ifdef DEBUG
+#define ERROR(fmt, ...) \
+	do { fprintf(stderr, "ERROR:%s:%d: " fmt "\n", __func__, __LINE__,\
+##__VA_ARGS__); } while (0)
+#else
+#define ERROR(fmt, ...)
+#endif
+
+struct vpeconv_session {
+	char *device;
+	int fd;
+
+	/* kept so slots can be requested again after a release or reset */
+	vpeconv_format in_fmt;
+	vpeconv_format out_fmt;
+	vpeconv_memory in_memory;
+	vpeconv_memory out_memory;
+	unsigned int in_stride;		/* 0, the driver's */
+	unsigned int out_stride;
+	unsigned int slots;
+	uint32_t in_size;
+	uint32_t out_size;
+	int has_format;
+	int configured;		/* slots requested */
+	int streaming;
+	int refused;		/* VPECONV_REFUSED_*, by the last submit */
+
+	/* frames on the device, oldest at head; slot i uses buffer index i
+	 * on both queues */
+	void *user_data[VPECONV_MAX_SLOTS];
+	unsigned int head;
+	unsigned int count;
+};
+
+
+vpeconv_session *vpeconv_open(const char *device)
+{
+	vpeconv_session *s;
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		return NULL;
+
+	s->device = strdup(device ? device : VPECONV_DEFAULT_DEVICE);
+	if (s->device == NULL)
+		goto failed;
+
+	s->fd = v4l2_open(s->device);
+	if (s->fd < 0) {
+		ERROR("open %s failed: %s", s->device, strerror(errno));
+		goto failed;
+	}
+
+	return s;
+
+failed:
+	free(s->device);
+	free(s);
+	return NULL;
+}
+
+
+static void stop_streaming(vpeconv_session *s)
+{
+	if (s->streaming) {
+		(void)v4l2_stream_off(s->fd, 1);
+		(void)v4l2_stream_off(s->fd, 0);
+		s->streaming = 0;
+	}
+}
+
+
+/* STREAMOFF gave every queued buffer back, forget the frames */
+static int drop_frames(vpeconv_session *s)
+{
+	int lost = s->count;
+
+	s->head = 0;
+	s->count = 0;
+
+	return lost;
+}
+
+
+static int v4l2_memory(vpeconv_memory memory)
+{
+	return memory == VPECONV_MEMORY_USERPTR ?
+		V4L2_MEMORY_USERPTR : V4L2_MEMORY_DMABUF;
+}
+
+
+static void release_slots(vpeconv_session *s)
+{
+	if (s->configured) {
+		(void)v4l2_release_buffer(s->fd, 1, v4l2_memory(s->in_memory));
+		(void)v4l2_release_buffer(s->fd, 0, v4l2_memory(s->out_memory));
+		s->configured = 0;
+	}
+}
+
+
+static int request_slots(vpeconv_session *s)
+{
+	int ret;
+
+	ret = v4l2_request_buffer(s->fd, s->in_fmt.width, s->in_fmt.height,
+			s->in_fmt.fourcc, s->in_fmt.colorspace, s->in_stride,
+			s->slots, 1,
+			v4l2_memory(s->in_memory), &s->in_size);
+	if (ret < 0)
+		return -1;
+
+	ret = v4l2_request_buffer(s->fd, s->out_fmt.width, s->out_fmt.height,
+			s->out_fmt.fourcc, s->out_fmt.colorspace, s->out_stride,
+			s->slots, 0,
+			v4l2_memory(s->out_memory), &s->out_size);
+	if (ret < 0) {
+		(void)v4l2_release_buffer(s->fd, 1, v4l2_memory(s->in_memory));
+		return -1;
+	}
+
+	s->configured = 1;
+	return 0;
+}
+
+
+void vpeconv_close(vpeconv_session *s)
+{
+	if (s == NULL)
+		return;
+
+	if (s->fd >= 0) {
+		stop_streaming(s);
+		release_slots(s);
+		v4l2_close(s->fd);
+	}
+
+	free(s->device);
+	free(s);
+}
+
+
+int vpeconv_get_fd(vpeconv_session *s)
+{
+	return s->fd;
+}
+
+
+int vpeconv_configure(vpeconv_session *s, const vpeconv_format *in,
+		const vpeconv_format *out, unsigned int slots,
+		uint32_t *in_size, uint32_t *out_size)
+{
+	if (slots == 0 || slots > VPECONV_MAX_SLOTS) {
+		ERROR("unsupported number of slots: %u", slots);
+		return -1;
+	}
+
+	stop_streaming(s);
+	(void)drop_frames(s);
+	release_slots(s);
+
+	s->in_fmt = *in;
+	s->out_fmt = *out;
+	s->slots = slots;
+	s->has_format = 1;
+
+	if (request_slots(s) < 0)
+		return -1;
+
+	if (in_size)
+		*in_size = s->in_size;
+	if (out_size)
+		*out_size = s->out_size;
+
+	return 0;
+}
+
+
+int vpeconv_set_memory(vpeconv_session *s, vpeconv_memory in,
+		vpeconv_memory out)
+{
+	if (in == s->in_memory && out == s->out_memory)
+		return 0;
+
+	/* the queues are requested for one kind of memory */
+	stop_streaming(s);
+	(void)drop_frames(s);
+	release_slots(s);
+
+	s->in_memory = in;
+	s->out_memory = out;
+
+	return 0;
+}
+
+
+int vpeconv_set_stride(vpeconv_session *s, unsigned int in_stride,
+		unsigned int out_stride)
+{
+	s->in_stride = in_stride;
+	s->out_stride = out_stride;
+
+	return 0;
+}
+
+
+int vpeconv_set_crop(vpeconv_session *s, int left, int top,
+		int width, int height)
+{
+	return v4l2_set_crop(s->fd, left, top, width, height);
+}
+
+
+int vpeconv_set_compose(vpeconv_session *s, int left, int top,
+		int width, int height)
+{
+	return v4l2_set_compose(s->fd, left, top, width, height);
+}
+
+
+static int refusable(vpeconv_session *s, int is_input)
+{
+	if ((is_input ? s->in_memory : s->out_memory) != VPECONV_MEMORY_USERPTR)
+		return 0;
+
+	return errno == EFAULT || errno == EINVAL;
+}
+
+
+static int queue_side(vpeconv_session *s, unsigned int slot,
+		const vpeconv_frame *frame, int is_input)
+{
+	if (is_input) {
+		if (s->in_memory == VPECONV_MEMORY_USERPTR)
+			return v4l2_queue_userptr(s->fd, slot, frame->in_ptr,
+					s->in_size, 1);
+		return v4l2_queue_buffer(s->fd, slot, frame->in_fd,
+				s->in_size, 1);
+	}
+
+	if (s->out_memory == VPECONV_MEMORY_USERPTR)
+		return v4l2_queue_userptr(s->fd, slot, frame->out_ptr,
+				s->out_size, 0);
+	return v4l2_queue_buffer(s->fd, slot, frame->out_fd, s->out_size, 0);
+}
+
+
+int vpeconv_submit(vpeconv_session *s, const vpeconv_frame *frames,
+		unsigned int n)
+{
+	unsigned int i, slot;
+	int input_first;
+
+	if (!s->has_format) {
+		ERROR("session not configured");
+		return -1;
+	}
+
+	/* released while idle, the formats are still set */
+	if (!s->configured && request_slots(s) < 0)
+		return -1;
+
+	/*
+	 * Only a USERPTR buffer can be refused. Queue that side first so a
+	 * refusal leaves nothing half queued. With both sides USERPTR the
+	 * output queued first can only be taken back by stopping the
+	 * queue, which is fine while no other frame is on it.
+	 */
+	input_first = s->in_memory == VPECONV_MEMORY_USERPTR &&
+		s->out_memory != VPECONV_MEMORY_USERPTR;
+	s->refused = 0;
+
+	for (i = 0; i < n && s->count < s->slots; i++) {
+		slot = (s->head + s->count) % s->slots;
+
+		if (queue_side(s, slot, &frames[i], input_first) < 0) {
+			if (!refusable(s, input_first))
+				return -1;
+			s->refused = input_first ?
+				VPECONV_REFUSED_INPUT : VPECONV_REFUSED_OUTPUT;
+			break;
+		}
+		if (queue_side(s, slot, &frames[i], !input_first) < 0) {
+			if (!refusable(s, !input_first) || s->count > 0)
+				return -1;
+			stop_streaming(s);
+			(void)v4l2_stream_off(s->fd, input_first);
+			s->refused = input_first ?
+				VPECONV_REFUSED_OUTPUT : VPECONV_REFUSED_INPUT;
+			break;
+		}
+
+		s->user_data[slot] = frames[i].user_data;
+		s->count++;
+	}
+
+	if (i > 0 && !s->streaming) {
+		if (v4l2_stream_on(s->fd, 0) < 0)
+			return -1;
+		if (v4l2_stream_on(s->fd, 1) < 0) {
+			(void)v4l2_stream_off(s->fd, 0);
+			return -1;
+		}
+		s->streaming = 1;
+	}
+
+	return (int)i;
+}
+
+
+int vpeconv_complete(vpeconv_session *s, vpeconv_completion *done,
+		unsigned int max, int timeout_ms)
+{
+	unsigned int n = 0;
+	uint32_t out_flags, in_flags;
+	int ret, index;
+
+	while (n < max && s->count > 0) {
+		/* only the first frame is waited for */
+		ret = v4l2_wait_buffer(s->fd, n == 0 ? timeout_ms : 0);
+		if (ret < 0)
+			goto failed;
+		if (ret == 0)
+			break;
+
+		index = v4l2_dequeue_buffer(s->fd, 0,
+				v4l2_memory(s->out_memory), &out_flags);
+		if (index < 0)
+			goto failed;
+		if (v4l2_dequeue_buffer(s->fd, 1, v4l2_memory(s->in_memory),
+					&in_flags) < 0)
+			goto failed;
+
+		/* the device runs the jobs in order */
+		if ((unsigned int)index != s->head) {
+			ERROR("frame %d done before frame %u", index, s->head);
+			goto failed;
+		}
+
+		/* the driver flags a frame it could not process */
+		done[n].user_data = s->user_data[s->head];
+		done[n].status = (out_flags | in_flags) & V4L2_BUF_FLAG_ERROR ?
+			-EIO : 0;
+		n++;
+
+		s->head = (s->head + 1) % s->slots;
+		s->count--;
+	}
+
+	return (int)n;
+
+failed:
+	/* report what finished, the failure shows on the next call */
+	return n > 0 ? (int)n : -1;
+}
+
+
+int vpeconv_refused(vpeconv_session *s)
+{
+	return s->refused;
+}
+
+
+unsigned int vpeconv_in_flight(vpeconv_session *s)
+{
+	return s->count;
+}
+
+
+int vpeconv_flush(vpeconv_session *s)
+{
+	stop_streaming(s);
+	return drop_frames(s);
+}
+
+
+/*
+ * Bring the device back after a failed or stuck job: reset both queues,
+ * reopening the device if that is not enough.
+ */
+int vpeconv_reset(vpeconv_session *s)
+{
+	int lost;
+
+	lost = vpeconv_flush(s);
+	release_slots(s);
+
+	if (s->fd >= 0 && (!s->has_format || request_slots(s) == 0))
+		return lost;
+
+	/* the queues could not be reset in place, start over on a new handle */
+	ERROR("reopening %s", s->device);
+	if (s->fd >= 0)
+		v4l2_close(s->fd);
+
+	s->fd = v4l2_open(s->device);
+	if (s->fd < 0) {
+		ERROR("open %s failed: %s", s->device, strerror(errno));
+		return -1;
+	}
+
+	if (s->has_format && request_slots(s) < 0)
+		return -1;
+
+	return lost;
+}
+
+
+int vpeconv_release(vpeconv_session *s)
+{
+	int lost;
+
+	lost = vpeconv_flush(s);
+	release_slots(s);
+
+	return lost;
+}
+
+
+int vpeconv_buffer_alloc(unsigned int size, void **data)
+{
+	return alloc_cmem_buffer(size, 1, data);
+}
+
+
+void vpeconv_buffer_free(void *data)
+{
+	free_cmem_buffer(data);
+}
+
+
+int vpeconv_buffer_sync(void *data, size_t size, int for_device)
+{
+	return cmem_do_cache_operation(data, size,
+			for_device ? CMEM_CACHE_FLUSH : CMEM_CACHE_INVALIDATE);
+}
@@ -0,0 +1,137 @@
+/* Copyright (C) 2014 Texas Instruments Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * libvpeconv: converts frames on the VPE without GStreamer.
+ *
+ * A session owns the device. Configure it with the input and output
+ * formats, submit frames as pairs of dmabufs and collect them in submit
+ * order with vpeconv_complete(). The fd from vpeconv_get_fd() polls
+ * readable when a frame is done, so completions fit in an event loop.
+ *
+ * Buffers may come from anywhere that exports dmabufs; the vpeconv_buffer
+ * functions allocate from the shared CMEM registry.
+ */
+
+#ifndef VPECONV_H
+#define VPECONV_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VPECONV_DEFAULT_DEVICE "/dev/v4l/by-path/platform-489d0000.vpe-video-index0"
+
+/* most frames a session keeps on the device */
+#define VPECONV_MAX_SLOTS 8
+
+typedef struct vpeconv_session vpeconv_session;
+
+/* how a queue takes its buffers */
+typedef enum {
+	VPECONV_MEMORY_DMABUF,		/* the frame's fd */
+	VPECONV_MEMORY_USERPTR,		/* the frame's pointer, mapped by the caller */
+} vpeconv_memory;
+
+/* one side of the conversion */
+typedef struct {
+	unsigned int width;
+	unsigned int height;
+	uint32_t fourcc;	/* V4L2_PIX_FMT_* */
+	uint32_t colorspace;	/* enum v4l2_colorspace */
+} vpeconv_format;
+
+typedef struct {
+	int in_fd;		/* dmabuf the device reads */
+	int out_fd;		/* dmabuf the device writes */
+	void *in_ptr;		/* the same on a USERPTR queue, at least */
+	void *out_ptr;		/* the size configure returned */
+	void *user_data;	/* handed back on completion */
+} vpeconv_frame;
+
+typedef struct {
+	void *user_data;
+	int status;		/* 0, the output is written; -EIO, it is corrupt */
+} vpeconv_completion;
+
+/* device NULL opens the default VPE node */
+vpeconv_session *vpeconv_open(const char *device);
+void vpeconv_close(vpeconv_session *s);
+int vpeconv_get_fd(vpeconv_session *s);
+
+/* sets the formats and requests the slots, frames in flight are dropped.
+ * in_size and out_size, if not NULL, receive the buffer sizes needed. */
+int vpeconv_configure(vpeconv_session *s, const vpeconv_format *in,
+		const vpeconv_format *out, unsigned int slots,
+		uint32_t *in_size, uint32_t *out_size);
+
+/* DMABUF for both queues until set. Drops the frames in flight, the slots
+ * are requested again on the next configure or submit. */
+int vpeconv_set_memory(vpeconv_session *s, vpeconv_memory in,
+		vpeconv_memory out);
+
+/* the line pitch in bytes of each side from the next configure, 0 for
+ * the driver's own. A strip of a wider frame, queued USERPTR at its first
+ * column, passes the frame's; configure fails if the driver changes it. */
+int vpeconv_set_stride(vpeconv_session *s, unsigned int in_stride,
+		unsigned int out_stride);
+
+/* the part of the input read from now on, reset by configure */
+int vpeconv_set_crop(vpeconv_session *s, int left, int top,
+		int width, int height);
+
+/* the part of the output written from now on, the rest of the frame is
+ * left as it was; reset by configure */
+int vpeconv_set_compose(vpeconv_session *s, int left, int top,
+		int width, int height);
+
+/* queues up to n frames, returns how many fit in the free slots. It also
+ * stops at a frame whose USERPTR buffer the device refuses, that frame
+ * is not queued and the session stays usable. */
+int vpeconv_submit(vpeconv_session *s, const vpeconv_frame *frames,
+		unsigned int n);
+
+/* the side the last submit stopped at, 0 if none was refused */
+#define VPECONV_REFUSED_INPUT	1
+#define VPECONV_REFUSED_OUTPUT	2
+int vpeconv_refused(vpeconv_session *s);
+
+/* up to max finished frames in submit order, waiting timeout_ms (-1 for
+ * ever) for the first; 0 on timeout, -1 when the device failed */
+int vpeconv_complete(vpeconv_session *s, vpeconv_completion *done,
+		unsigned int max, int timeout_ms);
+
+unsigned int vpeconv_in_flight(vpeconv_session *s);
+
+/* these drop the frames in flight and return how many */
+int vpeconv_flush(vpeconv_session *s);
+int vpeconv_reset(vpeconv_session *s);		/* after a failed complete */
+int vpeconv_release(vpeconv_session *s);	/* frees the slots until the next submit */
+
+/* CMEM buffers, sync before the device reads and before the CPU reads */
+int vpeconv_buffer_alloc(unsigned int size, void **data);
+void vpeconv_buffer_free(void *data);
+int vpeconv_buffer_sync(void *data, size_t size, int for_device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VPECONV_H */